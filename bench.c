@@ -0,0 +1,446 @@
+// Набор замеров производительности c_perceptron с выводом результатов в JSON (stdout).
+// - execute: задержка c_perceptron_execute() (перцентили) и пропускная способность c_perceptron_execute_rows()
+//   для топологий от крошечных до широких и глубоких, в том числе с ReLU в скрытых слоях;
+// - pgs: поколения и тестирования потомков в секунду для c_pgs_run() при разных размерах популяции и количестве уроков;
+// - io: пропускная способность c_perceptron_save()/c_perceptron_load().
+// Сборка: cc -std=c11 -O2 bench.c c_perceptron.c -lm -lpthread -lrt -o bench
+// Запуск: ./bench [quick] > result.json
+// Режим quick уменьшает количество замеров для быстрой проверки.
+// Документ печатается только после успешного выполнения всех замеров, ошибки печатаются в stderr.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "c_perceptron.h"
+
+// Имя временного файла для замеров сохранения и загрузки.
+#define BENCH_FILE_NAME "bench_perceptron.tmp"
+
+// Количество строк в пакете при замере c_perceptron_execute_rows().
+#define BENCH_ROWS 256
+
+// Возвращает текущее монотонное время в наносекундах.
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int comp_double(const void *_p1,
+                       const void *_p2)
+{
+    const double d1 = *(const double*)_p1;
+    const double d2 = *(const double*)_p2;
+    return (d1 > d2) - (d1 < d2);
+}
+
+// Возвращает перцентиль _p (0..1) отсортированных замеров.
+static double percentile(const double *const _sorted,
+                         const size_t _count,
+                         const double _p)
+{
+    size_t i = (size_t)(_p * (double)(_count - 1) + 0.5);
+    if (i >= _count)
+    {
+        i = _count - 1;
+    }
+    return _sorted[i];
+}
+
+// Печатает топологию в виде JSON массива.
+static void print_topology(FILE *const _json,
+                           const size_t *const _topology,
+                           const size_t _layers_count)
+{
+    fprintf(_json, "[");
+    for (size_t l = 0; l < _layers_count; ++l)
+    {
+        fprintf(_json, "%s%zu", (l == 0) ? "" : ",", _topology[l]);
+    }
+    fprintf(_json, "]");
+}
+
+// Заполняет массив случайными сигналами [0; 1].
+static void fill_signals(float *const _signals,
+                         const size_t _count,
+                         uint64_t *const _seed)
+{
+    for (size_t i = 0; i < _count; ++i)
+    {
+        *_seed = *_seed * 6364136223846793005LLU + 1;
+        _signals[i] = (float)(*_seed >> 40) / (float)(1 << 24);
+    }
+}
+
+// Замер задержки и пропускной способности выполнения перцептрона заданной топологии.
+// Скрытые слои используют функцию активации _activation, выходной - сигмоиду.
+// Возвращает 0 в случае успеха.
+static int bench_execute(const size_t *const _topology,
+                         const size_t _layers_count,
+                         const size_t _activation,
+                         const int _quick,
+                         const int _first,
+                         FILE *const _json)
+{
+    size_t error;
+    uint64_t seed = 1;
+
+    c_perceptron *const perceptron = c_perceptron_create(_layers_count, _topology, &error);
+    if (perceptron == NULL)
+    {
+        fprintf(stderr, "c_perceptron_create() error: %zu\n", error);
+        return -1;
+    }
+    c_perceptron_noise(perceptron, 1.f, &seed);
+    for (size_t l = 1; l < _layers_count - 1; ++l)
+    {
+        c_perceptron_set_activation(perceptron, l, _activation);
+    }
+
+    const size_t ins_count = _topology[0];
+    const size_t outs_count = _topology[_layers_count - 1];
+
+    // Количество замеров подбирается так, чтобы замер занимал порядка 0.2 секунды (0.02 в режиме quick).
+    float *const ins = c_perceptron_get_ins(perceptron);
+    fill_signals(ins, ins_count, &seed);
+    const double probe_start = now_ns();
+    size_t probe_count = 0;
+    while (now_ns() - probe_start < 1e6)
+    {
+        c_perceptron_execute(perceptron);
+        ++probe_count;
+    }
+    const double call_ns = (now_ns() - probe_start) / (double)probe_count;
+    size_t samples_count = (size_t)(((_quick != 0) ? 2e7 : 2e8) / call_ns);
+    if (samples_count < 100)
+    {
+        samples_count = 100;
+    }
+    if (samples_count > 100000)
+    {
+        samples_count = 100000;
+    }
+
+    double *const samples = malloc(sizeof(double) * samples_count);
+    float *const rows_in = malloc(sizeof(float) * BENCH_ROWS * ins_count);
+    float *const rows_out = malloc(sizeof(float) * BENCH_ROWS * outs_count);
+    if ( (samples == NULL) ||
+         (rows_in == NULL) ||
+         (rows_out == NULL) )
+    {
+        free(samples);
+        free(rows_in);
+        free(rows_out);
+        c_perceptron_delete(perceptron);
+        fprintf(stderr, "malloc() error\n");
+        return -2;
+    }
+
+    // Задержка одиночного выполнения.
+    double sum = 0;
+    for (size_t i = 0; i < samples_count; ++i)
+    {
+        const double t0 = now_ns();
+        c_perceptron_execute(perceptron);
+        samples[i] = now_ns() - t0;
+        sum += samples[i];
+    }
+    qsort(samples, samples_count, sizeof(double), comp_double);
+
+    // Пропускная способность пакетного выполнения.
+    fill_signals(rows_in, BENCH_ROWS * ins_count, &seed);
+    size_t batches_count = samples_count / BENCH_ROWS + 1;
+    const double rows_start = now_ns();
+    for (size_t b = 0; b < batches_count; ++b)
+    {
+        c_perceptron_execute_rows(perceptron, rows_in, ins_count, rows_out, outs_count, BENCH_ROWS);
+    }
+    const double rows_ns = now_ns() - rows_start;
+
+    fprintf(_json, "%s\n    {\"topology\": ", (_first != 0) ? "" : ",");
+    print_topology(_json, _topology, _layers_count);
+    fprintf(_json, ", \"activation\": %zu", _activation);
+    fprintf(_json, ", \"weights\": %zu, \"samples\": %zu, "
+            "\"latency_ns\": {\"min\": %.0f, \"mean\": %.0f, \"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f}, "
+            "\"rows_per_sec\": %.0f}",
+            c_perceptron_get_weights_count(perceptron), samples_count,
+            samples[0], sum / (double)samples_count,
+            percentile(samples, samples_count, 0.5), percentile(samples, samples_count, 0.9),
+            percentile(samples, samples_count, 0.99), percentile(samples, samples_count, 0.999),
+            samples[samples_count - 1],
+            (double)(batches_count * BENCH_ROWS) * 1e9 / rows_ns);
+
+    free(samples);
+    free(rows_in);
+    free(rows_out);
+    c_perceptron_delete(perceptron);
+
+    return 0;
+}
+
+// Замер скорости обучения при заданных размере популяции и количестве уроков.
+// Возвращает 0 в случае успеха.
+static int bench_pgs(const size_t *const _topology,
+                     const size_t _layers_count,
+                     const size_t _pop_count,
+                     const size_t _lessons_count,
+                     const size_t _iterations_count,
+                     const int _first,
+                     FILE *const _json)
+{
+    size_t error;
+    uint64_t seed = 1;
+
+    c_perceptron *const perceptron = c_perceptron_create(_layers_count, _topology, &error);
+    if (perceptron == NULL)
+    {
+        fprintf(stderr, "c_perceptron_create() error: %zu\n", error);
+        return -1;
+    }
+    c_perceptron_noise(perceptron, 1.f, &seed);
+
+    c_pgs *const pgs = c_pgs_create(perceptron, _pop_count, &error);
+    if (pgs == NULL)
+    {
+        c_perceptron_delete(perceptron);
+        fprintf(stderr, "c_pgs_create() error: %zu\n", error);
+        return -2;
+    }
+
+    const size_t ins_outs_count = _topology[0] + _topology[_layers_count - 1];
+    float *const lessons = malloc(sizeof(float) * ins_outs_count * _lessons_count);
+    if (lessons == NULL)
+    {
+        c_pgs_delete(pgs);
+        c_perceptron_delete(perceptron);
+        fprintf(stderr, "malloc() error\n");
+        return -3;
+    }
+    fill_signals(lessons, ins_outs_count * _lessons_count, &seed);
+
+    const double start = now_ns();
+    const ptrdiff_t r_code = c_pgs_run(pgs, perceptron, lessons, _lessons_count, _iterations_count, 1.f, 1.f, &seed);
+    const double elapsed = (now_ns() - start) / 1e9;
+
+    if (r_code < 0)
+    {
+        free(lessons);
+        c_pgs_delete(pgs);
+        c_perceptron_delete(perceptron);
+        fprintf(stderr, "c_pgs_run() error: %td\n", r_code);
+        return -4;
+    }
+
+    // Каждое поколение тестирует pop_count * (pop_count - 1) потомков.
+    const double evaluations = (double)_iterations_count * (double)(_pop_count * (_pop_count - 1));
+
+    fprintf(_json, "%s\n    {\"topology\": ", (_first != 0) ? "" : ",");
+    print_topology(_json, _topology, _layers_count);
+    fprintf(_json, ", \"pop_count\": %zu, \"lessons\": %zu, \"generations\": %zu, \"seconds\": %.6f, "
+            "\"generations_per_sec\": %.3f, \"evaluations_per_sec\": %.1f, \"lesson_evaluations_per_sec\": %.0f}",
+            _pop_count, _lessons_count, _iterations_count, elapsed,
+            (double)_iterations_count / elapsed, evaluations / elapsed,
+            evaluations * (double)_lessons_count / elapsed);
+
+    free(lessons);
+    c_pgs_delete(pgs);
+    c_perceptron_delete(perceptron);
+
+    return 0;
+}
+
+// Замер пропускной способности сохранения и загрузки.
+// Возвращает 0 в случае успеха.
+static int bench_io(const size_t *const _topology,
+                    const size_t _layers_count,
+                    const size_t _repeats,
+                    const int _first,
+                    FILE *const _json)
+{
+    size_t error;
+    uint64_t seed = 1;
+
+    c_perceptron *const perceptron = c_perceptron_create(_layers_count, _topology, &error);
+    if (perceptron == NULL)
+    {
+        fprintf(stderr, "c_perceptron_create() error: %zu\n", error);
+        return -1;
+    }
+    c_perceptron_noise(perceptron, 1.f, &seed);
+
+    double save_ns = 0;
+    double load_ns = 0;
+    for (size_t i = 0; i < _repeats; ++i)
+    {
+        double t0 = now_ns();
+        const ptrdiff_t r_code = c_perceptron_save(perceptron, BENCH_FILE_NAME);
+        save_ns += now_ns() - t0;
+        if (r_code < 0)
+        {
+            c_perceptron_delete(perceptron);
+            fprintf(stderr, "c_perceptron_save() error: %td\n", r_code);
+            return -2;
+        }
+
+        t0 = now_ns();
+        c_perceptron *const loaded_perceptron = c_perceptron_load(BENCH_FILE_NAME, &error);
+        load_ns += now_ns() - t0;
+        if (loaded_perceptron == NULL)
+        {
+            c_perceptron_delete(perceptron);
+            fprintf(stderr, "c_perceptron_load() error: %zu\n", error);
+            return -3;
+        }
+        c_perceptron_delete(loaded_perceptron);
+    }
+    remove(BENCH_FILE_NAME);
+
+    const double bytes = (double)sizeof(float) * (double)c_perceptron_get_weights_count(perceptron);
+
+    fprintf(_json, "%s\n    {\"topology\": ", (_first != 0) ? "" : ",");
+    print_topology(_json, _topology, _layers_count);
+    fprintf(_json, ", \"weights_bytes\": %.0f, \"repeats\": %zu, "
+            "\"save_mb_per_sec\": %.1f, \"load_mb_per_sec\": %.1f, \"save_us\": %.1f, \"load_us\": %.1f}",
+            bytes, _repeats,
+            bytes * (double)_repeats / save_ns * 1e3, bytes * (double)_repeats / load_ns * 1e3,
+            save_ns / (double)_repeats / 1e3, load_ns / (double)_repeats / 1e3);
+
+    c_perceptron_delete(perceptron);
+
+    return 0;
+}
+
+// Печатает в stdout документ, собранный во временном файле.
+// Возвращает 0 в случае успеха.
+static int json_print(FILE *const _json)
+{
+    if ( (ferror(_json) != 0) ||
+         (fseek(_json, 0, SEEK_SET) != 0) )
+    {
+        fprintf(stderr, "JSON buffer error\n");
+        return -1;
+    }
+
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), _json)) > 0)
+    {
+        if (fwrite(buffer, 1, count, stdout) != count)
+        {
+            fprintf(stderr, "stdout write error\n");
+            return -2;
+        }
+    }
+    if ( (ferror(_json) != 0) ||
+         (fflush(stdout) != 0) )
+    {
+        fprintf(stderr, "JSON output error\n");
+        return -3;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if ( (argc > 2) ||
+         ( (argc == 2) && (strcmp(argv[1], "quick") != 0) ) )
+    {
+        fprintf(stderr, "usage: %s [quick]\n", argv[0]);
+        return 1;
+    }
+    const int quick = (argc == 2);
+
+    // Топологии от крошечной до широкой и глубокой.
+    static const size_t t_tiny[] = {1, 5, 8, 1};
+    static const size_t t_small[] = {16, 64, 16};
+    static const size_t t_medium[] = {64, 256, 256, 10};
+    static const size_t t_mnist[] = {784, 512, 512, 10};
+    static const size_t t_wide[] = {256, 4096, 256};
+    static const size_t t_deep[] = {32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 1};
+
+    const struct
+    {
+        const size_t *topology;
+        size_t layers_count;
+        size_t activation;
+    } topologies[] = {
+        {t_tiny, sizeof(t_tiny) / sizeof(size_t), C_ACTIVATION_SIGMOID},
+        {t_small, sizeof(t_small) / sizeof(size_t), C_ACTIVATION_SIGMOID},
+        {t_medium, sizeof(t_medium) / sizeof(size_t), C_ACTIVATION_SIGMOID},
+        {t_mnist, sizeof(t_mnist) / sizeof(size_t), C_ACTIVATION_SIGMOID},
+        {t_wide, sizeof(t_wide) / sizeof(size_t), C_ACTIVATION_SIGMOID},
+        {t_deep, sizeof(t_deep) / sizeof(size_t), C_ACTIVATION_SIGMOID},
+        // Кусочно-линейные скрытые слои.
+        {t_medium, sizeof(t_medium) / sizeof(size_t), C_ACTIVATION_RELU},
+        {t_mnist, sizeof(t_mnist) / sizeof(size_t), C_ACTIVATION_RELU},
+        {t_wide, sizeof(t_wide) / sizeof(size_t), C_ACTIVATION_RELU},
+        {t_deep, sizeof(t_deep) / sizeof(size_t), C_ACTIVATION_RELU},
+    };
+    const size_t topologies_count = sizeof(topologies) / sizeof(topologies[0]);
+
+    // Документ собирается во временном файле, чтобы при ошибке замера stdout не получил обрезанный JSON.
+    FILE *const json = tmpfile();
+    if (json == NULL)
+    {
+        fprintf(stderr, "tmpfile() error\n");
+        return 1;
+    }
+
+    fprintf(json, "{\n  \"quick\": %s,\n  \"execute\": [", (quick != 0) ? "true" : "false");
+    for (size_t t = 0; t < topologies_count; ++t)
+    {
+        if (bench_execute(topologies[t].topology, topologies[t].layers_count, topologies[t].activation,
+                          quick, t == 0, json) != 0)
+        {
+            fclose(json);
+            return 1;
+        }
+    }
+
+    // Обучение: сетка размеров популяции и количества уроков на небольшой сети.
+    static const size_t t_pgs[] = {4, 8, 1};
+    const size_t pop_counts[] = {10, 20, 40};
+    const size_t lessons_counts[] = {9, 100, 1000};
+    fprintf(json, "\n  ],\n  \"pgs\": [");
+    int first = 1;
+    for (size_t p = 0; p < sizeof(pop_counts) / sizeof(size_t); ++p)
+    {
+        for (size_t l = 0; l < sizeof(lessons_counts) / sizeof(size_t); ++l)
+        {
+            // Количество поколений уменьшается с ростом работы на поколение (не меньше 10).
+            const size_t work = pop_counts[p] * pop_counts[p] * lessons_counts[l];
+            size_t iterations_count = ((quick != 0) ? 2000000 : 20000000) / work;
+            if (iterations_count < 10)
+            {
+                iterations_count = 10;
+            }
+            if (bench_pgs(t_pgs, sizeof(t_pgs) / sizeof(size_t), pop_counts[p], lessons_counts[l],
+                          iterations_count, first, json) != 0)
+            {
+                fclose(json);
+                return 1;
+            }
+            first = 0;
+        }
+    }
+
+    fprintf(json, "\n  ],\n  \"io\": [");
+    if ( (bench_io(t_tiny, sizeof(t_tiny) / sizeof(size_t), (quick != 0) ? 100 : 1000, 1, json) != 0) ||
+         (bench_io(t_mnist, sizeof(t_mnist) / sizeof(size_t), (quick != 0) ? 5 : 50, 0, json) != 0) )
+    {
+        fclose(json);
+        return 1;
+    }
+    fprintf(json, "\n  ]\n}\n");
+
+    const int r_code = json_print(json);
+    fclose(json);
+
+    return (r_code == 0) ? 0 : 1;
+}
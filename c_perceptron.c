@@ -1,3 +1,10 @@
+// Интерфейсы POSIX (ftruncate(), shm_open() и т.д.) при компиляции в строгом режиме стандарта C,
+// а также привязка потоков к процессорам (pthread_setaffinity_np()) в Linux.
+// Условие повторяет определение C_PERCEPTRON_POSIX в c_perceptron.h: макрос нужен до первого системного заголовка.
+#if !defined(C_PERCEPTRON_NO_POSIX) && defined(__unix__)
+#define _GNU_SOURCE
+#endif
+
 #include "c_perceptron.h"
 
 #include <stdlib.h>
@@ -6,22 +13,189 @@
 #include <stdio.h>
 #include <limits.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef C_PERCEPTRON_POSIX
+#include <sched.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && defined(C_PERCEPTRON_POSIX)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 #define A 6364136223846793005LLU
 #define C 1
 #define RAND_64_32_MAX UINT32_MAX
 
+// Доля нулевых весов, начиная с которой перцептрон по умолчанию выполняется через CSR.
+#define SPARSE_THRESHOLD 0.75f
+
+// Состояния разреженного (CSR) представления весов.
+#define CSR_UNKNOWN 0// Веса изменились, решение еще не принято.
+#define CSR_DENSE 1// Весов недостаточно мало, используется плотное выполнение.
+#define CSR_READY 2// CSR построено и соответствует весам.
+
+// Выравнивание начала блока памяти перцептрона и выравнивание весов, входов и выходов внутри блока.
+#define BLOCK_ALIGN 64
+#define WEIGHTS_ALIGN 32
+
+// Максимальное количество буферов в одном вызове writev().
+#ifdef IOV_MAX
+#define CHECKPOINT_IOV_MAX IOV_MAX
+#else
+#define CHECKPOINT_IOV_MAX 1024
+#endif
+
+// Максимальное количество узлов NUMA, которые ищутся в /sys/devices/system/node.
+#define NUMA_NODES_MAX 64
+
+// Ширина слоя по умолчанию, начиная с которой нейроны слоя распределяются по потокам перцептрона.
+#define PARALLEL_WIDTH 4096
+
+// Количество аппаратных счетчиков профилировщика (см. C_COUNTER_*).
+#define PROFILE_COUNTERS 5
+
+// Если при инкрементальном выполнении изменилось больше 1/INCREMENTAL_DENSE_SHARE входов слоя,
+// суммы слоя пересчитываются полностью: построчный проход по весам дешевле такого количества столбцов.
+#define INCREMENTAL_DENSE_SHARE 8
+
+// Пустая ссылка в корзинах и цепочках кэша результатов.
+#define CACHE_NONE UINT32_MAX
+
+// Размер порции геномов потомков, которые скрещиваются и тестируются подряд в режиме файла подкачки
+// (см. c_pgs_create_scratch()), пока следующая порция читается с диска.
+#define SCRATCH_CHUNK_SIZE ((size_t)64 << 20)
+
+// Количество блоков, на которые делятся уроки при параллельном тестировании.
+// Разбиение зависит только от количества уроков, поэтому результат не зависит от количества потоков.
+#define LESSONS_BLOCKS 1024
+
+// Минимальная работа (уроки * веса) на поток, при которой параллельное по урокам тестирование окупает запуск
+// задачи пула. При меньшей работе блоки уроков вычисляются вызывающим потоком с тем же результатом.
+#define LESSONS_PARALLEL_WORK ((size_t)1 << 15)
+
+typedef struct s_c_workers c_workers;
+
+// Заголовок блока памяти.
+// Перцептрон вместе с топологией, весами, входами и выходами располагается в одном блоке.
+// Блок удаляется, когда на него не остается ссылок: ссылку держит сам перцептрон, а также каждый
+// перцептрон, использующий веса из этого блока (см. c_perceptron_clone_shared()).
+typedef struct s_c_block
+{
+    atomic_size_t refs;
+    c_allocator allocator;// Распределитель, выделивший блок.
+    size_t size;
+} c_block;
+
+// Состояние инкрементального выполнения (см. c_perceptron_set_incremental()).
+// Для каждого активного нейрона хранится сумма взвешенных входов и выход, для каждого нейрона,
+// кроме нейронов последнего слоя (включая входы), - значение, уже учтенное в суммах следующего слоя.
+// Все массивы идут слой за слоем и расположены в одном блоке с состоянием.
+typedef struct s_c_incremental
+{
+    float epsilon;
+    size_t full_interval;
+    size_t ticks;// Выполнений с последнего полного пересчета.
+    int valid;// 0 - суммы недействительны (веса изменились), нужен полный пересчет.
+
+    float *sums;
+    float *acts;
+    float *sent;
+    size_t outs_offset;// Смещение выходов последнего слоя в acts.
+
+    size_t size;
+    c_allocator allocator;
+} c_incremental;
+
+// Запись кэша результатов.
+typedef struct s_c_cache_slot
+{
+    uint64_t hash;
+    uint32_t next;// Следующая запись в цепочке корзины, CACHE_NONE - конец цепочки.
+    uint32_t referenced;// Бит обращения алгоритма CLOCK.
+} c_cache_slot;
+
+// Кэш результатов выполнения (см. c_perceptron_set_cache()).
+// Записи находятся по хешу входных сигналов через корзины с цепочками и вытесняются алгоритмом CLOCK.
+// Корзины, записи, входные и выходные сигналы записей расположены в одном блоке с кэшем.
+typedef struct s_c_cache
+{
+    size_t capacity;
+    size_t used_count;
+    size_t hand;// Стрелка CLOCK.
+    int valid;// 0 - записи недействительны (веса изменились), кэш очищается при следующем обращении.
+
+    uint32_t buckets_mask;
+    uint32_t *buckets;
+    c_cache_slot *slots;
+    float *ins;
+    float *outs;
+
+    c_cache_stats stats;
+
+    size_t size;
+    c_allocator allocator;
+} c_cache;
+
 // Перцептрон.
 struct s_c_perceptron
 {
     size_t layers_count;
     size_t *topology;
+    // Функции активации слоев (C_ACTIVATION_*), activations[0] не используется.
+    size_t *activations;
 
     size_t weights_count;
     float *weights;
 
+    // Блок, в котором расположен сам перцептрон.
+    c_block *block;
+    // Блок, в котором расположены веса перцептрона: собственный блок, блок другого перцептрона,
+    // если веса разделяются, или отдельный блок после копирования разделяемых весов.
+    // Разделяемые веса копируются перед первым изменением.
+    c_block *weights_block;
+
     float *ins;
     float *outs;
+
+    // Разреженное (CSR) представление весов: для каждого нейрона всех активных слоев
+    // хранятся только ненулевые веса и номера их входов.
+    // Строится лениво при выполнении, если доля нулевых весов >= sparse_threshold,
+    // и освобождается при любом изменении весов.
+    // В компактном режиме (weights == NULL, см. c_perceptron_clone_compact()) CSR - единственное
+    // представление весов, плотные веса восстанавливаются из него перед первым изменением.
+    float sparse_threshold;
+    int csr_state;
+    size_t csr_nnz;
+    size_t csr_rows_count;
+    size_t *csr_rows;
+    uint32_t *csr_cols;
+    float *csr_values;
+
+    // Пул потоков для параллельного выполнения широких слоев (см. c_perceptron_set_threads()), или NULL.
+    c_workers *workers;
+    size_t parallel_width;
+
+    // Пул потоков c_perceptron_evaluate(), сохраняемый между вызовами, или NULL.
+    c_workers *eval_workers;
+
+    // Профилировщик выполнения (см. c_perceptron_set_profiler()), или NULL.
+    c_profiler *profiler;
+
+    // Состояние инкрементального выполнения (см. c_perceptron_set_incremental()), или NULL.
+    c_incremental *incremental;
+
+    // Кэш результатов выполнения (см. c_perceptron_set_cache()), или NULL.
+    c_cache *cache;
 };
 
 // Сущность с весами и ошибкой.
@@ -32,7 +206,11 @@ typedef struct s_c_weights_and_sigma
     float sigma;// Суммарная ошибка по всем сигналам всех уроков.
 } c_weights_and_sigma;
 
+typedef struct s_c_pgs_numa c_pgs_numa;
+
 // Перцептронный генетический селекционер.
+// Селекционер вместе с топологией и массивами особей располагается в одном блоке памяти,
+// геномы всех особей - в другом, непрерывном, блоке.
 struct s_c_pgs
 {
     size_t layers_count;
@@ -43,6 +221,78 @@ struct s_c_pgs
 
     size_t pool_count;
     c_weights_and_sigma *pool;
+
+    float *genomes;
+    size_t genomes_size;
+    size_t size;
+
+    c_allocator allocator;
+
+    // Геномы отображены из файла подкачки (см. c_pgs_create_scratch()), 0 - геномы выделены распределителем.
+    int scratch;
+    // Номера ячеек геномов популяции, которые сортируются перед скрещиванием в режиме файла подкачки.
+    size_t *scratch_slots;
+
+    // Опубликованная модель, в которую c_pgs_run() публикует лучший геном по ходу обучения.
+    c_published *published;
+
+    // Контрольная точка, которую c_pgs_run() записывает каждые checkpoint_interval поколений.
+    char *checkpoint_name;
+    size_t checkpoint_name_size;
+    size_t checkpoint_interval;
+
+    // Транспорт миграции островной модели: каждые migration_interval поколений
+    // migration_count лучших особей отправляются другим островам, столько же пришельцев
+    // замещают худших особей.
+    c_migration migration;
+    size_t migration_island;
+    size_t migration_interval;
+    size_t migration_count;
+
+    // Режим NUMA (см. c_pgs_set_numa()), NULL - режим выключен.
+    c_pgs_numa *numa;
+
+    // Пул потоков для параллельного по урокам тестирования (см. c_pgs_set_lesson_threads()), NULL - режим выключен.
+    c_workers *lesson_workers;
+
+    // Профилировщик фаз обучения (см. c_pgs_set_profiler()), или NULL.
+    c_profiler *profiler;
+};
+
+// Заголовок контрольной точки селекционера.
+// За заголовком в файле следуют топология, ошибки особей популяции и геномы особей популяции.
+typedef struct s_c_pgs_checkpoint
+{
+    size_t layers_count;
+    size_t pop_count;
+    size_t weights_count;
+    size_t iterations_count;
+    size_t generation;// Количество завершенных поколений.
+    uint64_t seed;// Состояние ГПСЧ перед следующим поколением.
+    float mut_force;
+    float published_sigma;
+} c_pgs_checkpoint;
+
+// Опубликованная модель.
+// Читатели выполняют текущую версию модели без блокировок, писатель атомарно подменяет версию.
+// Старая версия удаляется, когда заканчиваются все чтения, которые могли ее получить:
+// читатели отмечаются в счетчике четности текущей эпохи, писатель после подмены версии
+// сменяет эпоху и дожидается обнуления счетчика прошлой эпохи.
+struct s_c_published
+{
+    _Atomic(c_perceptron*) current;
+    atomic_size_t version;
+    atomic_size_t epoch;
+    atomic_size_t readers[2];
+    atomic_flag writer_lock;
+
+    // Топология и функции активации неизменны на протяжении жизни модели.
+    size_t layers_count;
+    size_t *topology;
+    size_t *activations;
+
+    size_t size;
+    c_allocator allocator;
 };
 
 // Потоконезависимый ГПСЧ с периодом 2^64 и диапазоном генерируемых значений [0; UINT32_MAX].
@@ -146,10 +396,46 @@ static int comp(const void *_p1,
     }
 }
 
-// Функция активации.
-static float activation_function(const float _value)
+// Применяет функцию активации к _count значениям на месте.
+// Выбор функции вынесен из цикла, поэтому циклы кусочно-линейных функций векторизуются компилятором.
+static void activation_apply(const size_t _activation,
+                             float *const _values,
+                             const size_t _count)
 {
-    return 1 / (1 + exp(-_value));// Возможно, функция, имеющая значения [-1; +1] будет лучше?
+    switch (_activation)
+    {
+        case C_ACTIVATION_TANH:
+            for (size_t i = 0; i < _count; ++i)
+            {
+                _values[i] = tanh(_values[i]);
+            }
+            break;
+        case C_ACTIVATION_RELU:
+            for (size_t i = 0; i < _count; ++i)
+            {
+                _values[i] = (_values[i] > 0) ? _values[i] : 0;
+            }
+            break;
+        case C_ACTIVATION_LEAKY_RELU:
+            for (size_t i = 0; i < _count; ++i)
+            {
+                _values[i] = (_values[i] > 0) ? _values[i] : C_LEAKY_RELU_SLOPE * _values[i];
+            }
+            break;
+        case C_ACTIVATION_HARD_SIGMOID:
+            for (size_t i = 0; i < _count; ++i)
+            {
+                const float h = C_HARD_SIGMOID_SLOPE * _values[i] + 0.5f;
+                _values[i] = (h > 0) ? ((h < 1) ? h : 1) : 0;
+            }
+            break;
+        default:
+            for (size_t i = 0; i < _count; ++i)
+            {
+                _values[i] = 1 / (1 + exp(-_values[i]));
+            }
+            break;
+    }
 }
 
 // Если расположение задано, в него помещается код.
@@ -162,1185 +448,8777 @@ static void error_set(size_t *const _error,
     }
 }
 
-// Создает перцептрон заданой топологии.
-// Слоев должно быть >= 2..
-// Каждый слой должен содержать > 0 нейронов.
-// В случае ошибки возвращает NULL, и если _error != NULL,
-// в заданное расположение помещается код причины ошибки (> 0).
-c_perceptron *c_perceptron_create(const size_t _layers_count,
-                                  const size_t *const _topology,
-                                  size_t *const _error)
+static void csr_free(c_perceptron *const _perceptron);
+
+// Сообщает перцептрону, что его веса изменились.
+// Все производные от весов представления становятся недействительными.
+static void weights_changed(c_perceptron *const _perceptron)
 {
-    if (_layers_count < 2)
+    // В компактном режиме CSR хранит сами веса.
+    if (_perceptron->weights != NULL)
     {
-        error_set(_error, 1);
-        return NULL;
+        csr_free(_perceptron);
+        _perceptron->csr_state = CSR_UNKNOWN;
     }
-    if (_topology == NULL)
+    if (_perceptron->incremental != NULL)
     {
-        error_set(_error, 2);
-        return NULL;
+        _perceptron->incremental->valid = 0;
     }
-    for (size_t l = 0; l < _layers_count; ++l)
+    if (_perceptron->cache != NULL)
     {
-        if (_topology[l] == 0)
-        {
-            error_set(_error, 3);
-            return NULL;
-        }
+        _perceptron->cache->valid = 0;
     }
+}
 
-    // Определим, сколько памяти нужно под топологию.
-    const size_t new_topology_size = sizeof(size_t) * _layers_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_topology_size == 0) ||
-         (new_topology_size / sizeof(size_t) != _layers_count) )
+// Распределитель по умолчанию, выделяет выровненную память через malloc().
+// Адрес, полученный от malloc(), хранится непосредственно перед выровненным адресом.
+static void *default_alloc(void *const _context,
+                           const size_t _size,
+                           const size_t _alignment)
+{
+    (void)_context;
+
+    // Контроль целочисленного переполнения при сложении.
+    if (_size > SIZE_MAX - _alignment - sizeof(void*))
     {
-        error_set(_error, 4);
         return NULL;
     }
 
-    // Попытаемся выделить память под топологию.
-    size_t *const new_topology = malloc(new_topology_size);
-
+    void *const base = malloc(_size + _alignment + sizeof(void*));
     // Контроль успешности выделения памяти.
-    if (new_topology == NULL)
+    if (base == NULL)
     {
-        error_set(_error, 5);
         return NULL;
     }
 
-    // Определим количество весов в перцептроне.
-    size_t new_weights_count = 0;
-    for (size_t l = 1; l < _layers_count; ++l)
+    void **const aligned = (void**)(((uintptr_t)base + sizeof(void*) + _alignment - 1) / _alignment * _alignment);
+    aligned[-1] = base;
+
+    return aligned;
+}
+
+static void default_free(void *const _context,
+                         void *const _ptr,
+                         const size_t _size)
+{
+    (void)_context;
+    (void)_size;
+
+    free(((void**)_ptr)[-1]);
+}
+
+static const c_allocator default_allocator = {default_alloc, default_free, NULL};
+
+// Возвращает заданный распределитель, или распределитель по умолчанию, если _allocator == NULL.
+// Если распределитель задан некорректно, возвращает NULL.
+static const c_allocator *allocator_resolve(const c_allocator *const _allocator)
+{
+    if (_allocator == NULL)
     {
-        const size_t m = _topology[l - 1] * _topology[l];
-        // Контроль целочисленного переполнения при умножении.
-        if ( (m == 0) ||
-             (m / _topology[l - 1] != _topology[l]) )
-        {
-            free(new_topology);
-            error_set(_error, 6);
-            return NULL;
-        }
-        const size_t s = new_weights_count + m;
-        // Контроль целочисленного переполнения при сложении.
-        if (s < new_weights_count)
-        {
-            free(new_topology);
-            error_set(_error, 7);
-            return NULL;
-        }
-        new_weights_count = s;
+        return &default_allocator;
     }
-
-    // Определим, сколько памяти нужно под веса.
-    const size_t new_weights_size = sizeof(float) * new_weights_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_weights_size == 0) ||
-         (new_weights_size / sizeof(float) != new_weights_count) )
+    if ( (_allocator->alloc == NULL) ||
+         (_allocator->free == NULL) )
     {
-        free(new_topology);
-        error_set(_error, 8);
         return NULL;
     }
 
-    // Попытаемся выделить память под веса.
-    float *const new_weights = malloc(new_weights_size);
-    // Контроль успешности выделения памяти.
-    if (new_weights == NULL)
+    return _allocator;
+}
+
+// Выделяет память заданным распределителем, выравнивая ее по WEIGHTS_ALIGN.
+static void *mem_alloc(const c_allocator *const _allocator,
+                       const size_t _size)
+{
+    return _allocator->alloc(_allocator->context, _size, WEIGHTS_ALIGN);
+}
+
+// Освобождает память, выделенную mem_alloc().
+static void mem_free(const c_allocator *const _allocator,
+                     void *const _ptr,
+                     const size_t _size)
+{
+    if (_ptr != NULL)
     {
-        free(new_topology);
-        error_set(_error, 9);
-        return NULL;
+        _allocator->free(_allocator->context, _ptr, _size);
     }
+}
 
-    // Определяем, сколько памяти нужно под входа.
-    const size_t new_ins_count = _topology[0];
-    const size_t new_ins_size = sizeof(float) * new_ins_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_ins_size == 0) ||
-         (new_ins_size / sizeof(float) != new_ins_count) )
+// Округляет размер вверх до кратного _align.
+// В случае переполнения возвращает 0.
+static size_t align_up(const size_t _size,
+                       const size_t _align)
+{
+    if (_size > SIZE_MAX - (_align - 1))
     {
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 10);
-        return NULL;
+        return 0;
     }
 
-    // Пытаемся выделить память под входа.
-    float *const new_ins = malloc(new_ins_size);
+    return (_size + _align - 1) / _align * _align;
+}
+
+// Выделяет заданным распределителем выровненный по BLOCK_ALIGN блок памяти
+// с полезной нагрузкой _size байт (вместе с заголовком).
+// Счетчик ссылок блока равен 1.
+// В случае ошибки возвращает NULL.
+static c_block *block_alloc(const c_allocator *const _allocator,
+                            const size_t _size)
+{
+    c_block *const block = _allocator->alloc(_allocator->context, _size, BLOCK_ALIGN);
     // Контроль успешности выделения памяти.
-    if (new_ins == NULL)
+    if (block == NULL)
     {
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 11);
         return NULL;
     }
 
-    // Определяем, сколько памяти нужно под выхода.
-    const size_t new_outs_count = _topology[_layers_count - 1];
-    const size_t new_outs_size = sizeof(float) * new_outs_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_outs_size == 0) ||
-         (new_outs_size / sizeof(float) != new_outs_count) )
+    atomic_init(&block->refs, 1);
+    block->allocator = *_allocator;
+    block->size = _size;
+
+    return block;
+}
+
+// Отказывается от ссылки на блок, последняя ссылка удаляет блок.
+static void block_release(c_block *const _block)
+{
+    if (_block == NULL)
     {
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 12);
-        return NULL;
+        return;
     }
 
-    // Попытаемся выделить память под выхода.
-    float *new_outs = malloc(new_outs_size);
-    // Контроль успешности выделения памяти.
-    if (new_outs == NULL)
+    if (atomic_fetch_sub(&_block->refs, 1) == 1)
     {
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 13);
-        return NULL;
+        // Распределитель копируется, так как он хранится в освобождаемом блоке.
+        const c_allocator allocator = _block->allocator;
+        allocator.free(allocator.context, _block, _block->size);
     }
+}
 
-    // Пытаемся выделить память под перцептрон.
-    c_perceptron *const new_perceptron = malloc(sizeof(c_perceptron));
+// Расположение частей перцептрона в блоке памяти (смещения от начала блока).
+typedef struct s_c_perceptron_layout
+{
+    size_t perceptron;
+    size_t topology;
+    size_t activations;
+    size_t weights;
+    size_t ins;
+    size_t outs;
+    size_t size;
+    int with_weights;
+} c_perceptron_layout;
+
+// Определяет расположение частей перцептрона в блоке памяти.
+// Если _with_weights == 0, место под веса не выделяется (веса разделяются с другим перцептроном).
+// Размер топологии и весов должен быть проверен на переполнение заранее, размеры входов
+// и выходов не превосходят размер весов.
+// В случае переполнения возвращает 0.
+static int perceptron_layout(c_perceptron_layout *const _layout,
+                             const size_t _layers_count,
+                             const size_t _ins_count,
+                             const size_t _outs_count,
+                             const size_t _weights_count,
+                             const int _with_weights)
+{
+    const size_t topology_size = sizeof(size_t) * _layers_count;
+    const size_t weights_size = (_with_weights != 0) ? sizeof(float) * _weights_count : 0;
+    const size_t ins_size = sizeof(float) * _ins_count;
+    const size_t outs_size = sizeof(float) * _outs_count;
 
+    // Топология и функции активации идут сразу за перцептроном, чтобы метаданные оказались
+    // в тех же строках кэша, что и первые веса.
+    _layout->perceptron = align_up(sizeof(c_block), _Alignof(c_perceptron));
+    _layout->topology = align_up(_layout->perceptron + sizeof(c_perceptron), _Alignof(size_t));
+
+    if (_layout->topology > SIZE_MAX - topology_size) return 0;
+    _layout->activations = _layout->topology + topology_size;
+
+    if (_layout->activations > SIZE_MAX - topology_size) return 0;
+    _layout->weights = align_up(_layout->activations + topology_size, WEIGHTS_ALIGN);
+    if (_layout->weights == 0) return 0;
+
+    if (_layout->weights > SIZE_MAX - weights_size) return 0;
+    _layout->ins = align_up(_layout->weights + weights_size, WEIGHTS_ALIGN);
+    if (_layout->ins == 0) return 0;
+
+    if (_layout->ins > SIZE_MAX - ins_size) return 0;
+    _layout->outs = align_up(_layout->ins + ins_size, WEIGHTS_ALIGN);
+    if (_layout->outs == 0) return 0;
+
+    if (_layout->outs > SIZE_MAX - outs_size) return 0;
+    _layout->size = _layout->outs + outs_size;
+
+    _layout->with_weights = _with_weights;
+
+    return 1;
+}
+
+// Выделяет блок памяти по заданному расположению и собирает в нем перцептрон.
+// Если _topology != NULL, топология копируется в перцептрон.
+// Если _activations != NULL, функции активации копируются в перцептрон, иначе все слои используют
+// C_ACTIVATION_SIGMOID.
+// Веса, входа и выхода не инициализируются.
+// Если расположение не содержит весов, weights и weights_block должен задать вызывающий.
+// В случае ошибки возвращает NULL.
+static c_perceptron *perceptron_alloc(const c_allocator *const _allocator,
+                                      const c_perceptron_layout *const _layout,
+                                      const size_t _layers_count,
+                                      const size_t *const _topology,
+                                      const size_t *const _activations,
+                                      const size_t _weights_count)
+{
+    c_block *const new_block = block_alloc(_allocator, _layout->size);
     // Контроль успешности выделения памяти.
-    if (new_perceptron == NULL)
+    if (new_block == NULL)
     {
-        free(new_outs);
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 14);
         return NULL;
     }
 
+    char *const h = (char*)new_block;
+    c_perceptron *const new_perceptron = (c_perceptron*)(h + _layout->perceptron);
+
     // Собираем перцептрон.
     new_perceptron->layers_count = _layers_count;
-    new_perceptron->topology = new_topology;
-    memcpy(new_topology, _topology, new_topology_size);
-    new_perceptron->weights_count = new_weights_count;
-    new_perceptron->weights = new_weights;
-    new_perceptron->ins = new_ins;
-    new_perceptron->outs = new_outs;
+    new_perceptron->topology = (size_t*)(h + _layout->topology);
+    if (_topology != NULL)
+    {
+        memcpy(new_perceptron->topology, _topology, sizeof(size_t) * _layers_count);
+    }
+    new_perceptron->activations = (size_t*)(h + _layout->activations);
+    for (size_t l = 0; l < _layers_count; ++l)
+    {
+        new_perceptron->activations[l] = (_activations != NULL) ? _activations[l] : C_ACTIVATION_SIGMOID;
+    }
+    new_perceptron->weights_count = _weights_count;
+    new_perceptron->block = new_block;
+    if (_layout->with_weights != 0)
+    {
+        // Вторая ссылка на блок - ссылка на веса.
+        atomic_fetch_add(&new_block->refs, 1);
+        new_perceptron->weights = (float*)(h + _layout->weights);
+        new_perceptron->weights_block = new_block;
+    } else {
+        new_perceptron->weights = NULL;
+        new_perceptron->weights_block = NULL;
+    }
+    new_perceptron->ins = (float*)(h + _layout->ins);
+    new_perceptron->outs = (float*)(h + _layout->outs);
+    new_perceptron->sparse_threshold = SPARSE_THRESHOLD;
+    new_perceptron->csr_state = CSR_UNKNOWN;
+    new_perceptron->csr_nnz = 0;
+    new_perceptron->csr_rows_count = 0;
+    new_perceptron->csr_rows = NULL;
+    new_perceptron->csr_cols = NULL;
+    new_perceptron->csr_values = NULL;
+    new_perceptron->workers = NULL;
+    new_perceptron->parallel_width = PARALLEL_WIDTH;
+    new_perceptron->eval_workers = NULL;
+    new_perceptron->profiler = NULL;
+    new_perceptron->incremental = NULL;
+    new_perceptron->cache = NULL;
 
     return new_perceptron;
 }
 
-// Удаляет перцептрон.
-// В случае успеха возвращает > 0.
-// В случае ошибки возвращает < 0.
-ptrdiff_t c_perceptron_delete(c_perceptron *const _perceptron)
+// Выделяет распределителем перцептрона отдельный блок под его веса.
+// В случае ошибки возвращает NULL.
+static c_block *weights_block_alloc(const c_perceptron *const _perceptron,
+                                    float **const _weights)
 {
-    if (_perceptron == NULL)
+    // Контроль целочисленного переполнения не нужен, так как
+    // он выполняется на этапе конструирования перцептрона.
+    const size_t new_weights_size = sizeof(float) * _perceptron->weights_count;
+    const size_t new_weights_offset = align_up(sizeof(c_block), WEIGHTS_ALIGN);
+
+    if (new_weights_size > SIZE_MAX - new_weights_offset)
     {
-        return -1;
+        return NULL;
     }
+    c_block *const new_weights_block = block_alloc(&_perceptron->block->allocator,
+                                                   new_weights_offset + new_weights_size);
+    // Контроль успешности выделения памяти.
+    if (new_weights_block == NULL)
+    {
+        return NULL;
+    }
+    *_weights = (float*)((char*)new_weights_block + new_weights_offset);
 
-    free(_perceptron->outs);
-    free(_perceptron->ins);
-    free(_perceptron->weights);
-    free(_perceptron->topology);
-    free(_perceptron);
-
-    return 1;
+    return new_weights_block;
 }
 
-// Заполняет веса перцептрона шумом.
-// В случае успеха функция возвращает > 0.
-// В случае ошибки функция возвращает < 0.
-ptrdiff_t c_perceptron_noise(c_perceptron *const _perceptron,
-                             const float _noise_force,
-                             uint64_t *const _seed)
+// Восстанавливает плотные веса из CSR представления в _weights.
+static void weights_expand(const c_perceptron *const _perceptron,
+                           float *const _weights)
 {
-    if (_perceptron == NULL)
+    memset(_weights, 0, sizeof(float) * _perceptron->weights_count);
+    size_t w = 0;
+    size_t r = 0;
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
     {
-        return -1;
+        const size_t pn_count = _perceptron->topology[l - 1];
+        for (size_t cn = 0; cn < _perceptron->topology[l]; ++cn, ++r)
+        {
+            for (size_t k = _perceptron->csr_rows[r]; k < _perceptron->csr_rows[r + 1]; ++k)
+            {
+                _weights[w + _perceptron->csr_cols[k]] = _perceptron->csr_values[k];
+            }
+            w += pn_count;
+        }
     }
+}
 
-    if (_seed == NULL)
+// Возвращает веса нейрона, которые начинаются с веса _w и описываются строкой _r CSR.
+// В компактном режиме веса восстанавливаются из CSR в _row (не меньше входов нейрона).
+static const float *weights_row(const c_perceptron *const _perceptron,
+                                const size_t _w,
+                                const size_t _r,
+                                const size_t _pn_count,
+                                float *const _row)
+{
+    if (_perceptron->weights != NULL)
     {
-        return -2;
+        return &_perceptron->weights[_w];
     }
 
-    weights_noise(_perceptron->weights, _perceptron->weights_count, _noise_force, _seed);
-
-    return 1;
+    memset(_row, 0, sizeof(float) * _pn_count);
+    for (size_t k = _perceptron->csr_rows[_r]; k < _perceptron->csr_rows[_r + 1]; ++k)
+    {
+        _row[_perceptron->csr_cols[k]] = _perceptron->csr_values[k];
+    }
+    return _row;
 }
 
-
-// Прямое обращение ко входным сигналам перцептрона.
-// В случае, если _perceptron == NULL, возвращает NULL.
-float *c_perceptron_get_ins(c_perceptron *const _perceptron)
+// Выделяет распределителем перцептрона буфер для weights_row(), вмещающий веса нейрона любого слоя.
+// У перцептрона с плотными весами буфер не нужен, и возвращается NULL, как и в случае ошибки.
+static float *weights_row_alloc(const c_perceptron *const _perceptron,
+                                size_t *const _size)
 {
-    if (_perceptron == NULL)
+    *_size = 0;
+    if (_perceptron->weights != NULL)
     {
         return NULL;
     }
 
-    return _perceptron->ins;
+    size_t pn_max = 0;
+    for (size_t l = 0; l < _perceptron->layers_count - 1; ++l)
+    {
+        if (_perceptron->topology[l] > pn_max)
+        {
+            pn_max = _perceptron->topology[l];
+        }
+    }
+    *_size = sizeof(float) * pn_max;
+    return mem_alloc(&_perceptron->block->allocator, *_size);
 }
 
-// Прямое обращение к выходным сигналам перцептрона.
-// В случае, если _perceptron == NULL, возвращает NULL.
-const float *c_perceptron_get_outs(c_perceptron *const _perceptron)
+// Копирует плотные веса перцептрона в _weights, в компактном режиме восстанавливает их из CSR.
+static void weights_copy(const c_perceptron *const _perceptron,
+                         float *const _weights)
 {
-    if (_perceptron == NULL)
+    if (_perceptron->weights != NULL)
     {
-        return NULL;
+        memcpy(_weights, _perceptron->weights, sizeof(float) * _perceptron->weights_count);
+    } else {
+        weights_expand(_perceptron, _weights);
     }
-
-    return _perceptron->outs;
 }
 
-// Пропускает сигнал через перцептрон.
+// Выводит перцептрон из компактного режима: восстанавливает плотные веса из CSR в отдельном блоке
+// и освобождает CSR, которое будет построено заново при выполнении, если веса останутся разреженными.
 // В случае успеха возвращает > 0.
-// В случае ошибки возвращает < 0.
-ptrdiff_t c_perceptron_execute(c_perceptron *const _perceptron)
+// В случае ошибки возвращает < 0, перцептрон не меняется.
+static ptrdiff_t weights_densify(c_perceptron *const _perceptron)
 {
-    if (_perceptron == NULL)
+    if (_perceptron->weights != NULL)
     {
-        return -1;
+        return 1;
     }
 
-    // Определяем, сколько нейронов имеется в самом "жирном" слое.
-    size_t h_buffer_count = 0;
-    for (size_t l = 0; l < _perceptron->layers_count; ++l)
+    float *new_weights = NULL;
+    c_block *const new_weights_block = weights_block_alloc(_perceptron, &new_weights);
+    if (new_weights_block == NULL)
     {
-        if (_perceptron->topology[l] > h_buffer_count)
-        {
-            h_buffer_count = _perceptron->topology[l];
-        }
+        return -1;
     }
+    weights_expand(_perceptron, new_weights);
 
-    // Вспомогательные буфера.
-    float a[h_buffer_count],
-          b[h_buffer_count];
+    _perceptron->weights = new_weights;
+    _perceptron->weights_block = new_weights_block;
+    csr_free(_perceptron);
+    _perceptron->csr_state = CSR_UNKNOWN;
 
-    // Указатели нужны для быстрого свопа.
-    float *h_ins = a,
-          *h_outs = b;
+    return 1;
+}
 
-    // Определяем, сколько памяти занимают входные сигналы перцептрона.
-    const size_t ins_size = sizeof(float) * _perceptron->topology[0];
-    // Контроль целочисленного переполнения не нужен, так как
-    // он выполняется на этапе конструирования перцептрона.
+// Если веса перцептрона разделяются с другими перцептронами, делает их собственную копию.
+// Компактный перцептрон выводится из компактного режима.
+// Вызывается перед любым изменением весов.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0, перцептрон не меняется.
+static ptrdiff_t weights_unshare(c_perceptron *const _perceptron)
+{
+    if (_perceptron->weights == NULL)
+    {
+        return weights_densify(_perceptron);
+    }
 
-    // Определяем, сколько памяти занимают выходные сигналы перцептрона.
-    const size_t outs_size = sizeof(float) * _perceptron->topology[_perceptron->layers_count - 1];
-    // Контроль целочисленного переполнения не нужен, так как
-    // он выполняется на этапе конструирования перцептрона.
+    // Веса в собственном блоке принадлежат только перцептрону, если на блок ссылается лишь он сам
+    // (дважды: как перцептрон и как владелец весов), веса в чужом блоке - если других ссылок нет.
+    // Пока перцептрон держит ссылку, никто другой не может начать пользоваться его весами.
+    const size_t own_refs = (_perceptron->weights_block == _perceptron->block) ? 2 : 1;
+    if (atomic_load(&_perceptron->weights_block->refs) == own_refs)
+    {
+        return 1;
+    }
+
+    // Копия весов размещается в отдельном блоке.
+    float *new_weights = NULL;
+    c_block *const new_weights_block = weights_block_alloc(_perceptron, &new_weights);
+    if (new_weights_block == NULL)
+    {
+        return -1;
+    }
+    memcpy(new_weights, _perceptron->weights, sizeof(float) * _perceptron->weights_count);
 
-    // Пропускаем входные сигналы перцептрона через сеть.
+    // Отказываемся от разделяемых весов.
+    // Другие перцептроны могли отказаться от них одновременно с нами.
+    block_release(_perceptron->weights_block);
 
-    memcpy(h_outs, _perceptron->ins, ins_size);
-    size_t w = 0;
+    _perceptron->weights = new_weights;
+    _perceptron->weights_block = new_weights_block;
+
+    return 1;
+}
+
+// Определяет количество нулевых весов.
+static size_t weights_zero_count(const float *const _weights,
+                                 const size_t _weights_count)
+{
+    size_t count = 0;
+    for (size_t w = 0; w < _weights_count; ++w)
+    {
+        if (_weights[w] == 0.f)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Освобождает CSR представление весов.
+static void csr_free(c_perceptron *const _perceptron)
+{
+    const c_allocator *const allocator = &_perceptron->block->allocator;
+    mem_free(allocator, _perceptron->csr_values, sizeof(float) * _perceptron->csr_nnz);
+    mem_free(allocator, _perceptron->csr_cols, sizeof(uint32_t) * _perceptron->csr_nnz);
+    mem_free(allocator, _perceptron->csr_rows, sizeof(size_t) * _perceptron->csr_rows_count);
+    _perceptron->csr_nnz = 0;
+    _perceptron->csr_rows_count = 0;
+    _perceptron->csr_rows = NULL;
+    _perceptron->csr_cols = NULL;
+    _perceptron->csr_values = NULL;
+}
+
+// Выделяет распределителем перцептрона память под CSR с _nnz ненулевыми весами.
+// CSR перцептрона должно быть освобождено.
+// В случае успеха возвращает > 0, в случае ошибки возвращает 0.
+static int csr_alloc(c_perceptron *const _perceptron,
+                     const size_t _nnz)
+{
+    // Определяем количество нейронов во всех активных слоях.
+    // Контроль целочисленного переполнения не нужен, так как нейронов и ненулевых весов не больше, чем весов.
+    size_t neurons_count = 0;
     for (size_t l = 1; l < _perceptron->layers_count; ++l)
     {
-        float *const h = h_ins;
-        h_ins = h_outs;
-        h_outs = h;
+        neurons_count += _perceptron->topology[l];
+    }
+
+    const c_allocator *const allocator = &_perceptron->block->allocator;
+    _perceptron->csr_rows = mem_alloc(allocator, sizeof(size_t) * (neurons_count + 1));
+    _perceptron->csr_rows_count = neurons_count + 1;
+    if (_nnz > 0)
+    {
+        _perceptron->csr_cols = mem_alloc(allocator, sizeof(uint32_t) * _nnz);
+        _perceptron->csr_values = mem_alloc(allocator, sizeof(float) * _nnz);
+    }
+    _perceptron->csr_nnz = _nnz;
+    if ( (_perceptron->csr_rows == NULL) ||
+         ( (_nnz > 0) && ( (_perceptron->csr_cols == NULL) || (_perceptron->csr_values == NULL) ) ) )
+    {
+        csr_free(_perceptron);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Проверяет, что номера входов всех слоев помещаются в uint32_t.
+static int csr_fits(const c_perceptron *const _perceptron)
+{
+    for (size_t l = 0; l < _perceptron->layers_count - 1; ++l)
+    {
+        if (_perceptron->topology[l] > UINT32_MAX)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
 
+// Заполняет выделенное CSR перцептрона ненулевыми весами из плотных весов _weights.
+static void csr_build(c_perceptron *const _perceptron,
+                      const float *const _weights)
+{
+    size_t w = 0;
+    size_t r = 0;
+    size_t k = 0;
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
+    {
         for (size_t cn = 0; cn < _perceptron->topology[l]; ++cn)
         {
-            float sum = 0;
+            _perceptron->csr_rows[r++] = k;
             for (size_t pn = 0; pn < _perceptron->topology[l - 1]; ++pn)
             {
-                sum += h_ins[pn] * _perceptron->weights[w++];
+                const float weight = _weights[w++];
+                if (weight != 0.f)
+                {
+                    _perceptron->csr_cols[k] = pn;
+                    _perceptron->csr_values[k] = weight;
+                    ++k;
+                }
+            }
+        }
+    }
+    _perceptron->csr_rows[r] = k;
+}
+
+// Копирует CSR перцептрона _source в перцептрон той же топологии с освобожденным CSR.
+// В случае успеха возвращает > 0, в случае ошибки возвращает 0.
+static int csr_copy(c_perceptron *const _perceptron,
+                    const c_perceptron *const _source)
+{
+    if (csr_alloc(_perceptron, _source->csr_nnz) == 0)
+    {
+        return 0;
+    }
+    memcpy(_perceptron->csr_rows, _source->csr_rows, sizeof(size_t) * _source->csr_rows_count);
+    if (_source->csr_nnz > 0)
+    {
+        memcpy(_perceptron->csr_cols, _source->csr_cols, sizeof(uint32_t) * _source->csr_nnz);
+        memcpy(_perceptron->csr_values, _source->csr_values, sizeof(float) * _source->csr_nnz);
+    }
+    _perceptron->csr_state = CSR_READY;
+
+    return 1;
+}
+
+// Принимает решение о способе выполнения перцептрона и, если нужно, строит CSR.
+// Если построить CSR не удалось (не хватает памяти, слишком широкий слой),
+// перцептрон выполняется плотно.
+// Компактный перцептрон всегда выполняется через CSR.
+static void csr_update(c_perceptron *const _perceptron)
+{
+    if (_perceptron->weights == NULL)
+    {
+        _perceptron->csr_state = CSR_READY;
+        return;
+    }
+
+    _perceptron->csr_state = CSR_DENSE;
+
+    const size_t zero_count = weights_zero_count(_perceptron->weights, _perceptron->weights_count);
+    if ((float)zero_count < _perceptron->sparse_threshold * (float)_perceptron->weights_count)
+    {
+        return;
+    }
+
+    // Номера входов хранятся в uint32_t.
+    if (csr_fits(_perceptron) == 0)
+    {
+        return;
+    }
+
+    // Память выделяется под точное количество ненулевых весов и освобождается при изменении весов.
+    csr_free(_perceptron);
+    if (csr_alloc(_perceptron, _perceptron->weights_count - zero_count) == 0)
+    {
+        return;
+    }
+    csr_build(_perceptron, _perceptron->weights);
+
+    _perceptron->csr_state = CSR_READY;
+}
+
+#ifdef C_PERCEPTRON_POSIX
+
+// Мьютекс.
+typedef pthread_mutex_t c_mutex;
+
+// Инициализирует мьютекс. В случае успеха возвращает 1, в случае ошибки 0.
+static int mutex_init(c_mutex *const _mutex)
+{
+    return pthread_mutex_init(_mutex, NULL) == 0;
+}
+
+static void mutex_destroy(c_mutex *const _mutex)
+{
+    pthread_mutex_destroy(_mutex);
+}
+
+static void mutex_lock(c_mutex *const _mutex)
+{
+    pthread_mutex_lock(_mutex);
+}
+
+static void mutex_unlock(c_mutex *const _mutex)
+{
+    pthread_mutex_unlock(_mutex);
+}
+
+// Уступает процессор другим потокам при активном ожидании.
+static void thread_yield(void)
+{
+    sched_yield();
+}
+
+#else
+
+// Без POSIX библиотека не создает потоков, и мьютекс ничего не защищает.
+typedef int c_mutex;
+
+static int mutex_init(c_mutex *const _mutex)
+{
+    *_mutex = 0;
+    return 1;
+}
+
+static void mutex_destroy(c_mutex *const _mutex)
+{
+    (void)_mutex;
+}
+
+static void mutex_lock(c_mutex *const _mutex)
+{
+    (void)_mutex;
+}
+
+static void mutex_unlock(c_mutex *const _mutex)
+{
+    (void)_mutex;
+}
+
+// Стандарт C11 не умеет уступать процессор, ожидание остается активным.
+static void thread_yield(void)
+{
+}
+
+#endif
+
+#ifdef C_PERCEPTRON_POSIX
+
+// Пул потоков.
+// Потоки создаются один раз и ждут задачу; workers_run() выполняет задачу на всех потоках пула
+// (каждый поток получает свой номер) и дожидается ее завершения.
+struct s_c_workers
+{
+    size_t threads_count;
+    pthread_t *threads;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t finish;
+
+    size_t generation;// Номер текущей задачи.
+    size_t pending;// Количество потоков, еще выполняющих задачу.
+    size_t started;// Количество потоков, начавших работу (для создания пула).
+    int stop;
+
+    void (*task)(void *_context, size_t _worker);
+    void *context;
+
+#ifdef __linux__
+    cpu_set_t *affinity;// Процессоры каждого потока, или NULL.
+#endif
+
+    size_t size;
+    c_allocator allocator;
+};
+
+// Аргумент потока пула.
+typedef struct s_c_worker_arg
+{
+    c_workers *workers;
+    size_t worker;
+} c_worker_arg;
+
+// Поток пула.
+static void *workers_thread(void *const _arg)
+{
+    const c_worker_arg *const arg = _arg;
+    c_workers *const workers = arg->workers;
+    const size_t worker = arg->worker;
+
+#ifdef __linux__
+    // Привязываем поток к его процессорам до первого обращения к памяти задач.
+    if (workers->affinity != NULL)
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &workers->affinity[worker]);
+    }
+#endif
+
+    pthread_mutex_lock(&workers->mutex);
+
+    ++workers->started;
+    pthread_cond_broadcast(&workers->finish);
+
+    size_t generation = 0;
+    for (;;)
+    {
+        while ( (workers->generation == generation) &&
+                (workers->stop == 0) )
+        {
+            pthread_cond_wait(&workers->start, &workers->mutex);
+        }
+        if (workers->stop != 0)
+        {
+            break;
+        }
+        generation = workers->generation;
+
+        void (*const task)(void*, size_t) = workers->task;
+        void *const context = workers->context;
+
+        pthread_mutex_unlock(&workers->mutex);
+        task(context, worker);
+        pthread_mutex_lock(&workers->mutex);
+
+        if (--workers->pending == 0)
+        {
+            pthread_cond_broadcast(&workers->finish);
+        }
+    }
+
+    pthread_mutex_unlock(&workers->mutex);
+
+    return NULL;
+}
+
+static void workers_delete(c_workers *const _workers);
+
+// Создает пул из _threads_count потоков.
+// Если _affinity != NULL, i-й поток привязывается к процессорам _affinity[i] (только в Linux).
+// В случае ошибки возвращает NULL.
+static c_workers *workers_create(const c_allocator *const _allocator,
+                                 const size_t _threads_count,
+                                 const void *const _affinity)
+{
+    // Определим размер пула: пул, потоки, аргументы потоков, процессоры потоков.
+    const size_t o_threads = align_up(sizeof(c_workers), _Alignof(pthread_t));
+    const size_t threads_size = sizeof(pthread_t) * _threads_count;
+    const size_t o_args = align_up(o_threads + threads_size, _Alignof(c_worker_arg));
+    const size_t args_size = sizeof(c_worker_arg) * _threads_count;
+    size_t new_size = o_args + args_size;
+#ifdef __linux__
+    const size_t o_affinity = align_up(new_size, _Alignof(cpu_set_t));
+    const size_t affinity_size = sizeof(cpu_set_t) * _threads_count;
+    new_size = o_affinity + affinity_size;
+#endif
+    // Контроль целочисленного переполнения не нужен: количество потоков ограничено вызывающей стороной.
+
+    char *const h = mem_alloc(_allocator, new_size);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+        return NULL;
+    }
+
+    // Собираем пул.
+    c_workers *const new_workers = (c_workers*)h;
+    new_workers->threads_count = 0;
+    new_workers->threads = (pthread_t*)(h + o_threads);
+    new_workers->generation = 0;
+    new_workers->pending = 0;
+    new_workers->started = 0;
+    new_workers->stop = 0;
+    new_workers->task = NULL;
+    new_workers->context = NULL;
+#ifdef __linux__
+    new_workers->affinity = NULL;
+    if (_affinity != NULL)
+    {
+        new_workers->affinity = (cpu_set_t*)(h + o_affinity);
+        memcpy(new_workers->affinity, _affinity, affinity_size);
+    }
+#else
+    (void)_affinity;
+#endif
+    new_workers->size = new_size;
+    new_workers->allocator = *_allocator;
+
+    if (pthread_mutex_init(&new_workers->mutex, NULL) != 0)
+    {
+        mem_free(_allocator, h, new_size);
+        return NULL;
+    }
+    if (pthread_cond_init(&new_workers->start, NULL) != 0)
+    {
+        pthread_mutex_destroy(&new_workers->mutex);
+        mem_free(_allocator, h, new_size);
+        return NULL;
+    }
+    if (pthread_cond_init(&new_workers->finish, NULL) != 0)
+    {
+        pthread_cond_destroy(&new_workers->start);
+        pthread_mutex_destroy(&new_workers->mutex);
+        mem_free(_allocator, h, new_size);
+        return NULL;
+    }
+
+    // Запускаем потоки.
+    c_worker_arg *const args = (c_worker_arg*)(h + o_args);
+    for (size_t w = 0; w < _threads_count; ++w)
+    {
+        args[w].workers = new_workers;
+        args[w].worker = w;
+        if (pthread_create(&new_workers->threads[w], NULL, workers_thread, &args[w]) != 0)
+        {
+            workers_delete(new_workers);
+            return NULL;
+        }
+        ++new_workers->threads_count;
+    }
+
+    // Дожидаемся, пока все потоки привяжутся к своим процессорам.
+    pthread_mutex_lock(&new_workers->mutex);
+    while (new_workers->started != _threads_count)
+    {
+        pthread_cond_wait(&new_workers->finish, &new_workers->mutex);
+    }
+    pthread_mutex_unlock(&new_workers->mutex);
+
+    return new_workers;
+}
+
+// Останавливает потоки пула и удаляет пул.
+static void workers_delete(c_workers *const _workers)
+{
+    pthread_mutex_lock(&_workers->mutex);
+    _workers->stop = 1;
+    pthread_cond_broadcast(&_workers->start);
+    pthread_mutex_unlock(&_workers->mutex);
+
+    for (size_t w = 0; w < _workers->threads_count; ++w)
+    {
+        pthread_join(_workers->threads[w], NULL);
+    }
+
+    pthread_cond_destroy(&_workers->finish);
+    pthread_cond_destroy(&_workers->start);
+    pthread_mutex_destroy(&_workers->mutex);
+
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _workers->allocator;
+    mem_free(&allocator, _workers, _workers->size);
+}
+
+// Выполняет задачу на всех потоках пула и дожидается ее завершения.
+static void workers_run(c_workers *const _workers,
+                        void (*const _task)(void *_context, size_t _worker),
+                        void *const _context)
+{
+    pthread_mutex_lock(&_workers->mutex);
+
+    _workers->task = _task;
+    _workers->context = _context;
+    _workers->pending = _workers->threads_count;
+    ++_workers->generation;
+    pthread_cond_broadcast(&_workers->start);
+
+    while (_workers->pending != 0)
+    {
+        pthread_cond_wait(&_workers->finish, &_workers->mutex);
+    }
+
+    pthread_mutex_unlock(&_workers->mutex);
+}
+
+#else
+
+// Пул без потоков: workers_run() выполняет задачу за каждый "поток" по очереди в вызывающем потоке,
+// поэтому результаты совпадают с многопоточным выполнением.
+struct s_c_workers
+{
+    size_t threads_count;
+
+    size_t size;
+    c_allocator allocator;
+};
+
+// Создает пул на _threads_count "потоков". Привязка к процессорам игнорируется.
+// В случае ошибки возвращает NULL.
+static c_workers *workers_create(const c_allocator *const _allocator,
+                                 const size_t _threads_count,
+                                 const void *const _affinity)
+{
+    (void)_affinity;
+
+    c_workers *const new_workers = mem_alloc(_allocator, sizeof(c_workers));
+    // Контроль успешности выделения памяти.
+    if (new_workers == NULL)
+    {
+        return NULL;
+    }
+
+    new_workers->threads_count = _threads_count;
+    new_workers->size = sizeof(c_workers);
+    new_workers->allocator = *_allocator;
+
+    return new_workers;
+}
+
+// Удаляет пул.
+static void workers_delete(c_workers *const _workers)
+{
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _workers->allocator;
+    mem_free(&allocator, _workers, _workers->size);
+}
+
+// Выполняет задачу за все "потоки" пула по очереди.
+static void workers_run(c_workers *const _workers,
+                        void (*const _task)(void *_context, size_t _worker),
+                        void *const _context)
+{
+    for (size_t w = 0; w < _workers->threads_count; ++w)
+    {
+        _task(_context, w);
+    }
+}
+
+#endif
+
+// Вычисляет выходы нейронов [_cn_first; _cn_last) слоя _l.
+// _weights указывает на первый вес слоя, _r - номер первой строки CSR слоя.
+static void forward_layer(const c_perceptron *const _perceptron,
+                          const size_t _l,
+                          const float *const _weights,
+                          const int _use_csr,
+                          const size_t _r,
+                          const float *const _ins,
+                          float *const _outs,
+                          const size_t _cn_first,
+                          const size_t _cn_last)
+{
+    if (_use_csr != 0)
+    {
+        for (size_t cn = _cn_first; cn < _cn_last; ++cn)
+        {
+            const size_t r = _r + cn;
+            float sum = 0;
+            for (size_t k = _perceptron->csr_rows[r]; k < _perceptron->csr_rows[r + 1]; ++k)
+            {
+                sum += _ins[_perceptron->csr_cols[k]] * _perceptron->csr_values[k];
             }
-            h_outs[cn] = activation_function(sum);
+            _outs[cn] = sum;
         }
+    } else {
+        const size_t pn_count = _perceptron->topology[_l - 1];
+        for (size_t cn = _cn_first; cn < _cn_last; ++cn)
+        {
+            const float *const weights = &_weights[cn * pn_count];
+            float sum = 0;
+            for (size_t pn = 0; pn < pn_count; ++pn)
+            {
+                sum += _ins[pn] * weights[pn];
+            }
+            _outs[cn] = sum;
+        }
+    }
+    // Функция активации применяется к суммам всего диапазона отдельным циклом.
+    activation_apply(_perceptron->activations[_l], &_outs[_cn_first], _cn_last - _cn_first);
+}
+
+// Слой, нейроны которого распределяются по потокам пула.
+typedef struct s_c_layer_task
+{
+    const c_perceptron *perceptron;
+    size_t l;
+    const float *weights;
+    int use_csr;
+    size_t r;
+    const float *ins;
+    float *outs;
+    size_t threads_count;
+} c_layer_task;
+
+// Задача пула: поток w вычисляет w-ю из threads_count равных частей нейронов слоя.
+static void forward_layer_task(void *const _context,
+                               const size_t _worker)
+{
+    const c_layer_task *const task = _context;
+    const size_t cn_count = task->perceptron->topology[task->l];
+    const size_t cn_first = cn_count * _worker / task->threads_count;
+    const size_t cn_last = cn_count * (_worker + 1) / task->threads_count;
+
+    forward_layer(task->perceptron, task->l, task->weights, task->use_csr, task->r,
+                  task->ins, task->outs, cn_first, cn_last);
+}
+
+// Возвращает текущее монотонное время в наносекундах.
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+#ifdef C_PERCEPTRON_POSIX
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    // Стандарт C11 не гарантирует монотонных часов, используется календарное время.
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Событие трассы профилировщика: одно выполнение фазы.
+typedef struct s_c_profile_event
+{
+    atomic_int ready;// Событие записано полностью.
+    size_t phase;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t counters[PROFILE_COUNTERS];
+} c_profile_event;
+
+// Профилировщик фаз обучения и выполнения.
+// Аппаратные счетчики открываются через perf_event_open() для создавшего профилировщик потока
+// и потоков, которые он создаст после этого (пулы, задачи, конвейеры).
+// Фазы могут завершаться в разных потоках одновременно: статистика накапливается под мьютексом,
+// ячейки трассы занимаются атомарно.
+struct s_c_profiler
+{
+    int fds[PROFILE_COUNTERS];
+    uint32_t available;
+
+    c_mutex mutex;// Защищает stats.
+    c_profile_stats stats[C_PROFILE_PHASES];
+
+    uint64_t origin_ns;
+    c_profile_event *events;
+    size_t events_capacity;
+    atomic_size_t events_count;// Занятые ячейки трассы, не больше events_capacity.
+    atomic_size_t events_dropped;
+
+    size_t size;
+    c_allocator allocator;
+};
+
+// Показания профилировщика в начале фазы.
+typedef struct s_c_profile_mark
+{
+    uint64_t ns;
+    uint64_t counters[PROFILE_COUNTERS];
+} c_profile_mark;
+
+// Читает показания счетчиков.
+static void profile_read(const c_profiler *const _profiler,
+                         uint64_t *const _counters)
+{
+    for (size_t c = 0; c < PROFILE_COUNTERS; ++c)
+    {
+        _counters[c] = 0;
+#ifdef C_PERCEPTRON_POSIX
+        if (_profiler->fds[c] >= 0)
+        {
+            uint64_t value;
+            if (read(_profiler->fds[c], &value, sizeof(uint64_t)) == (ssize_t)sizeof(uint64_t))
+            {
+                _counters[c] = value;
+            }
+        }
+#else
+        (void)_profiler;
+#endif
+    }
+}
+
+// Запоминает показания в начале фазы. Если _profiler == NULL, ничего не делает.
+static void profile_begin(const c_profiler *const _profiler,
+                          c_profile_mark *const _mark)
+{
+    if (_profiler == NULL)
+    {
+        return;
+    }
+    profile_read(_profiler, _mark->counters);
+    _mark->ns = monotonic_ns();
+}
+
+// Добавляет к статистике фазы разницу показаний с начала фазы. Если _profiler == NULL, ничего не делает.
+static void profile_end(c_profiler *const _profiler,
+                        const size_t _phase,
+                        const c_profile_mark *const _mark)
+{
+    if (_profiler == NULL)
+    {
+        return;
+    }
+
+    const uint64_t ns = monotonic_ns();
+    uint64_t counters[PROFILE_COUNTERS];
+    profile_read(_profiler, counters);
+    for (size_t c = 0; c < PROFILE_COUNTERS; ++c)
+    {
+        counters[c] -= _mark->counters[c];
+    }
+
+    mutex_lock(&_profiler->mutex);
+    c_profile_stats *const stats = &_profiler->stats[_phase];
+    ++stats->calls;
+    stats->wall_ns += ns - _mark->ns;
+    stats->cycles += counters[0];
+    stats->instructions += counters[1];
+    stats->l1d_misses += counters[2];
+    stats->llc_misses += counters[3];
+    stats->branch_misses += counters[4];
+    mutex_unlock(&_profiler->mutex);
+
+    if (_profiler->events_capacity != 0)
+    {
+        // Занимаем ячейку трассы, не выходя за ее емкость.
+        size_t e = atomic_load_explicit(&_profiler->events_count, memory_order_relaxed);
+        while ( (e < _profiler->events_capacity) &&
+                (atomic_compare_exchange_weak_explicit(&_profiler->events_count, &e, e + 1,
+                                                       memory_order_relaxed, memory_order_relaxed) == 0) )
+        {
+        }
+        if (e < _profiler->events_capacity)
+        {
+            c_profile_event *const event = &_profiler->events[e];
+            event->phase = _phase;
+            event->start_ns = _mark->ns - _profiler->origin_ns;
+            event->duration_ns = ns - _mark->ns;
+            memcpy(event->counters, counters, sizeof(counters));
+            atomic_store_explicit(&event->ready, 1, memory_order_release);
+        } else {
+            atomic_fetch_add_explicit(&_profiler->events_dropped, 1, memory_order_relaxed);
+        }
+    }
+}
+
+// Открывает аппаратный счетчик. Возвращает дескриптор, или -1, если счетчик недоступен.
+static int profile_open_counter(const size_t _counter)
+{
+#if defined(__linux__) && defined(C_PERCEPTRON_POSIX)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 0;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    switch (_counter)
+    {
+        case 0:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case 1:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case 2:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case 3:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+
+    const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    return (fd < 0) ? -1 : (int)fd;
+#else
+    (void)_counter;
+    return -1;
+#endif
+}
+
+// Создает профилировщик.
+// Аппаратные счетчики (такты, инструкции, промахи L1D и LLC при чтении, ошибки предсказания ветвлений)
+// считают события создавшего профилировщик потока и потоков, созданных им позже, в режиме пользователя.
+// Счетчики, которые недоступны (не Linux, запрет perf_event_paranoid, виртуальная машина), не считаются,
+// см. поле available статистики; время фаз измеряется всегда.
+// Поэтому показания фазы - сумма по всем таким потокам за время фазы: например, пока c_pgs_run_async()
+// тестирует потомков, в C_PROFILE_EVALUATE попадает и то, что одновременно делает создавший поток (обслуживание запросов).
+// Один профилировщик можно подключать к перцептронам и селекционерам, выполняемым в разных потоках.
+// Если _trace_capacity > 0, профилировщик запоминает до _trace_capacity событий для c_profiler_write_trace().
+// Каждая фаза добавляет несколько системных вызовов, что заметно на очень маленьких сетях.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_profiler *c_profiler_create(const size_t _trace_capacity,
+                              size_t *const _error)
+{
+    const c_allocator *const allocator = allocator_resolve(NULL);
+
+    const size_t o_events = align_up(sizeof(c_profiler), _Alignof(c_profile_event));
+    // Контроль целочисленного переполнения.
+    if ( (o_events == 0) ||
+         (_trace_capacity > (SIZE_MAX - o_events) / sizeof(c_profile_event)) )
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    const size_t new_size = o_events + sizeof(c_profile_event) * _trace_capacity;
+
+    // Пытаемся выделить память под профилировщик.
+    char *const h = mem_alloc(allocator, new_size);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+
+    // Собираем профилировщик.
+    c_profiler *const new_profiler = (c_profiler*)h;
+    if (mutex_init(&new_profiler->mutex) == 0)
+    {
+        mem_free(allocator, h, new_size);
+        error_set(_error, 3);
+        return NULL;
+    }
+    new_profiler->available = 0;
+    for (size_t c = 0; c < PROFILE_COUNTERS; ++c)
+    {
+        new_profiler->fds[c] = profile_open_counter(c);
+        if (new_profiler->fds[c] >= 0)
+        {
+            new_profiler->available |= 1u << c;
+        }
+    }
+    memset(new_profiler->stats, 0, sizeof(new_profiler->stats));
+    for (size_t p = 0; p < C_PROFILE_PHASES; ++p)
+    {
+        new_profiler->stats[p].available = new_profiler->available;
+    }
+    new_profiler->origin_ns = monotonic_ns();
+    new_profiler->events = (c_profile_event*)(h + o_events);
+    new_profiler->events_capacity = _trace_capacity;
+    atomic_init(&new_profiler->events_count, 0);
+    atomic_init(&new_profiler->events_dropped, 0);
+    for (size_t e = 0; e < _trace_capacity; ++e)
+    {
+        atomic_init(&new_profiler->events[e].ready, 0);
+    }
+    new_profiler->size = new_size;
+    new_profiler->allocator = *allocator;
+
+    return new_profiler;
+}
+
+// Удаляет профилировщик. Он должен быть предварительно отключен от перцептронов и селекционеров.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_profiler_delete(c_profiler *const _profiler)
+{
+    if (_profiler == NULL)
+    {
+        return -1;
+    }
+
+    for (size_t c = 0; c < PROFILE_COUNTERS; ++c)
+    {
+#ifdef C_PERCEPTRON_POSIX
+        if (_profiler->fds[c] >= 0)
+        {
+            close(_profiler->fds[c]);
+        }
+#endif
+    }
+    mutex_destroy(&_profiler->mutex);
+
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _profiler->allocator;
+    mem_free(&allocator, _profiler, _profiler->size);
+
+    return 1;
+}
+
+// Обнуляет статистику и трассу профилировщика.
+// Нельзя вызывать одновременно с профилируемыми фазами.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_profiler_reset(c_profiler *const _profiler)
+{
+    if (_profiler == NULL)
+    {
+        return -1;
+    }
+
+    mutex_lock(&_profiler->mutex);
+    memset(_profiler->stats, 0, sizeof(_profiler->stats));
+    for (size_t p = 0; p < C_PROFILE_PHASES; ++p)
+    {
+        _profiler->stats[p].available = _profiler->available;
+    }
+    mutex_unlock(&_profiler->mutex);
+    _profiler->origin_ns = monotonic_ns();
+    const size_t events_count = atomic_load(&_profiler->events_count);
+    for (size_t e = 0; e < events_count; ++e)
+    {
+        atomic_store_explicit(&_profiler->events[e].ready, 0, memory_order_relaxed);
+    }
+    atomic_store(&_profiler->events_count, 0);
+    atomic_store(&_profiler->events_dropped, 0);
+
+    return 1;
+}
+
+// Помещает в *_stats накопленную статистику фазы _phase (C_PROFILE_*).
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_profiler_get_stats(const c_profiler *const _profiler,
+                               const size_t _phase,
+                               c_profile_stats *const _stats)
+{
+    if (_profiler == NULL)
+    {
+        return -1;
+    }
+    if (_phase >= C_PROFILE_PHASES)
+    {
+        return -2;
+    }
+    if (_stats == NULL)
+    {
+        return -3;
+    }
+
+    // Мьютекс не относится к наблюдаемому состоянию профилировщика.
+    c_mutex *const mutex = (c_mutex*)&_profiler->mutex;
+    mutex_lock(mutex);
+    *_stats = _profiler->stats[_phase];
+    mutex_unlock(mutex);
+
+    return 1;
+}
+
+// Записывает трассу в файл формата Chrome trace event (JSON), который открывается в chrome://tracing или Perfetto.
+// Каждое событие - завершенная фаза ("ph": "X") с показаниями доступных счетчиков в args.
+// Фазы, которые еще записываются другими потоками, пропускаются.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_profiler_write_trace(const c_profiler *const _profiler,
+                                 const char *const _file_name)
+{
+    if (_profiler == NULL)
+    {
+        return -1;
+    }
+    if ( (_file_name == NULL) ||
+         (strlen(_file_name) == 0) )
+    {
+        return -2;
+    }
+
+    static const char *const phase_names[C_PROFILE_PHASES] = {"cross", "evaluate", "select", "execute"};
+    static const char *const counter_names[PROFILE_COUNTERS] = {"cycles", "instructions", "l1d_misses",
+                                                                "llc_misses", "branch_misses"};
+
+    FILE *f = fopen(_file_name, "w");
+
+    // Контроль успешности открытия.
+    if (f == NULL)
+    {
+        return -3;
+    }
+
+    fprintf(f, "{\"traceEvents\":[");
+    const size_t events_count = atomic_load(&_profiler->events_count);
+    int first_event = 1;
+    for (size_t e = 0; e < events_count; ++e)
+    {
+        const c_profile_event *const event = &_profiler->events[e];
+        if (atomic_load_explicit(&event->ready, memory_order_acquire) == 0)
+        {
+            continue;
+        }
+        fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                (first_event != 0) ? "" : ",", phase_names[event->phase],
+                (double)event->start_ns / 1e3, (double)event->duration_ns / 1e3);
+        int first = 1;
+        for (size_t c = 0; c < PROFILE_COUNTERS; ++c)
+        {
+            if ((_profiler->available & (1u << c)) != 0)
+            {
+                fprintf(f, "%s\"%s\":%llu", (first != 0) ? "" : ",", counter_names[c],
+                        (unsigned long long)event->counters[c]);
+                first = 0;
+            }
+        }
+        fprintf(f, "}}");
+        first_event = 0;
+    }
+    fprintf(f, "\n],\"otherData\":{\"dropped_events\":%zu}}\n", atomic_load(&_profiler->events_dropped));
+
+    // Контроль успешности записи.
+    if ( (ferror(f) != 0) ||
+         (fclose(f) != 0) )
+    {
+        return -4;
+    }
+
+    return 1;
+}
+
+// Пропускает сигнал через перцептрон с заданными весами.
+// Если _use_csr != 0, используется CSR представление весов перцептрона, а _weights игнорируются.
+// Входные сигналы читаются прямо из _ins (с шагом _ins_stride между соседними сигналами),
+// выходные сигналы пишутся прямо в _outs. _ins и _outs не должны перекрываться.
+// Если _workers != NULL, нейроны слоев шириной >= parallel_width перцептрона распределяются по потокам пула;
+// следующий слой начинается после завершения всех потоков. Результат совпадает с последовательным выполнением.
+static void forward(const c_perceptron *const _perceptron,
+                    const float *const _weights,
+                    const int _use_csr,
+                    const float *const _ins,
+                    const size_t _ins_stride,
+                    float *const _outs,
+                    c_workers *const _workers)
+{
+    // Определяем, сколько нейронов имеется в самом "жирном" слое.
+    size_t h_buffer_count = 0;
+    for (size_t l = 0; l < _perceptron->layers_count; ++l)
+    {
+        if (_perceptron->topology[l] > h_buffer_count)
+        {
+            h_buffer_count = _perceptron->topology[l];
+        }
+    }
+
+    // Вспомогательные буфера.
+    float a[h_buffer_count],
+          b[h_buffer_count];
+
+    // Указатели нужны для быстрого свопа.
+    const float *h_ins = _ins;
+    float *h_outs;
+
+    // Непрерывные входные сигналы читаются на месте.
+    // Разреженные по памяти входные сигналы один раз собираются в буфер, чтобы
+    // не читать их с шагом для каждого нейрона первого слоя.
+    if (_ins_stride != 1)
+    {
+        for (size_t pn = 0; pn < _perceptron->topology[0]; ++pn)
+        {
+            b[pn] = _ins[pn * _ins_stride];
+        }
+        h_ins = b;
+    }
+
+    // Пропускаем входные сигналы через сеть.
+    // Последний слой пишет сразу в _outs.
+    size_t w = 0;
+    size_t r = 0;
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
+    {
+        if (l == _perceptron->layers_count - 1)
+        {
+            h_outs = _outs;
+        } else {
+            h_outs = (h_ins == a) ? b : a;
+        }
+
+        const size_t cn_count = _perceptron->topology[l];
+        const float *const l_weights = (_use_csr != 0) ? NULL : &_weights[w];
+
+        if ( (_workers != NULL) &&
+             (cn_count >= _perceptron->parallel_width) )
+        {
+            c_layer_task task = {_perceptron, l, l_weights, _use_csr, r, h_ins, h_outs, _workers->threads_count};
+            workers_run(_workers, forward_layer_task, &task);
+        } else {
+            forward_layer(_perceptron, l, l_weights, _use_csr, r, h_ins, h_outs, 0, cn_count);
+        }
+
+        w += _perceptron->topology[l - 1] * cn_count;
+        r += cn_count;
+
+        h_ins = h_outs;
+    }
+}
+
+// Создает состояние инкрементального выполнения для перцептрона. Суммы недействительны до первого выполнения.
+// В случае ошибки возвращает NULL.
+static c_incremental *incremental_create(const c_perceptron *const _perceptron,
+                                         const float _epsilon,
+                                         const size_t _full_interval)
+{
+    // Количество нейронов уже проверено при создании перцептрона, переполнение невозможно.
+    size_t active_count = 0;
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
+    {
+        active_count += _perceptron->topology[l];
+    }
+    const size_t sent_count = active_count + _perceptron->topology[0] -
+                              _perceptron->topology[_perceptron->layers_count - 1];
+
+    // Определим размер состояния: состояние, суммы, выходы, учтенные значения.
+    const size_t o_sums = align_up(sizeof(c_incremental), _Alignof(float));
+    const size_t o_acts = o_sums + sizeof(float) * active_count;
+    const size_t o_sent = o_acts + sizeof(float) * active_count;
+    const size_t new_size = o_sent + sizeof(float) * sent_count;
+
+    const c_allocator *const allocator = &_perceptron->block->allocator;
+    char *const h = mem_alloc(allocator, new_size);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+        return NULL;
+    }
+
+    // Собираем состояние.
+    c_incremental *const new_incremental = (c_incremental*)h;
+    new_incremental->epsilon = _epsilon;
+    new_incremental->full_interval = _full_interval;
+    new_incremental->ticks = 0;
+    new_incremental->valid = 0;
+    new_incremental->sums = (float*)(h + o_sums);
+    new_incremental->acts = (float*)(h + o_acts);
+    new_incremental->sent = (float*)(h + o_sent);
+    new_incremental->outs_offset = active_count - _perceptron->topology[_perceptron->layers_count - 1];
+    new_incremental->size = new_size;
+    new_incremental->allocator = *allocator;
+
+    return new_incremental;
+}
+
+// Удаляет состояние инкрементального выполнения.
+static void incremental_delete(c_incremental *const _incremental)
+{
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _incremental->allocator;
+    mem_free(&allocator, _incremental, _incremental->size);
+}
+
+// Пропускает сигнал через перцептрон, обновляя сохраненные суммы только для изменившихся сигналов.
+// Изменившийся на d вход pn добавляет d * w к сумме каждого нейрона cn первого слоя (столбец pn весов слоя).
+// Выход нейрона передается следующему слою, только если он отличается от уже учтенного значения больше,
+// чем на epsilon; меньшие изменения накапливаются, пока не превысят epsilon. Если слой не передал
+// ни одного изменения, следующие слои не вычисляются. Если изменилась заметная доля входов слоя
+// (см. INCREMENTAL_DENSE_SHARE), суммы слоя пересчитываются полностью.
+// Каждые full_interval выполнений, а также после изменения весов, суммы пересчитываются полностью
+// в том же порядке, что и forward(), что ограничивает накопление ошибок округления.
+// Входные сигналы читаются из _ins с шагом _ins_stride, выходные пишутся в _outs.
+static void forward_incremental(c_perceptron *const _perceptron,
+                                const float *const _ins,
+                                const size_t _ins_stride,
+                                float *const _outs)
+{
+    c_incremental *const incremental = _perceptron->incremental;
+
+    const int full = (incremental->valid == 0) ||
+                     (incremental->ticks >= incremental->full_interval);
+    if (full != 0)
+    {
+        incremental->ticks = 0;
+        incremental->valid = 1;
+    }
+    ++incremental->ticks;
+
+    size_t w = 0;
+    size_t n = 0;
+    size_t s = 0;
+    const float *h_ins = _ins;
+    size_t h_stride = _ins_stride;
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
+    {
+        const size_t pn_count = _perceptron->topology[l - 1];
+        const size_t cn_count = _perceptron->topology[l];
+        const float *const weights = &_perceptron->weights[w];
+        float *const sums = &incremental->sums[n];
+        float *const acts = &incremental->acts[n];
+        float *const sent = &incremental->sent[s];
+
+        // Входы учитываются при любом изменении, выходы нейронов - при изменении больше epsilon.
+        size_t changed_count = pn_count;
+        if (full == 0)
+        {
+            changed_count = 0;
+            for (size_t pn = 0; pn < pn_count; ++pn)
+            {
+                const float value = h_ins[pn * h_stride];
+                if ( (l == 1) ? (value != sent[pn]) : (fabsf(value - sent[pn]) > incremental->epsilon) )
+                {
+                    ++changed_count;
+                }
+            }
+        }
+
+        // Выходы слоя, не получившего изменений, остались прежними, как и выходы следующих слоев.
+        if (changed_count == 0)
+        {
+            break;
+        }
+
+        if (changed_count * INCREMENTAL_DENSE_SHARE > pn_count)
+        {
+            for (size_t pn = 0; pn < pn_count; ++pn)
+            {
+                sent[pn] = h_ins[pn * h_stride];
+            }
+            for (size_t cn = 0; cn < cn_count; ++cn)
+            {
+                const float *const c_weights = &weights[cn * pn_count];
+                float sum = 0;
+                for (size_t pn = 0; pn < pn_count; ++pn)
+                {
+                    sum += sent[pn] * c_weights[pn];
+                }
+                sums[cn] = sum;
+            }
+        } else {
+            for (size_t pn = 0; pn < pn_count; ++pn)
+            {
+                const float value = h_ins[pn * h_stride];
+                const float delta = value - sent[pn];
+                if ( (l == 1) ? (value != sent[pn]) : (fabsf(delta) > incremental->epsilon) )
+                {
+                    for (size_t cn = 0; cn < cn_count; ++cn)
+                    {
+                        sums[cn] += delta * weights[cn * pn_count + pn];
+                    }
+                    sent[pn] = value;
+                }
+            }
+        }
+
+        memcpy(acts, sums, sizeof(float) * cn_count);
+        activation_apply(_perceptron->activations[l], acts, cn_count);
+
+        w += pn_count * cn_count;
+        n += cn_count;
+        s += pn_count;
+
+        h_ins = acts;
+        h_stride = 1;
+    }
+
+    const size_t outs_count = _perceptron->topology[_perceptron->layers_count - 1];
+    memcpy(_outs, &incremental->acts[incremental->outs_offset], sizeof(float) * outs_count);
+}
+
+// Создает кэш результатов на _capacity записей для перцептрона.
+// В случае ошибки возвращает NULL.
+static c_cache *cache_create(const c_perceptron *const _perceptron,
+                             const size_t _capacity)
+{
+    const size_t ins_count = _perceptron->topology[0];
+    const size_t outs_count = _perceptron->topology[_perceptron->layers_count - 1];
+
+    // Корзин - степень двойки, не меньшая количества записей.
+    size_t buckets_count = 1;
+    while (buckets_count < _capacity)
+    {
+        buckets_count *= 2;
+    }
+    // Контроль целочисленного переполнения.
+    if ( (_capacity >= CACHE_NONE) ||
+         (buckets_count > CACHE_NONE) ||
+         (ins_count + outs_count > SIZE_MAX / sizeof(float) / _capacity) )
+    {
+        return NULL;
+    }
+
+    // Определим размер кэша: кэш, корзины, записи, входные и выходные сигналы записей.
+    const size_t o_buckets = align_up(sizeof(c_cache), _Alignof(uint32_t));
+    const size_t o_slots = align_up(o_buckets + sizeof(uint32_t) * buckets_count, _Alignof(c_cache_slot));
+    const size_t o_ins = align_up(o_slots + sizeof(c_cache_slot) * _capacity, _Alignof(float));
+    const size_t o_outs = o_ins + sizeof(float) * ins_count * _capacity;
+    if ( (o_slots == 0) ||
+         (o_ins == 0) ||
+         (o_outs > SIZE_MAX - sizeof(float) * outs_count * _capacity) )
+    {
+        return NULL;
+    }
+    const size_t new_size = o_outs + sizeof(float) * outs_count * _capacity;
+
+    const c_allocator *const allocator = &_perceptron->block->allocator;
+    char *const h = mem_alloc(allocator, new_size);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+        return NULL;
+    }
+
+    // Собираем кэш. Пустым его делает первое обращение.
+    c_cache *const new_cache = (c_cache*)h;
+    new_cache->capacity = _capacity;
+    new_cache->used_count = 0;
+    new_cache->hand = 0;
+    new_cache->valid = 0;
+    new_cache->buckets_mask = (uint32_t)(buckets_count - 1);
+    new_cache->buckets = (uint32_t*)(h + o_buckets);
+    new_cache->slots = (c_cache_slot*)(h + o_slots);
+    new_cache->ins = (float*)(h + o_ins);
+    new_cache->outs = (float*)(h + o_outs);
+    memset(&new_cache->stats, 0, sizeof(c_cache_stats));
+    new_cache->stats.capacity = _capacity;
+    new_cache->size = new_size;
+    new_cache->allocator = *allocator;
+
+    return new_cache;
+}
+
+// Удаляет кэш результатов.
+static void cache_delete(c_cache *const _cache)
+{
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _cache->allocator;
+    mem_free(&allocator, _cache, _cache->size);
+}
+
+// Возвращает хеш _count входных сигналов. Сигналы сравниваются побитово, поэтому хешируются их биты.
+static uint64_t cache_hash(const float *const _ins,
+                           const size_t _count)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15u ^ (uint64_t)_count;
+    for (size_t i = 0; i < _count; ++i)
+    {
+        uint32_t bits;
+        memcpy(&bits, &_ins[i], sizeof(uint32_t));
+        hash = (hash ^ bits) * 0xFF51AFD7ED558CCDu;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// Ищет в кэше результат для входных сигналов _ins с хешем _hash и копирует его в _outs.
+// Недействительный кэш предварительно очищается.
+// Возвращает 1, если результат найден, иначе 0.
+static int cache_get(const c_perceptron *const _perceptron,
+                     const float *const _ins,
+                     const uint64_t _hash,
+                     float *const _outs)
+{
+    c_cache *const cache = _perceptron->cache;
+    const size_t ins_count = _perceptron->topology[0];
+    const size_t outs_count = _perceptron->topology[_perceptron->layers_count - 1];
+
+    if (cache->valid == 0)
+    {
+        for (size_t b = 0; b <= cache->buckets_mask; ++b)
+        {
+            cache->buckets[b] = CACHE_NONE;
+        }
+        if (cache->used_count != 0)
+        {
+            ++cache->stats.invalidations;
+        }
+        cache->used_count = 0;
+        cache->hand = 0;
+        cache->valid = 1;
+    }
+
+    for (uint32_t i = cache->buckets[_hash & cache->buckets_mask]; i != CACHE_NONE; i = cache->slots[i].next)
+    {
+        if ( (cache->slots[i].hash == _hash) &&
+             (memcmp(&cache->ins[i * ins_count], _ins, sizeof(float) * ins_count) == 0) )
+        {
+            cache->slots[i].referenced = 1;
+            memcpy(_outs, &cache->outs[i * outs_count], sizeof(float) * outs_count);
+            ++cache->stats.hits;
+            return 1;
+        }
+    }
+
+    ++cache->stats.misses;
+    return 0;
+}
+
+// Помещает в кэш результат _outs для входных сигналов _ins с хешем _hash.
+// Если свободных записей нет, вытесняет запись, к которой не обращались за последний оборот стрелки.
+static void cache_put(const c_perceptron *const _perceptron,
+                      const float *const _ins,
+                      const uint64_t _hash,
+                      const float *const _outs)
+{
+    c_cache *const cache = _perceptron->cache;
+    const size_t ins_count = _perceptron->topology[0];
+    const size_t outs_count = _perceptron->topology[_perceptron->layers_count - 1];
+
+    size_t i;
+    if (cache->used_count < cache->capacity)
+    {
+        i = cache->used_count++;
+    } else {
+        while (cache->slots[cache->hand].referenced != 0)
+        {
+            cache->slots[cache->hand].referenced = 0;
+            cache->hand = (cache->hand + 1) % cache->capacity;
+        }
+        i = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->capacity;
+
+        // Исключаем вытесняемую запись из цепочки ее корзины.
+        uint32_t *link = &cache->buckets[cache->slots[i].hash & cache->buckets_mask];
+        while (*link != i)
+        {
+            link = &cache->slots[*link].next;
+        }
+        *link = cache->slots[i].next;
+
+        ++cache->stats.evictions;
+    }
+
+    uint32_t *const bucket = &cache->buckets[_hash & cache->buckets_mask];
+    cache->slots[i].hash = _hash;
+    cache->slots[i].next = *bucket;
+    cache->slots[i].referenced = 1;
+    *bucket = (uint32_t)i;
+    memcpy(&cache->ins[i * ins_count], _ins, sizeof(float) * ins_count);
+    memcpy(&cache->outs[i * outs_count], _outs, sizeof(float) * outs_count);
+}
+
+// Пропускает сигнал через перцептрон с его собственными весами.
+// Если включен кэш результатов, результат сначала ищется в кэше, а вычисленный результат помещается в кэш.
+// Если _use_incremental != 0 и включено инкрементальное выполнение, используется forward_incremental(),
+// иначе forward() с пулом потоков перцептрона.
+static void execute_signal(c_perceptron *const _perceptron,
+                           const float *const _ins,
+                           const size_t _ins_stride,
+                           float *const _outs,
+                           const int _use_incremental)
+{
+    const size_t ins_count = _perceptron->topology[0];
+
+    // Ключ кэша - непрерывные входные сигналы, разреженные по памяти сигналы собираются в буфер.
+    float gathered[( (_perceptron->cache != NULL) && (_ins_stride != 1) ) ? ins_count : 1];
+    const float *key = _ins;
+    uint64_t hash = 0;
+    if (_perceptron->cache != NULL)
+    {
+        if (_ins_stride != 1)
+        {
+            for (size_t pn = 0; pn < ins_count; ++pn)
+            {
+                gathered[pn] = _ins[pn * _ins_stride];
+            }
+            key = gathered;
+        }
+        hash = cache_hash(key, ins_count);
+        if (cache_get(_perceptron, key, hash, _outs) != 0)
+        {
+            return;
+        }
+    }
+
+    if ( (_use_incremental != 0) &&
+         (_perceptron->incremental != NULL) )
+    {
+        forward_incremental(_perceptron, _ins, _ins_stride, _outs);
+    } else {
+        forward(_perceptron, _perceptron->weights, _perceptron->csr_state == CSR_READY,
+                _ins, _ins_stride, _outs, _perceptron->workers);
+    }
+
+    if (_perceptron->cache != NULL)
+    {
+        cache_put(_perceptron, key, hash, _outs);
+    }
+}
+
+// Вычисляет суммарную ошибку заданных весов на всех уроках (последовательно, в порядке уроков).
+static float weights_sigma(const c_perceptron *const _perceptron,
+                           const float *const _weights,
+                           const int _use_csr,
+                           const float *const _lessons,
+                           const size_t _lessons_count)
+{
+    const size_t ins_count = _perceptron->topology[0];
+    const size_t outs_count = _perceptron->topology[_perceptron->layers_count - 1];
+    const size_t ins_outs_count = ins_count + outs_count;
+
+    // Буфер для выходных сигналов перцептрона.
+    float h_outs[outs_count];
+
+    float sigma = 0.f;
+
+    // Обходим все уроки.
+    for (size_t l = 0; l < _lessons_count; ++l)
+    {
+        const float *const l_ins = &_lessons[l * ins_outs_count];
+        const float *const l_outs = &_lessons[l * ins_outs_count + ins_count];
+
+        // Пропускаем входные сигналы урока через перцептрон с заданными весами.
+        forward(_perceptron, _weights, _use_csr, l_ins, 1, h_outs, NULL);
+
+        // Вычисляем суммарную ошибку по всем выходным сигналам.
+        for (size_t o = 0; o < outs_count; ++o)
+        {
+            sigma += fabs(l_outs[o] - h_outs[o]);
+        }
+    }
+
+    return sigma;
+}
+
+// Параллельное по урокам тестирование весов.
+// Уроки делятся на blocks_count блоков, ошибка каждого блока вычисляется последовательно,
+// затем ошибки блоков складываются попарно деревом в фиксированном порядке.
+typedef struct s_c_lessons_eval
+{
+    const c_perceptron *perceptron;
+    const float *weights;
+    int use_csr;
+    const float *lessons;
+    size_t lessons_count;
+    size_t blocks_count;
+    size_t threads_count;
+    float partials[LESSONS_BLOCKS];
+} c_lessons_eval;
+
+// Вычисляет ошибку блока уроков _b.
+static void lessons_eval_block(c_lessons_eval *const _eval,
+                               const size_t _b)
+{
+    const size_t ins_outs_count = _eval->perceptron->topology[0] +
+                                  _eval->perceptron->topology[_eval->perceptron->layers_count - 1];
+
+    // Блок b содержит уроки [b * q + min(b, r); (b + 1) * q + min(b + 1, r)), где q и r - частное и остаток
+    // от деления количества уроков на количество блоков.
+    const size_t q = _eval->lessons_count / _eval->blocks_count;
+    const size_t r = _eval->lessons_count % _eval->blocks_count;
+    const size_t first = _b * q + ((_b < r) ? _b : r);
+    const size_t count = q + ((_b < r) ? 1 : 0);
+
+    _eval->partials[_b] = weights_sigma(_eval->perceptron, _eval->weights, _eval->use_csr,
+                                        &_eval->lessons[first * ins_outs_count], count);
+}
+
+// Задача пула: поток w вычисляет ошибки блоков w, w + threads_count, ...
+static void lessons_eval_task(void *const _context,
+                              const size_t _worker)
+{
+    c_lessons_eval *const eval = _context;
+    for (size_t b = _worker; b < eval->blocks_count; b += eval->threads_count)
+    {
+        lessons_eval_block(eval, b);
+    }
+}
+
+// Вычисляет суммарную ошибку весов на уроках.
+// Если _workers != NULL, блоки уроков распределяются по потокам пула, иначе вычисляются вызывающим потоком.
+// Результат не зависит от количества потоков.
+static float lessons_sigma(c_lessons_eval *const _eval,
+                           c_workers *const _workers)
+{
+    _eval->blocks_count = (_eval->lessons_count < LESSONS_BLOCKS) ? _eval->lessons_count : LESSONS_BLOCKS;
+
+    if (_workers != NULL)
+    {
+        _eval->threads_count = _workers->threads_count;
+        workers_run(_workers, lessons_eval_task, _eval);
+    } else {
+        for (size_t b = 0; b < _eval->blocks_count; ++b)
+        {
+            lessons_eval_block(_eval, b);
+        }
+    }
+
+    // Складываем ошибки блоков попарно: (0 + 1) + (2 + 3), ((0 + 1) + (2 + 3)) + ((4 + 5) + (6 + 7)), ...
+    for (size_t step = 1; step < _eval->blocks_count; step *= 2)
+    {
+        for (size_t b = 0; b + step < _eval->blocks_count; b += 2 * step)
+        {
+            _eval->partials[b] += _eval->partials[b + step];
+        }
+    }
+
+    return _eval->partials[0];
+}
+
+// Проверяет, окупает ли тестирование _lessons_count уроков запуск задачи на _threads_count потоках.
+static int lessons_parallel(const c_perceptron *const _perceptron,
+                            const size_t _lessons_count,
+                            const size_t _threads_count)
+{
+    const size_t lessons_min = (LESSONS_PARALLEL_WORK + _perceptron->weights_count - 1) / _perceptron->weights_count;
+    return _lessons_count / _threads_count >= lessons_min;
+}
+
+// Создает перцептрон заданой топологии.
+// Слоев должно быть >= 2..
+// Каждый слой должен содержать > 0 нейронов.
+// Перцептрон вместе с топологией, весами, входами и выходами размещается в одном выровненном блоке памяти.
+// В случае ошибки возвращает NULL, и если _error != NULL,
+// в заданное расположение помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_create(const size_t _layers_count,
+                                  const size_t *const _topology,
+                                  size_t *const _error)
+{
+    return c_perceptron_create_ex(_layers_count, _topology, NULL, _error);
+}
+
+// Создает перцептрон заданой топологии, см. c_perceptron_create_ex().
+// Если _with_weights == 0, память под плотные веса не выделяется (компактный перцептрон),
+// CSR должен построить вызывающий.
+static c_perceptron *perceptron_create(const size_t _layers_count,
+                                       const size_t *const _topology,
+                                       const c_allocator *const _allocator,
+                                       const int _with_weights,
+                                       size_t *const _error)
+{
+    if (_layers_count < 2)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    if (_topology == NULL)
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+    for (size_t l = 0; l < _layers_count; ++l)
+    {
+        if (_topology[l] == 0)
+        {
+            error_set(_error, 3);
+            return NULL;
+        }
+    }
+    const c_allocator *const allocator = allocator_resolve(_allocator);
+    if (allocator == NULL)
+    {
+        error_set(_error, 15);
+        return NULL;
+    }
+
+    // Определим, сколько памяти нужно под топологию.
+    const size_t new_topology_size = sizeof(size_t) * _layers_count;
+    // Контроль целочисленного переполнения при умножении.
+    if ( (new_topology_size == 0) ||
+         (new_topology_size / sizeof(size_t) != _layers_count) )
+    {
+        error_set(_error, 4);
+        return NULL;
+    }
+
+    // Определим количество весов в перцептроне.
+    size_t new_weights_count = 0;
+    for (size_t l = 1; l < _layers_count; ++l)
+    {
+        const size_t m = _topology[l - 1] * _topology[l];
+        // Контроль целочисленного переполнения при умножении.
+        if ( (m == 0) ||
+             (m / _topology[l - 1] != _topology[l]) )
+        {
+            error_set(_error, 6);
+            return NULL;
+        }
+        const size_t s = new_weights_count + m;
+        // Контроль целочисленного переполнения при сложении.
+        if (s < new_weights_count)
+        {
+            error_set(_error, 7);
+            return NULL;
+        }
+        new_weights_count = s;
+    }
+
+    // Определим, сколько памяти нужно под веса.
+    const size_t new_weights_size = sizeof(float) * new_weights_count;
+    // Контроль целочисленного переполнения при умножении.
+    if ( (new_weights_size == 0) ||
+         (new_weights_size / sizeof(float) != new_weights_count) )
+    {
+        error_set(_error, 8);
+        return NULL;
+    }
+
+    // Определим расположение частей перцептрона в блоке памяти.
+    c_perceptron_layout layout;
+    // Контроль целочисленного переполнения при сложении.
+    if (perceptron_layout(&layout, _layers_count, _topology[0], _topology[_layers_count - 1],
+                          new_weights_count, _with_weights) == 0)
+    {
+        error_set(_error, 16);
+        return NULL;
+    }
+
+    // Пытаемся выделить память под перцептрон.
+    c_perceptron *const new_perceptron = perceptron_alloc(allocator, &layout, _layers_count, _topology, NULL, new_weights_count);
+
+    // Контроль успешности выделения памяти.
+    if (new_perceptron == NULL)
+    {
+        error_set(_error, 14);
+        return NULL;
+    }
+
+    return new_perceptron;
+}
+
+// Создает перцептрон заданой топологии, память под который выделяется заданным распределителем.
+// Если _allocator == NULL, используется распределитель по умолчанию (malloc()/free()).
+// Распределитель копируется в перцептрон и используется для всей памяти перцептрона до его удаления.
+// В случае ошибки возвращает NULL, и если _error != NULL,
+// в заданное расположение помещается код причины ошибки (> 0):
+// коды c_perceptron_create(), 15 - некорректный распределитель, 16 - переполнение размера блока.
+c_perceptron *c_perceptron_create_ex(const size_t _layers_count,
+                                     const size_t *const _topology,
+                                     const c_allocator *const _allocator,
+                                     size_t *const _error)
+{
+    return perceptron_create(_layers_count, _topology, _allocator, 1, _error);
+}
+
+// Удаляет перцептрон.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_delete(c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+
+    if (_perceptron->workers != NULL)
+    {
+        workers_delete(_perceptron->workers);
+    }
+    if (_perceptron->eval_workers != NULL)
+    {
+        workers_delete(_perceptron->eval_workers);
+    }
+    if (_perceptron->incremental != NULL)
+    {
+        incremental_delete(_perceptron->incremental);
+    }
+    if (_perceptron->cache != NULL)
+    {
+        cache_delete(_perceptron->cache);
+    }
+
+    csr_free(_perceptron);
+
+    // Веса удаляются вместе с последней ссылкой на их блок.
+    block_release(_perceptron->weights_block);
+    // Перцептрон расположен в собственном блоке, поэтому он освобождается последним.
+    block_release(_perceptron->block);
+
+    return 1;
+}
+
+// Заполняет веса перцептрона шумом.
+// В случае успеха функция возвращает > 0.
+// В случае ошибки функция возвращает < 0.
+ptrdiff_t c_perceptron_noise(c_perceptron *const _perceptron,
+                             const float _noise_force,
+                             uint64_t *const _seed)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+
+    if (_seed == NULL)
+    {
+        return -2;
+    }
+
+    if (weights_unshare(_perceptron) < 0)
+    {
+        return -3;
+    }
+
+    weights_noise(_perceptron->weights, _perceptron->weights_count, _noise_force, _seed);
+    weights_changed(_perceptron);
+
+    return 1;
+}
+
+
+// Прямое обращение ко входным сигналам перцептрона.
+// В случае, если _perceptron == NULL, возвращает NULL.
+float *c_perceptron_get_ins(c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return NULL;
+    }
+
+    return _perceptron->ins;
+}
+
+// Прямое обращение к выходным сигналам перцептрона.
+// В случае, если _perceptron == NULL, возвращает NULL.
+const float *c_perceptron_get_outs(c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return NULL;
+    }
+
+    return _perceptron->outs;
+}
+
+// Возвращает количество слоев перцептрона.
+// В случае, если _perceptron == NULL, возвращает 0.
+size_t c_perceptron_get_layers_count(const c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return 0;
+    }
+
+    return _perceptron->layers_count;
+}
+
+// Прямое обращение к топологии перцептрона (только для чтения).
+// В случае, если _perceptron == NULL, возвращает NULL.
+const size_t *c_perceptron_get_topology(const c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return NULL;
+    }
+
+    return _perceptron->topology;
+}
+
+// Задает функцию активации (C_ACTIVATION_*) слоя _layer (1 <= _layer < количество слоев).
+// По умолчанию все слои используют C_ACTIVATION_SIGMOID.
+// Функции активации сохраняются вместе с перцептроном и копируются при клонировании.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_set_activation(c_perceptron *const _perceptron,
+                                      const size_t _layer,
+                                      const size_t _activation)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if ( (_layer == 0) ||
+         (_layer >= _perceptron->layers_count) )
+    {
+        return -2;
+    }
+    if (_activation > C_ACTIVATION_HARD_SIGMOID)
+    {
+        return -3;
+    }
+
+    _perceptron->activations[_layer] = _activation;
+    // Выходы, сохраненные инкрементальным выполнением и кэшем, вычислены прежней функцией.
+    weights_changed(_perceptron);
+
+    return 1;
+}
+
+// Возвращает функцию активации (C_ACTIVATION_*) слоя _layer (1 <= _layer < количество слоев).
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_get_activation(const c_perceptron *const _perceptron,
+                                      const size_t _layer)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if ( (_layer == 0) ||
+         (_layer >= _perceptron->layers_count) )
+    {
+        return -2;
+    }
+
+    return _perceptron->activations[_layer];
+}
+
+// Возвращает количество весов перцептрона.
+// В случае, если _perceptron == NULL, возвращает 0.
+size_t c_perceptron_get_weights_count(const c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return 0;
+    }
+
+    return _perceptron->weights_count;
+}
+
+// Прямое обращение к весам перцептрона (только для чтения).
+// Веса хранятся послойно, для каждого нейрона слоя подряд идут веса всех его входов.
+// Указатель действителен до следующего изменения весов перцептрона.
+// У компактного перцептрона (см. c_perceptron_clone_compact()) нет плотных весов,
+// для него веса можно получить через c_perceptron_copy_weights().
+// В случае, если _perceptron == NULL или перцептрон компактный, возвращает NULL.
+const float *c_perceptron_get_weights(const c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return NULL;
+    }
+
+    return _perceptron->weights;
+}
+
+// Копирует веса перцептрона в заданный массив в порядке c_perceptron_get_weights(),
+// в том числе для компактного перцептрона.
+// Количество весов должно совпадать с количеством весов перцептрона.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_copy_weights(const c_perceptron *const _perceptron,
+                                    float *const _weights,
+                                    const size_t _weights_count)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_weights == NULL)
+    {
+        return -2;
+    }
+    if (_weights_count != _perceptron->weights_count)
+    {
+        return -3;
+    }
+
+    weights_copy(_perceptron, _weights);
+
+    return 1;
+}
+
+// Копирует заданные веса в перцептрон.
+// Количество весов должно совпадать с количеством весов перцептрона.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0, перцептрон не меняет состояние весов.
+ptrdiff_t c_perceptron_set_weights(c_perceptron *const _perceptron,
+                                   const float *const _weights,
+                                   const size_t _weights_count)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_weights == NULL)
+    {
+        return -2;
+    }
+    if (_weights_count != _perceptron->weights_count)
+    {
+        return -3;
+    }
+    if (weights_unshare(_perceptron) < 0)
+    {
+        return -4;
+    }
+
+    memcpy(_perceptron->weights, _weights, sizeof(float) * _weights_count);
+    weights_changed(_perceptron);
+
+    return 1;
+}
+
+// Компаратор, сортирует модули весов по возрастанию.
+static int comp_float(const void *_p1,
+                      const void *_p2)
+{
+    const float p1 = *(const float*)_p1;
+    const float p2 = *(const float*)_p2;
+    if (p1 > p2)
+    {
+        return 1;
+    } else {
+        if (p1 == p2)
+        {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+}
+
+// Обнуляет все веса перцептрона, модуль которых меньше _threshold.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_prune(c_perceptron *const _perceptron,
+                             const float _threshold)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if ( (isfinite(_threshold) == 0) ||
+         (_threshold < 0.f) )
+    {
+        return -2;
+    }
+    if (weights_unshare(_perceptron) < 0)
+    {
+        return -3;
+    }
+
+    for (size_t w = 0; w < _perceptron->weights_count; ++w)
+    {
+        if (fabs(_perceptron->weights[w]) < _threshold)
+        {
+            _perceptron->weights[w] = 0.f;
+        }
+    }
+    weights_changed(_perceptron);
+
+    return 1;
+}
+
+// Обнуляет наименьшие по модулю веса перцептрона так, чтобы доля нулевых весов
+// стала не меньше _sparsity [0; 1].
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0, перцептрон не меняет состояние весов.
+ptrdiff_t c_perceptron_prune_sparsity(c_perceptron *const _perceptron,
+                                      const float _sparsity)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if ( !(_sparsity >= 0.f) ||
+         !(_sparsity <= 1.f) )
+    {
+        return -2;
+    }
+
+    // Определяем, сколько весов должно быть нулевыми.
+    size_t target_count = ceil((double)_sparsity * _perceptron->weights_count);
+    if (target_count > _perceptron->weights_count)
+    {
+        target_count = _perceptron->weights_count;
+    }
+    if (target_count == 0)
+    {
+        return 1;
+    }
+
+    // Контроль целочисленного переполнения не нужен, так как
+    // он выполняется на этапе конструирования перцептрона.
+    const c_allocator *const allocator = &_perceptron->block->allocator;
+    float *const magnitudes = mem_alloc(allocator, sizeof(float) * _perceptron->weights_count);
+    // Контроль успешности выделения памяти.
+    if (magnitudes == NULL)
+    {
+        return -3;
+    }
+
+    // Находим модуль веса, ниже которого все веса обнуляются.
+    weights_copy(_perceptron, magnitudes);
+    for (size_t w = 0; w < _perceptron->weights_count; ++w)
+    {
+        magnitudes[w] = fabs(magnitudes[w]);
+    }
+    qsort(magnitudes, _perceptron->weights_count, sizeof(float), comp_float);
+    const float threshold = magnitudes[target_count - 1];
+    mem_free(allocator, magnitudes, sizeof(float) * _perceptron->weights_count);
+
+    if (weights_unshare(_perceptron) < 0)
+    {
+        return -4;
+    }
+
+    // Обнуляем веса меньше порога, а затем веса, равные порогу, пока не наберем нужную долю.
+    size_t zero_count = 0;
+    for (size_t w = 0; w < _perceptron->weights_count; ++w)
+    {
+        if (fabs(_perceptron->weights[w]) < threshold)
+        {
+            _perceptron->weights[w] = 0.f;
+            ++zero_count;
+        }
+    }
+    for (size_t w = 0; (w < _perceptron->weights_count) && (zero_count < target_count); ++w)
+    {
+        if (fabs(_perceptron->weights[w]) == threshold)
+        {
+            _perceptron->weights[w] = 0.f;
+            ++zero_count;
+        }
+    }
+    weights_changed(_perceptron);
+
+    return 1;
+}
+
+// Задает долю нулевых весов [0; 1], начиная с которой перцептрон выполняется через CSR.
+// Значение > 1 запрещает разреженное выполнение.
+// Компактный перцептрон выполняется через CSR независимо от порога.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_set_sparse_threshold(c_perceptron *const _perceptron,
+                                            const float _threshold)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if ( (isnan(_threshold) != 0) ||
+         (_threshold < 0.f) )
+    {
+        return -2;
+    }
+
+    _perceptron->sparse_threshold = _threshold;
+    weights_changed(_perceptron);
+
+    return 1;
+}
+
+// Возвращает долю нулевых весов перцептрона [0; 1].
+// В случае, если _perceptron == NULL, возвращает 0.
+float c_perceptron_get_sparsity(const c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return 0.f;
+    }
+
+    const size_t zero_count = (_perceptron->weights != NULL) ?
+                              weights_zero_count(_perceptron->weights, _perceptron->weights_count) :
+                              _perceptron->weights_count - _perceptron->csr_nnz;
+
+    return (float)zero_count / (float)_perceptron->weights_count;
+}
+
+// Включает параллельное выполнение широких слоев: нейроны каждого слоя шириной >= _width распределяются
+// по постоянному пулу из _threads_count потоков, следующий слой вычисляется после завершения всех потоков.
+// Слои уже _width вычисляются вызывающим потоком. _width == 0 задает ширину по умолчанию (PARALLEL_WIDTH).
+// Результаты совпадают с последовательным выполнением.
+// Пул используется c_perceptron_execute(), c_perceptron_execute_io() и c_perceptron_execute_rows(),
+// которые при включенном режиме нельзя вызывать для одного перцептрона одновременно из нескольких потоков.
+// Клоны перцептрона режим не наследуют.
+// _threads_count <= 1 выключает режим.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_set_threads(c_perceptron *const _perceptron,
+                                   const size_t _threads_count,
+                                   const size_t _width)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+
+    c_workers *new_workers = NULL;
+    if (_threads_count > 1)
+    {
+        new_workers = workers_create(&_perceptron->block->allocator, _threads_count, NULL);
+        if (new_workers == NULL)
+        {
+            return -2;
+        }
+    }
+
+    if (_perceptron->workers != NULL)
+    {
+        workers_delete(_perceptron->workers);
+    }
+    _perceptron->workers = new_workers;
+    _perceptron->parallel_width = (_width != 0) ? _width : PARALLEL_WIDTH;
+
+    return 1;
+}
+
+// Подключает к перцептрону профилировщик: каждый вызов c_perceptron_execute(), c_perceptron_execute_io()
+// и c_perceptron_execute_rows() учитывается в фазе C_PROFILE_EXECUTE.
+// Клоны перцептрона профилировщик не наследуют. _profiler == NULL отключает профилирование.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_set_profiler(c_perceptron *const _perceptron,
+                                    c_profiler *const _profiler)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+
+    _perceptron->profiler = _profiler;
+
+    return 1;
+}
+
+// Включает инкрементальное выполнение для случая, когда между вызовами меняется лишь малая часть входов.
+// Перцептрон хранит суммы взвешенных входов каждого нейрона и при выполнении учитывает только
+// изменившиеся входы и выходы нейронов, изменившиеся больше, чем на _epsilon (>= 0), поэтому
+// стоимость вызова пропорциональна объему изменений, а не размеру сети.
+// Выходы отличаются от полного пересчета не больше, чем позволяет _epsilon и накопленная ошибка округления;
+// каждый _full_interval-й вызов, а также первый вызов после изменения весов, пересчитывает сеть полностью.
+// _epsilon == 0 и _full_interval == 1 дают результаты, совпадающие с обычным выполнением.
+// Режим используется c_perceptron_execute() и c_perceptron_execute_io(); пул потоков
+// (см. c_perceptron_set_threads()) и разреженное представление весов в этом режиме не используются,
+// поэтому компактный перцептрон выводится из компактного режима.
+// Клоны перцептрона режим не наследуют.
+// _full_interval == 0 выключает режим.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_set_incremental(c_perceptron *const _perceptron,
+                                       const float _epsilon,
+                                       const size_t _full_interval)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if ( (isfinite(_epsilon) == 0) ||
+         (_epsilon < 0.f) )
+    {
+        return -2;
+    }
+
+    c_incremental *new_incremental = NULL;
+    if (_full_interval != 0)
+    {
+        if (weights_densify(_perceptron) < 0)
+        {
+            return -3;
+        }
+        new_incremental = incremental_create(_perceptron, _epsilon, _full_interval);
+        if (new_incremental == NULL)
+        {
+            return -3;
+        }
+    }
+
+    if (_perceptron->incremental != NULL)
+    {
+        incremental_delete(_perceptron->incremental);
+    }
+    _perceptron->incremental = new_incremental;
+
+    return 1;
+}
+
+// Включает кэш результатов выполнения на _capacity записей для повторяющихся входных сигналов.
+// Ключ записи - входные сигналы (сравниваются побитово), при переполнении вытесняются записи,
+// к которым дольше не обращались (алгоритм CLOCK). Любое изменение весов (c_perceptron_noise(),
+// c_perceptron_set_weights(), прореживание, c_pgs_run() и т.д.) делает кэш недействительным.
+// Кэш используется c_perceptron_execute(), c_perceptron_execute_io() и c_perceptron_execute_rows();
+// результаты совпадают с выполнением без кэша. Статистика доступна через c_perceptron_get_cache_stats().
+// Клоны перцептрона кэш не наследуют. Повторный вызов создает новый пустой кэш со сброшенной статистикой.
+// _capacity == 0 выключает кэш.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_set_cache(c_perceptron *const _perceptron,
+                                 const size_t _capacity)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+
+    c_cache *new_cache = NULL;
+    if (_capacity != 0)
+    {
+        new_cache = cache_create(_perceptron, _capacity);
+        if (new_cache == NULL)
+        {
+            return -2;
+        }
+    }
+
+    if (_perceptron->cache != NULL)
+    {
+        cache_delete(_perceptron->cache);
+    }
+    _perceptron->cache = new_cache;
+
+    return 1;
+}
+
+// Помещает в *_stats статистику кэша результатов: попадания, промахи, вытеснения, сбросы из-за
+// изменения весов, количество занятых записей и емкость.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_get_cache_stats(const c_perceptron *const _perceptron,
+                                       c_cache_stats *const _stats)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_perceptron->cache == NULL)
+    {
+        return -2;
+    }
+    if (_stats == NULL)
+    {
+        return -3;
+    }
+
+    *_stats = _perceptron->cache->stats;
+    _stats->entries_count = (_perceptron->cache->valid != 0) ? _perceptron->cache->used_count : 0;
+
+    return 1;
+}
+
+// Пропускает сигнал через перцептрон.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_execute(c_perceptron *const _perceptron)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+
+    // После изменения весов решаем, выгодно ли разреженное выполнение.
+    if (_perceptron->csr_state == CSR_UNKNOWN)
+    {
+        csr_update(_perceptron);
+    }
+
+    c_profile_mark mark;
+    profile_begin(_perceptron->profiler, &mark);
+
+    execute_signal(_perceptron, _perceptron->ins, 1, _perceptron->outs, 1);
+
+    profile_end(_perceptron->profiler, C_PROFILE_EXECUTE, &mark);
+
+    return 1;
+}
+
+// Пропускает сигнал через перцептрон, читая входные сигналы из памяти вызывающего и
+// записывая выходные сигналы в память вызывающего, минуя входа и выхода перцептрона.
+// _in_stride - расстояние (в float) между соседними входными сигналами, 1 - сигналы идут подряд.
+// _in и _out не должны перекрываться.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_execute_io(c_perceptron *const _perceptron,
+                                  const float *const _in,
+                                  const size_t _in_stride,
+                                  float *const _out)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_in == NULL)
+    {
+        return -2;
+    }
+    if (_in_stride == 0)
+    {
+        return -3;
+    }
+    if (_out == NULL)
+    {
+        return -4;
+    }
+
+    if (_perceptron->csr_state == CSR_UNKNOWN)
+    {
+        csr_update(_perceptron);
+    }
+
+    c_profile_mark mark;
+    profile_begin(_perceptron->profiler, &mark);
+
+    execute_signal(_perceptron, _in, _in_stride, _out, 1);
+
+    profile_end(_perceptron->profiler, C_PROFILE_EXECUTE, &mark);
+
+    return 1;
+}
+
+// Пропускает через перцептрон _rows_count строк, лежащих в памяти вызывающего.
+// Входные сигналы строки r начинаются с _in[r * _in_row_stride] и идут подряд,
+// выходные сигналы строки r пишутся в _out[r * _out_row_stride] подряд.
+// Шаги задаются в float и не должны быть меньше количества входов и выходов соответственно.
+// _in и _out не должны перекрываться.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_execute_rows(c_perceptron *const _perceptron,
+                                    const float *const _in,
+                                    const size_t _in_row_stride,
+                                    float *const _out,
+                                    const size_t _out_row_stride,
+                                    const size_t _rows_count)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_in == NULL)
+    {
+        return -2;
+    }
+    if (_in_row_stride < _perceptron->topology[0])
+    {
+        return -3;
+    }
+    if (_out == NULL)
+    {
+        return -4;
+    }
+    if (_out_row_stride < _perceptron->topology[_perceptron->layers_count - 1])
+    {
+        return -5;
+    }
+
+    if (_perceptron->csr_state == CSR_UNKNOWN)
+    {
+        csr_update(_perceptron);
+    }
+
+    c_profile_mark mark;
+    profile_begin(_perceptron->profiler, &mark);
+
+    for (size_t r = 0; r < _rows_count; ++r)
+    {
+        execute_signal(_perceptron, &_in[r * _in_row_stride], 1, &_out[r * _out_row_stride], 0);
+    }
+
+    profile_end(_perceptron->profiler, C_PROFILE_EXECUTE, &mark);
+
+    return 1;
+}
+
+// Вычисляет суммарную ошибку перцептрона на уроках (сумму модулей разностей выходов перцептрона и уроков).
+// Уроки должны храниться в виде: ins outs ins outs...
+// Если _threads_count > 1, уроки тестируются параллельно на _threads_count потоках: используется пул
+// c_perceptron_set_threads() с таким же количеством потоков, иначе пул создается при первом вызове и хранится
+// в перцептроне до его удаления или вызова с другим количеством потоков. В этом режиме функцию нельзя вызывать
+// для одного перцептрона одновременно из нескольких потоков. Если уроков слишком мало, чтобы окупить запуск
+// потоков, они тестируются вызывающим потоком.
+// Ошибки блоков уроков складываются в фиксированном порядке, поэтому результат не зависит от количества потоков
+// (и совпадает с ошибкой, которую вычисляет селекционер в режиме c_pgs_set_lesson_threads()).
+// В случае успеха возвращает > 0, ошибка помещается в *_sigma.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_evaluate(c_perceptron *const _perceptron,
+                                const float *const _lessons,
+                                const size_t _lessons_count,
+                                const size_t _threads_count,
+                                float *const _sigma)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_lessons == NULL)
+    {
+        return -2;
+    }
+    if (_lessons_count == 0)
+    {
+        return -3;
+    }
+    if (_sigma == NULL)
+    {
+        return -4;
+    }
+
+    // Контроль целочисленного переполнения при умножении.
+    const size_t ins_outs_size = sizeof(float) * (_perceptron->topology[0] +
+                                                  _perceptron->topology[_perceptron->layers_count - 1]);
+    if (_lessons_count > SIZE_MAX / ins_outs_size)
+    {
+        return -5;
+    }
+
+    if (_perceptron->csr_state == CSR_UNKNOWN)
+    {
+        csr_update(_perceptron);
+    }
+
+    c_lessons_eval eval;
+    eval.perceptron = _perceptron;
+    eval.weights = _perceptron->weights;
+    eval.use_csr = _perceptron->csr_state == CSR_READY;
+    eval.lessons = _lessons;
+    eval.lessons_count = _lessons_count;
+
+    c_workers *workers = NULL;
+    if ( (_threads_count > 1) &&
+         (lessons_parallel(_perceptron, _lessons_count, _threads_count) != 0) )
+    {
+        if ( (_perceptron->workers != NULL) &&
+             (_perceptron->workers->threads_count == _threads_count) )
+        {
+            workers = _perceptron->workers;
+        } else {
+            if ( (_perceptron->eval_workers != NULL) &&
+                 (_perceptron->eval_workers->threads_count != _threads_count) )
+            {
+                workers_delete(_perceptron->eval_workers);
+                _perceptron->eval_workers = NULL;
+            }
+            if (_perceptron->eval_workers == NULL)
+            {
+                _perceptron->eval_workers = workers_create(&_perceptron->block->allocator, _threads_count, NULL);
+                if (_perceptron->eval_workers == NULL)
+                {
+                    return -6;
+                }
+            }
+            workers = _perceptron->eval_workers;
+        }
+    }
+
+    *_sigma = lessons_sigma(&eval, workers);
+
+    return 1;
+}
+
+// Клонирует перцептрон.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_clone(const c_perceptron *const _perceptron,
+                                 size_t *const _error)
+{
+    return c_perceptron_clone_ex(_perceptron, NULL, _error);
+}
+
+// Клонирует перцептрон, память под клон выделяется заданным распределителем.
+// Если _allocator == NULL, используется распределитель по умолчанию (malloc()/free()).
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0): коды c_perceptron_clone(), 7 - некорректный распределитель.
+c_perceptron *c_perceptron_clone_ex(const c_perceptron *const _perceptron,
+                                    const c_allocator *const _allocator,
+                                    size_t *const _error)
+{
+    if (_perceptron == NULL)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    const c_allocator *const allocator = allocator_resolve(_allocator);
+    if (allocator == NULL)
+    {
+        error_set(_error, 7);
+        return NULL;
+    }
+
+    // Определим расположение частей перцептрона в блоке памяти.
+    // Контроль целочисленного переполнения не нужен, так как
+    // это переполнение контролируется на этапе конструирования перцептрона.
+    // Клон компактного перцептрона тоже компактный.
+    const int compact = _perceptron->weights == NULL;
+    const size_t ins_count = _perceptron->topology[0];
+    const size_t outs_count = _perceptron->topology[_perceptron->layers_count - 1];
+    c_perceptron_layout layout;
+    perceptron_layout(&layout, _perceptron->layers_count, ins_count, outs_count,
+                      _perceptron->weights_count, compact == 0);
+
+    // Попытаемся выделить память под перцептрон.
+    c_perceptron *const new_perceptron = perceptron_alloc(allocator, &layout, _perceptron->layers_count,
+                                                          _perceptron->topology, _perceptron->activations,
+                                                          _perceptron->weights_count);
+
+    // Контроль успешности выделения памяти.
+    if (new_perceptron == NULL)
+    {
+        error_set(_error, 6);
+        return NULL;
+    }
+
+    // Копируем веса (в компактном режиме - CSR), входа и выхода.
+    if (compact == 0)
+    {
+        memcpy(new_perceptron->weights, _perceptron->weights, sizeof(float) * _perceptron->weights_count);
+    } else {
+        if (csr_copy(new_perceptron, _perceptron) == 0)
+        {
+            c_perceptron_delete(new_perceptron);
+            error_set(_error, 3);
+            return NULL;
+        }
+    }
+    memcpy(new_perceptron->ins, _perceptron->ins, sizeof(float) * ins_count);
+    memcpy(new_perceptron->outs, _perceptron->outs, sizeof(float) * outs_count);
+    new_perceptron->sparse_threshold = _perceptron->sparse_threshold;
+
+    return new_perceptron;
+}
+
+// Клонирует перцептрон, разделяя с ним веса.
+// Веса не копируются, пока один из разделяющих их перцептронов не попытается изменить их
+// (c_perceptron_noise(), c_perceptron_set_weights(), c_perceptron_prune*(), c_pgs_run()).
+// Разделяющие веса перцептроны можно использовать из разных потоков.
+// Компактный перцептрон (см. c_perceptron_clone_compact()) не разделяет CSR, а клонируется целиком.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_clone_shared(const c_perceptron *const _perceptron,
+                                        size_t *const _error)
+{
+    return c_perceptron_clone_shared_ex(_perceptron, NULL, _error);
+}
+
+// Клонирует перцептрон, разделяя с ним веса, память под клон выделяется заданным распределителем.
+// Если _allocator == NULL, используется распределитель по умолчанию (malloc()/free()).
+// Копия весов при первом изменении выделяется распределителем клона.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_clone_shared_ex(const c_perceptron *const _perceptron,
+                                           const c_allocator *const _allocator,
+                                           size_t *const _error)
+{
+    if (_perceptron == NULL)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    const c_allocator *const allocator = allocator_resolve(_allocator);
+    if (allocator == NULL)
+    {
+        error_set(_error, 7);
+        return NULL;
+    }
+    if (_perceptron->weights == NULL)
+    {
+        return c_perceptron_clone_ex(_perceptron, allocator, _error);
+    }
+
+    // Определим расположение частей перцептрона в блоке памяти, без весов.
+    // Контроль целочисленного переполнения не нужен, так как
+    // это переполнение контролируется на этапе конструирования перцептрона.
+    const size_t ins_count = _perceptron->topology[0];
+    const size_t outs_count = _perceptron->topology[_perceptron->layers_count - 1];
+    c_perceptron_layout layout;
+    perceptron_layout(&layout, _perceptron->layers_count, ins_count, outs_count,
+                      _perceptron->weights_count, 0);
+
+    // Попытаемся выделить память под перцептрон.
+    c_perceptron *const new_perceptron = perceptron_alloc(allocator, &layout, _perceptron->layers_count,
+                                                          _perceptron->topology, _perceptron->activations,
+                                                          _perceptron->weights_count);
+
+    // Контроль успешности выделения памяти.
+    if (new_perceptron == NULL)
+    {
+        error_set(_error, 6);
+        return NULL;
+    }
+
+    // Становимся еще одним владельцем весов.
+    atomic_fetch_add(&_perceptron->weights_block->refs, 1);
+    new_perceptron->weights = _perceptron->weights;
+    new_perceptron->weights_block = _perceptron->weights_block;
+
+    // Копируем входа и выхода.
+    memcpy(new_perceptron->ins, _perceptron->ins, sizeof(float) * ins_count);
+    memcpy(new_perceptron->outs, _perceptron->outs, sizeof(float) * outs_count);
+    new_perceptron->sparse_threshold = _perceptron->sparse_threshold;
+
+    return new_perceptron;
+}
+
+// Клонирует перцептрон в компактном режиме: клон хранит только разреженное (CSR) представление весов -
+// ненулевые веса и номера их входов, - без плотных весов, поэтому память под веса обрезанного
+// (см. c_perceptron_prune()) перцептрона пропорциональна количеству ненулевых весов.
+// Компактный перцептрон выполняется через CSR и предназначен для вывода. Плотные веса восстанавливаются
+// из CSR при первом изменении весов (c_perceptron_noise(), c_perceptron_set_weights(), c_perceptron_prune*(),
+// c_pgs_run()) и при включении инкрементального выполнения, после чего перцептрон работает как обычный.
+// c_perceptron_get_weights() для компактного перцептрона возвращает NULL.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_clone_compact(const c_perceptron *const _perceptron,
+                                         size_t *const _error)
+{
+    return c_perceptron_clone_compact_ex(_perceptron, NULL, _error);
+}
+
+// Клонирует перцептрон в компактном режиме, память под клон выделяется заданным распределителем.
+// Если _allocator == NULL, используется распределитель по умолчанию (malloc()/free()).
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_clone_compact_ex(const c_perceptron *const _perceptron,
+                                            const c_allocator *const _allocator,
+                                            size_t *const _error)
+{
+    if (_perceptron == NULL)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    const c_allocator *const allocator = allocator_resolve(_allocator);
+    if (allocator == NULL)
+    {
+        error_set(_error, 7);
+        return NULL;
+    }
+    // Номера входов хранятся в uint32_t.
+    if (csr_fits(_perceptron) == 0)
+    {
+        error_set(_error, 8);
+        return NULL;
+    }
+
+    // Определим расположение частей перцептрона в блоке памяти, без весов.
+    // Контроль целочисленного переполнения не нужен, так как
+    // это переполнение контролируется на этапе конструирования перцептрона.
+    const size_t ins_count = _perceptron->topology[0];
+    const size_t outs_count = _perceptron->topology[_perceptron->layers_count - 1];
+    c_perceptron_layout layout;
+    perceptron_layout(&layout, _perceptron->layers_count, ins_count, outs_count,
+                      _perceptron->weights_count, 0);
+
+    // Попытаемся выделить память под перцептрон.
+    c_perceptron *const new_perceptron = perceptron_alloc(allocator, &layout, _perceptron->layers_count,
+                                                          _perceptron->topology, _perceptron->activations,
+                                                          _perceptron->weights_count);
+
+    // Контроль успешности выделения памяти.
+    if (new_perceptron == NULL)
+    {
+        error_set(_error, 6);
+        return NULL;
+    }
+
+    // Строим CSR по плотным весам или копируем CSR компактного перцептрона.
+    int is_built = 0;
+    if (_perceptron->weights != NULL)
+    {
+        const size_t nnz = _perceptron->weights_count - weights_zero_count(_perceptron->weights,
+                                                                            _perceptron->weights_count);
+        is_built = csr_alloc(new_perceptron, nnz);
+        if (is_built != 0)
+        {
+            csr_build(new_perceptron, _perceptron->weights);
+        }
+    } else {
+        is_built = csr_copy(new_perceptron, _perceptron);
+    }
+    if (is_built == 0)
+    {
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 3);
+        return NULL;
+    }
+    new_perceptron->csr_state = CSR_READY;
+
+    // Копируем входа и выхода.
+    memcpy(new_perceptron->ins, _perceptron->ins, sizeof(float) * ins_count);
+    memcpy(new_perceptron->outs, _perceptron->outs, sizeof(float) * outs_count);
+    new_perceptron->sparse_threshold = _perceptron->sparse_threshold;
+
+    return new_perceptron;
+}
+
+// Считывает функции активации активных слоев, записанные в конце файла перцептрона.
+// Файлы, записанные до появления функций активации, заканчиваются выходами: все слои используют сигмоиду.
+// В случае успеха возвращает 1, если функции активации повреждены или неизвестны - 0.
+static int activations_read(c_perceptron *const _perceptron,
+                            FILE *const _f)
+{
+    const size_t count = _perceptron->layers_count - 1;
+    const size_t r_count = fread(&_perceptron->activations[1], sizeof(size_t), count, _f);
+    if (r_count == 0)
+    {
+        return (feof(_f) != 0) ? 1 : 0;
+    }
+    if (r_count != count)
+    {
+        return 0;
+    }
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
+    {
+        if (_perceptron->activations[l] > C_ACTIVATION_HARD_SIGMOID)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Сохраняет перцептрон в двоичный файл в платформозависимом формате (порядок байт и размер size_t платформозависимы).
+// За выходными сигналами записываются функции активации активных слоев.
+// Если файл с заданным именем существует, то он перезаписывается, если это возможно (если невозможно, функция вернет < 0).
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_save(const c_perceptron *const _perceptron,
+                            const char *const _file_name)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_file_name == NULL)
+    {
+        return -2;
+    }
+    if (strlen(_file_name) == 0)
+    {
+        return -3;
+    }
+
+    // Вещи, которые зависят от платформы:
+    // 1 - размер size_t;
+    // 2 - порядок size_t;
+    // 3 - порядок float.
+
+    FILE *f = fopen(_file_name, "wb");
+
+    // Контроль успешности открытия.
+    if (f == NULL)
+    {
+        return -4;
+    }
+
+    int r_code;
+    // Записываем в файл количество слоев.
+    r_code = fwrite(&_perceptron->layers_count, sizeof(size_t), 1, f);
+
+    // Контроль успешности записи.
+    if (r_code != 1)
+    {
+        fclose(f);
+        return -5;
+    }
+    // Записываем в файл топологию.
+    r_code = fwrite(_perceptron->topology, sizeof(size_t) * _perceptron->layers_count, 1, f);
+
+    // Контроль успешности записи.
+    if (r_code != 1)
+    {
+        fclose(f);
+        return -6;
+    }
+
+    // Записываем в файл количество весов.
+    r_code = fwrite(&_perceptron->weights_count, sizeof(size_t), 1, f);
+
+    // Контроль успешности записи.
+    if (r_code != 1)
+    {
+        fclose(f);
+        return -7;
+    }
+
+    // Записываем в файл веса, веса компактного перцептрона восстанавливаются по одному нейрону.
+    if (_perceptron->weights != NULL)
+    {
+        r_code = fwrite(_perceptron->weights, sizeof(float) * _perceptron->weights_count, 1, f);
+    } else {
+        size_t row_size;
+        float *const row = weights_row_alloc(_perceptron, &row_size);
+        r_code = (row != NULL);
+        size_t w = 0;
+        size_t r = 0;
+        for (size_t l = 1; (l < _perceptron->layers_count) && (r_code == 1); ++l)
+        {
+            const size_t pn_count = _perceptron->topology[l - 1];
+            for (size_t cn = 0; (cn < _perceptron->topology[l]) && (r_code == 1); ++cn, ++r, w += pn_count)
+            {
+                r_code = fwrite(weights_row(_perceptron, w, r, pn_count, row), sizeof(float) * pn_count, 1, f);
+            }
+        }
+        mem_free(&_perceptron->block->allocator, row, row_size);
+    }
+
+    // Контроль успешности записи.
+    if (r_code != 1)
+    {
+        fclose(f);
+        return -8;
+    }
+
+    // Записываем в файл входные сигналы.
+    r_code = fwrite(_perceptron->ins, sizeof(float)*_perceptron->topology[0], 1, f);
+
+    // Контроль успешности записи.
+    if (r_code != 1)
+    {
+        fclose(f);
+        return -9;
+    }
+
+    // Записываем в файл выходные сигналы.
+    r_code = fwrite(_perceptron->outs, sizeof(float) * _perceptron->topology[_perceptron->layers_count - 1], 1, f);
+
+    // Контроль успешности записи.
+    if (r_code != 1)
+    {
+        fclose(f);
+        return -10;
+    }
+
+    // Записываем в файл функции активации активных слоев.
+    r_code = fwrite(&_perceptron->activations[1], sizeof(size_t) * (_perceptron->layers_count - 1), 1, f);
+
+    // Контроль успешности записи.
+    if (r_code != 1)
+    {
+        fclose(f);
+        return -11;
+    }
+
+    fclose(f);
+
+    return 1;
+}
+
+// Загружает перцептрон из файла в платформозависимом формате (порядок байт и размер size_t платформозависимы).
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_load(const char *const _file_name,
+                                size_t *const _error)
+{
+    return c_perceptron_load_ex(_file_name, NULL, _error);
+}
+
+// Загружает перцептрон из файла, память под перцептрон выделяется заданным распределителем.
+// Если _allocator == NULL, используется распределитель по умолчанию (malloc()/free()).
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0): коды c_perceptron_load(), 23 - некорректный распределитель,
+// 24 - переполнение размера блока, 25 - повреждены функции активации.
+c_perceptron *c_perceptron_load_ex(const char *const _file_name,
+                                   const c_allocator *const _allocator,
+                                   size_t *const _error)
+{
+    if (_file_name == NULL)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    if (strlen(_file_name) == 0)
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+    const c_allocator *const allocator = allocator_resolve(_allocator);
+    if (allocator == NULL)
+    {
+        error_set(_error, 23);
+        return NULL;
+    }
+
+    FILE *f = fopen(_file_name, "rb");
+
+    // Контроль успешности открытия.
+    if (f == NULL)
+    {
+        error_set(_error, 3);
+        return NULL;
+    }
+
+    int r_code;
+
+    // Считываем количество слоев.
+    size_t new_layers_count;
+    r_code = fread(&new_layers_count, sizeof(size_t), 1, f);
+
+    // Контроль успешности считывания.
+    if (r_code != 1)
+    {
+        fclose(f);
+        error_set(_error, 4);
+        return NULL;
+    }
+
+    // Проверяем число слоев на валидность.
+    if (new_layers_count < 2)
+    {
+        fclose(f);
+        error_set(_error, 5);
+        return NULL;
+    }
+
+    // Определяем, сколько памяти нужно под топологию.
+    const size_t new_topology_size = sizeof(size_t) * new_layers_count;
+    // Контроль целочисленного переполнения при умножении.
+    if ( (new_topology_size == 0) ||
+         (new_topology_size / sizeof(size_t) != new_layers_count) )
+    {
+        fclose(f);
+        error_set(_error, 6);
+        return NULL;
+    }
+
+    // Первый проход по топологии: контроль ее корректности и подсчет весов.
+    // Сама топология будет считана повторно прямо в блок перцептрона, чтобы не выделять под нее память отдельно.
+    size_t h_weights_count = 0;
+    size_t new_ins_count = 0;
+    size_t new_outs_count = 0;
+    size_t prev_count = 0;
+    for (size_t l = 0; l < new_layers_count; ++l)
+    {
+        size_t count;
+        r_code = fread(&count, sizeof(size_t), 1, f);
+
+        // Контроль успешности считывания.
+        if (r_code != 1)
+        {
+            fclose(f);
+            error_set(_error, 8);
+            return NULL;
+        }
+
+        // Контроль корректности топологии.
+        if (count == 0)
+        {
+            fclose(f);
+            error_set(_error, 9);
+            return NULL;
+        }
+
+        if (l == 0)
+        {
+            new_ins_count = count;
+        } else {
+            const size_t m = prev_count * count;
+            // Контроль целочисленного переполнения при умножении.
+            if (m / prev_count != count)
+            {
+                fclose(f);
+                error_set(_error, 11);
+                return NULL;
+            }
+            const size_t s = h_weights_count + m;
+            // Контроль целочисленного переполнения при сложении.
+            if (s < h_weights_count)
+            {
+                fclose(f);
+                error_set(_error, 11);
+                return NULL;
+            }
+            h_weights_count = s;
+        }
+        new_outs_count = count;
+        prev_count = count;
+    }
+
+    // Считываем количество весов.
+    size_t new_weights_count;
+    r_code = fread(&new_weights_count, sizeof(size_t), 1, f);
+
+    // Контроль успешности считывания.
+    if (r_code != 1)
+    {
+        fclose(f);
+        error_set(_error, 10);
+        return NULL;
+    }
+
+    // Проверяем, совпадает ли это число, с загруженным из файла.
+    if (h_weights_count != new_weights_count)
+    {
+        fclose(f);
+        error_set(_error, 12);
+        return NULL;
+    }
+
+    // Определим размер весов, которые необходимо загрузить из файла.
+    const size_t new_weights_size = sizeof(float) * new_weights_count;
+
+    // Контроль целочисленного переполнения при умножении.
+    if ( (new_weights_size == 0) ||
+         (new_weights_size / sizeof(float) != new_weights_count) )
+    {
+        fclose(f);
+        error_set(_error, 13);
+        return NULL;
+    }
+
+    // Определим расположение частей перцептрона в блоке памяти.
+    c_perceptron_layout layout;
+    // Контроль целочисленного переполнения при сложении.
+    if (perceptron_layout(&layout, new_layers_count, new_ins_count, new_outs_count,
+                          new_weights_count, 1) == 0)
+    {
+        fclose(f);
+        error_set(_error, 24);
+        return NULL;
+    }
+
+    // Попытаемся выделить память под перцептрон.
+    c_perceptron *const new_perceptron = perceptron_alloc(allocator, &layout, new_layers_count, NULL, NULL, new_weights_count);
+
+    // Контроль успешности выделения памяти.
+    if (new_perceptron == NULL)
+    {
+        fclose(f);
+        error_set(_error, 22);
+        return NULL;
+    }
+
+    // Второй проход: считываем топологию в перцептрон.
+    if ( (fseek(f, sizeof(size_t), SEEK_SET) != 0) ||
+         (fread(new_perceptron->topology, new_topology_size, 1, f) != 1) ||
+         (fseek(f, sizeof(size_t), SEEK_CUR) != 0) )
+    {
+        fclose(f);
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 8);
+        return NULL;
+    }
+
+    // Попытаемся считать веса из файла.
+    r_code = fread(new_perceptron->weights, new_weights_size, 1, f);
+
+    // Контроль успешности считывания.
+    if (r_code != 1)
+    {
+        fclose(f);
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 15);
+        return NULL;
+    }
+
+    // Попытаемся считать входа.
+    r_code = fread(new_perceptron->ins, sizeof(float) * new_ins_count, 1, f);
+
+    // Контроль успешности считывания.
+    if (r_code != 1)
+    {
+        fclose(f);
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 18);
+        return NULL;
+    }
+
+    // Попытаемся считать выхода.
+    r_code = fread(new_perceptron->outs, sizeof(float) * new_outs_count, 1, f);
+
+    // Контроль успешности считывания.
+    if (r_code != 1)
+    {
+        fclose(f);
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 21);
+        return NULL;
+    }
+
+    // Попытаемся считать функции активации.
+    if (activations_read(new_perceptron, f) == 0)
+    {
+        fclose(f);
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 25);
+        return NULL;
+    }
+
+    fclose(f);
+
+    return new_perceptron;
+}
+
+// Сохраняет перцептрон в двоичный файл в разреженном (CSR) платформозависимом формате.
+// Хранятся только ненулевые веса: для каждого нейрона всех активных слоев - смещение его первого
+// ненулевого веса, затем номера входов (uint32_t) и значения всех ненулевых весов,
+// а после входных и выходных сигналов - функции активации активных слоев.
+// Если файл с заданным именем существует, то он перезаписывается, если это возможно.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_save_sparse(const c_perceptron *const _perceptron,
+                                   const char *const _file_name)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_file_name == NULL)
+    {
+        return -2;
+    }
+    if (strlen(_file_name) == 0)
+    {
+        return -3;
+    }
+
+    // Номера входов хранятся в uint32_t.
+    if (csr_fits(_perceptron) == 0)
+    {
+        return -4;
+    }
+
+    // Используется готовое CSR перцептрона, иначе CSR строится во временной копии описания перцептрона,
+    // которая владеет только им.
+    c_perceptron csr = *_perceptron;
+    const int is_temporary = _perceptron->csr_state != CSR_READY;
+    if (is_temporary != 0)
+    {
+        csr.csr_rows = NULL;
+        csr.csr_cols = NULL;
+        csr.csr_values = NULL;
+        csr.csr_nnz = 0;
+        csr.csr_rows_count = 0;
+        if (csr_alloc(&csr, _perceptron->weights_count - weights_zero_count(_perceptron->weights,
+                                                                           _perceptron->weights_count)) == 0)
+        {
+            return -8;
+        }
+        csr_build(&csr, _perceptron->weights);
+    }
+
+    FILE *f = fopen(_file_name, "wb");
+
+    // Контроль успешности открытия.
+    if (f == NULL)
+    {
+        if (is_temporary != 0)
+        {
+            csr_free(&csr);
+        }
+        return -5;
+    }
+
+    // Записываем количество слоев, топологию, количество весов и количество ненулевых весов.
+    fwrite(&_perceptron->layers_count, sizeof(size_t), 1, f);
+    fwrite(_perceptron->topology, sizeof(size_t) * _perceptron->layers_count, 1, f);
+    fwrite(&_perceptron->weights_count, sizeof(size_t), 1, f);
+    fwrite(&csr.csr_nnz, sizeof(size_t), 1, f);
+
+    // Записываем смещения строк, номера входов и значения ненулевых весов.
+    fwrite(csr.csr_rows, sizeof(size_t) * csr.csr_rows_count, 1, f);
+    if (csr.csr_nnz > 0)
+    {
+        fwrite(csr.csr_cols, sizeof(uint32_t) * csr.csr_nnz, 1, f);
+        fwrite(csr.csr_values, sizeof(float) * csr.csr_nnz, 1, f);
+    }
+
+    if (is_temporary != 0)
+    {
+        csr_free(&csr);
+    }
+
+    // Записываем входные и выходные сигналы и функции активации активных слоев.
+    fwrite(_perceptron->ins, sizeof(float) * _perceptron->topology[0], 1, f);
+    fwrite(_perceptron->outs, sizeof(float) * _perceptron->topology[_perceptron->layers_count - 1], 1, f);
+    fwrite(&_perceptron->activations[1], sizeof(size_t) * (_perceptron->layers_count - 1), 1, f);
+
+    // Контроль успешности записи.
+    if (ferror(f) != 0)
+    {
+        fclose(f);
+        return -6;
+    }
+
+    if (fclose(f) != 0)
+    {
+        return -7;
+    }
+
+    return 1;
+}
+
+// Загружает перцептрон из файла в разреженном (CSR) платформозависимом формате,
+// созданного c_perceptron_save_sparse().
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_load_sparse(const char *const _file_name,
+                                       size_t *const _error)
+{
+    return c_perceptron_load_sparse_ex(_file_name, NULL, _error);
+}
+
+// Загружает перцептрон из файла в разреженном (CSR) платформозависимом формате.
+// Если _compact != 0, загружается компактный перцептрон (см. c_perceptron_clone_compact()).
+static c_perceptron *perceptron_load_sparse(const char *const _file_name,
+                                            const c_allocator *const _allocator,
+                                            const int _compact,
+                                            size_t *const _error)
+{
+    const c_allocator *const allocator = allocator_resolve(_allocator);
+    if (allocator == NULL)
+    {
+        error_set(_error, 14);
+        return NULL;
+    }
+    if (_file_name == NULL)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    if (strlen(_file_name) == 0)
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+
+    FILE *f = fopen(_file_name, "rb");
+
+    // Контроль успешности открытия.
+    if (f == NULL)
+    {
+        error_set(_error, 3);
+        return NULL;
+    }
+
+    // Считываем количество слоев.
+    size_t new_layers_count;
+    if (fread(&new_layers_count, sizeof(size_t), 1, f) != 1)
+    {
+        fclose(f);
+        error_set(_error, 4);
+        return NULL;
+    }
+
+    // Проверяем число слоев на валидность.
+    // Контроль целочисленного переполнения при умножении.
+    const size_t new_topology_size = sizeof(size_t) * new_layers_count;
+    if ( (new_layers_count < 2) ||
+         (new_topology_size / sizeof(size_t) != new_layers_count) )
+    {
+        fclose(f);
+        error_set(_error, 5);
+        return NULL;
+    }
+
+    // Считываем топологию.
+    size_t *const new_topology = mem_alloc(allocator, new_topology_size);
+    if (new_topology == NULL)
+    {
+        fclose(f);
+        error_set(_error, 6);
+        return NULL;
+    }
+    if (fread(new_topology, new_topology_size, 1, f) != 1)
+    {
+        mem_free(allocator, new_topology, new_topology_size);
+        fclose(f);
+        error_set(_error, 7);
+        return NULL;
+    }
+
+    // Создаем перцептрон, его конструктор проверяет топологию.
+    c_perceptron *const new_perceptron = perceptron_create(new_layers_count, new_topology, allocator,
+                                                           _compact == 0, NULL);
+    mem_free(allocator, new_topology, new_topology_size);
+    if (new_perceptron == NULL)
+    {
+        fclose(f);
+        error_set(_error, 8);
+        return NULL;
+    }
+
+    // Считываем количество весов и количество ненулевых весов.
+    size_t new_weights_count;
+    size_t new_nnz;
+    if ( (fread(&new_weights_count, sizeof(size_t), 1, f) != 1) ||
+         (fread(&new_nnz, sizeof(size_t), 1, f) != 1) )
+    {
+        c_perceptron_delete(new_perceptron);
+        fclose(f);
+        error_set(_error, 9);
+        return NULL;
+    }
+    if ( (new_weights_count != new_perceptron->weights_count) ||
+         (new_nnz > new_weights_count) )
+    {
+        c_perceptron_delete(new_perceptron);
+        fclose(f);
+        error_set(_error, 10);
+        return NULL;
+    }
+
+    // CSR считывается прямо в перцептрон.
+    if (csr_alloc(new_perceptron, new_nnz) == 0)
+    {
+        c_perceptron_delete(new_perceptron);
+        fclose(f);
+        error_set(_error, 11);
+        return NULL;
+    }
+    const size_t *const rows = new_perceptron->csr_rows;
+    const uint32_t *const cols = new_perceptron->csr_cols;
+
+    // Считываем CSR, входные и выходные сигналы.
+    if ( (fread(new_perceptron->csr_rows, sizeof(size_t) * new_perceptron->csr_rows_count, 1, f) != 1) ||
+         ( (new_nnz > 0) && (fread(new_perceptron->csr_cols, sizeof(uint32_t) * new_nnz, 1, f) != 1) ) ||
+         ( (new_nnz > 0) && (fread(new_perceptron->csr_values, sizeof(float) * new_nnz, 1, f) != 1) ) ||
+         (fread(new_perceptron->ins, sizeof(float) * new_perceptron->topology[0], 1, f) != 1) ||
+         (fread(new_perceptron->outs, sizeof(float) * new_perceptron->topology[new_layers_count - 1], 1, f) != 1) ||
+         (activations_read(new_perceptron, f) == 0) )
+    {
+        c_perceptron_delete(new_perceptron);
+        fclose(f);
+        error_set(_error, 12);
+        return NULL;
+    }
+
+    fclose(f);
+
+    // Контроль корректности CSR.
+    const size_t neurons_count = new_perceptron->csr_rows_count - 1;
+    int is_valid = (rows[0] == 0) && (rows[neurons_count] == new_nnz);
+    size_t r = 0;
+    for (size_t l = 1; (l < new_layers_count) && (is_valid != 0); ++l)
+    {
+        for (size_t cn = 0; (cn < new_perceptron->topology[l]) && (is_valid != 0); ++cn, ++r)
+        {
+            if ( (rows[r] > rows[r + 1]) ||
+                 (rows[r + 1] > new_nnz) )
+            {
+                is_valid = 0;
+                break;
+            }
+            // Номера входов в строке должны строго возрастать.
+            for (size_t k = rows[r]; k < rows[r + 1]; ++k)
+            {
+                if ( (cols[k] >= new_perceptron->topology[l - 1]) ||
+                     ( (k > rows[r]) && (cols[k] <= cols[k - 1]) ) )
+                {
+                    is_valid = 0;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (is_valid == 0)
+    {
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 13);
+        return NULL;
+    }
+
+    if (_compact != 0)
+    {
+        new_perceptron->csr_state = CSR_READY;
+    } else {
+        // Восстанавливаем плотные веса, CSR будет построено заново при выполнении.
+        weights_expand(new_perceptron, new_perceptron->weights);
+        weights_changed(new_perceptron);
+    }
+
+    return new_perceptron;
+}
+
+// Загружает перцептрон из файла в разреженном (CSR) платформозависимом формате,
+// память под перцептрон выделяется заданным распределителем.
+// Если _allocator == NULL, используется распределитель по умолчанию (malloc()/free()).
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_perceptron *c_perceptron_load_sparse_ex(const char *const _file_name,
+                                          const c_allocator *const _allocator,
+                                          size_t *const _error)
+{
+    return perceptron_load_sparse(_file_name, _allocator, 0, _error);
+}
+
+// Загружает компактный перцептрон (см. c_perceptron_clone_compact()) из файла, созданного
+// c_perceptron_save_sparse(), без промежуточных плотных весов: занимаемая весами память
+// пропорциональна количеству ненулевых весов.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0), коды совпадают с кодами c_perceptron_load_sparse().
+c_perceptron *c_perceptron_load_compact(const char *const _file_name,
+                                        size_t *const _error)
+{
+    return c_perceptron_load_compact_ex(_file_name, NULL, _error);
+}
+
+// Загружает компактный перцептрон, память под перцептрон выделяется заданным распределителем.
+// Если _allocator == NULL, используется распределитель по умолчанию (malloc()/free()).
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0), коды совпадают с кодами c_perceptron_load_sparse().
+c_perceptron *c_perceptron_load_compact_ex(const char *const _file_name,
+                                           const c_allocator *const _allocator,
+                                           size_t *const _error)
+{
+    return perceptron_load_sparse(_file_name, _allocator, 1, _error);
+}
+
+// Проверяет, является ли строка допустимым идентификатором языка C.
+static int is_c_identifier(const char *const _name)
+{
+    if ( (_name == NULL) ||
+         (_name[0] == '\0') )
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; _name[i] != '\0'; ++i)
+    {
+        const char c = _name[i];
+        const int is_alpha = ( (c >= 'a') && (c <= 'z') ) ||
+                             ( (c >= 'A') && (c <= 'Z') ) ||
+                             (c == '_');
+        const int is_digit = (c >= '0') && (c <= '9');
+        if ( (is_alpha == 0) &&
+             ( (is_digit == 0) || (i == 0) ) )
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Генерирует самостоятельный исходный код на C, который выполняет то же, что и c_perceptron_execute()
+// для заданного перцептрона, в виде функции void _function_name(const float *_ins, float *_outs).
+// Веса помещаются в выровненные static const массивы, размеры всех циклов известны на этапе компиляции,
+// поэтому компилятор может полностью развернуть и векторизовать их. Куча и загрузчик не нужны.
+// Порядок вычислений совпадает с c_perceptron_execute(), поэтому результаты совпадают побитово
+// (если сгенерированный код не компилируется с -ffast-math и подобными флагами).
+// Если файл с заданным именем существует, то он перезаписывается.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_perceptron_codegen(const c_perceptron *const _perceptron,
+                               const char *const _file_name,
+                               const char *const _function_name)
+{
+    if (_perceptron == NULL)
+    {
+        return -1;
+    }
+    if (_file_name == NULL)
+    {
+        return -2;
+    }
+    if (strlen(_file_name) == 0)
+    {
+        return -3;
+    }
+    if (is_c_identifier(_function_name) == 0)
+    {
+        return -4;
+    }
+
+    // Точно представить в исходном коде можно только конечные веса.
+    const float *const weights = (_perceptron->weights != NULL) ? _perceptron->weights : _perceptron->csr_values;
+    const size_t weights_count = (_perceptron->weights != NULL) ? _perceptron->weights_count : _perceptron->csr_nnz;
+    for (size_t w = 0; w < weights_count; ++w)
+    {
+        if (isfinite(weights[w]) == 0)
+        {
+            return -5;
+        }
+    }
+
+    // Веса компактного перцептрона восстанавливаются из CSR по одному нейрону.
+    size_t row_size;
+    float *const row = weights_row_alloc(_perceptron, &row_size);
+    if ( (_perceptron->weights == NULL) &&
+         (row == NULL) )
+    {
+        return -9;
+    }
+
+    FILE *f = fopen(_file_name, "w");
+
+    // Контроль успешности открытия.
+    if (f == NULL)
+    {
+        mem_free(&_perceptron->block->allocator, row, row_size);
+        return -6;
+    }
+
+    fprintf(f, "// Сгенерировано c_perceptron_codegen().\n");
+    fprintf(f, "// Топология:");
+    for (size_t l = 0; l < _perceptron->layers_count; ++l)
+    {
+        fprintf(f, " %zu", _perceptron->topology[l]);
+    }
+    fprintf(f, ".\n// Функции активации (C_ACTIVATION_*):");
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
+    {
+        fprintf(f, " %zu", _perceptron->activations[l]);
+    }
+    fprintf(f, ".\n\n#include <stddef.h>\n#include <math.h>\n\n");
+
+    // Веса каждого слоя записываются отдельным массивом [нейрон][вход].
+    // Используется шестнадцатеричная запись, чтобы веса переносились без потери точности.
+    size_t w = 0;
+    size_t r = 0;
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
+    {
+        const size_t pn_count = _perceptron->topology[l - 1];
+        fprintf(f, "static _Alignas(64) const float %s_w_%zu[%zu][%zu] =\n{\n",
+                _function_name, l, _perceptron->topology[l], pn_count);
+        for (size_t cn = 0; cn < _perceptron->topology[l]; ++cn, ++r, w += pn_count)
+        {
+            const float *const n_weights = weights_row(_perceptron, w, r, pn_count, row);
+            fprintf(f, "    {");
+            for (size_t pn = 0; pn < pn_count; ++pn)
+            {
+                fprintf(f, "%s%af", (pn == 0) ? "" : ", ", n_weights[pn]);
+            }
+            fprintf(f, "},\n");
+        }
+        fprintf(f, "};\n\n");
+    }
+    mem_free(&_perceptron->block->allocator, row, row_size);
+
+    fprintf(f, "void %s(const float *const _ins,\n", _function_name);
+    fprintf(f, "%*s float *const _outs)\n{\n", (int)(strlen(_function_name) + 5), "");
+
+    // Промежуточные слои хранятся на стеке, последний слой пишется сразу в _outs.
+    for (size_t l = 1; l < _perceptron->layers_count - 1; ++l)
+    {
+        fprintf(f, "    float l_%zu[%zu];\n", l, _perceptron->topology[l]);
+    }
+
+    for (size_t l = 1; l < _perceptron->layers_count; ++l)
+    {
+        char h_ins[32];
+        char h_outs[32];
+        if (l == 1)
+        {
+            snprintf(h_ins, sizeof(h_ins), "_ins");
+        } else {
+            snprintf(h_ins, sizeof(h_ins), "l_%zu", l - 1);
+        }
+        if (l == _perceptron->layers_count - 1)
+        {
+            snprintf(h_outs, sizeof(h_outs), "_outs");
+        } else {
+            snprintf(h_outs, sizeof(h_outs), "l_%zu", l);
+        }
+
+        fprintf(f, "\n    for (size_t cn = 0; cn < %zu; ++cn)\n    {\n", _perceptron->topology[l]);
+        fprintf(f, "        float sum = 0;\n");
+        fprintf(f, "        for (size_t pn = 0; pn < %zu; ++pn)\n        {\n", _perceptron->topology[l - 1]);
+        fprintf(f, "            sum += %s[pn] * %s_w_%zu[cn][pn];\n", h_ins, _function_name, l);
+        fprintf(f, "        }\n");
+        // Выражения повторяют activation_apply(), в том числе для NaN.
+        switch (_perceptron->activations[l])
+        {
+            case C_ACTIVATION_TANH:
+                fprintf(f, "        %s[cn] = tanh(sum);\n", h_outs);
+                break;
+            case C_ACTIVATION_RELU:
+                fprintf(f, "        %s[cn] = (sum > 0) ? sum : 0;\n", h_outs);
+                break;
+            case C_ACTIVATION_LEAKY_RELU:
+                fprintf(f, "        %s[cn] = (sum > 0) ? sum : %af * sum;\n", h_outs, C_LEAKY_RELU_SLOPE);
+                break;
+            case C_ACTIVATION_HARD_SIGMOID:
+                fprintf(f, "        const float h = %af * sum + 0.5f;\n", C_HARD_SIGMOID_SLOPE);
+                fprintf(f, "        %s[cn] = (h > 0) ? ((h < 1) ? h : 1) : 0;\n", h_outs);
+                break;
+            default:
+                fprintf(f, "        %s[cn] = 1 / (1 + exp(-sum));\n", h_outs);
+                break;
+        }
+        fprintf(f, "    }\n");
+    }
+
+    fprintf(f, "}\n");
+
+    // Контроль успешности записи.
+    if (ferror(f) != 0)
+    {
+        fclose(f);
+        return -7;
+    }
+
+    if (fclose(f) != 0)
+    {
+        return -8;
+    }
+
+    return 1;
+}
+
+// Начинает чтение опубликованной модели.
+// Возвращает эпоху, которую необходимо передать в published_leave().
+static size_t published_enter(c_published *const _published)
+{
+    for (;;)
+    {
+        const size_t epoch = atomic_load(&_published->epoch);
+        atomic_fetch_add(&_published->readers[epoch & 1], 1);
+        // Если эпоха успела смениться, писатель мог не заметить нас.
+        if (atomic_load(&_published->epoch) == epoch)
+        {
+            return epoch;
+        }
+        atomic_fetch_sub(&_published->readers[epoch & 1], 1);
+    }
+}
+
+// Заканчивает чтение опубликованной модели.
+static void published_leave(c_published *const _published,
+                            const size_t _epoch)
+{
+    atomic_fetch_sub(&_published->readers[_epoch & 1], 1);
+}
+
+// Публикует новую версию модели с заданными весами.
+// Если задан компактный перцептрон _perceptron, новой версией становится его компактный клон.
+// Читатели не блокируются, писатель дожидается окончания чтений старой версии и удаляет ее.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0, опубликованная версия не меняется.
+static ptrdiff_t published_publish_weights(c_published *const _published,
+                                           const c_perceptron *const _perceptron,
+                                           const float *const _weights)
+{
+    // Писатели публикуют версии по очереди.
+    while (atomic_flag_test_and_set(&_published->writer_lock) != 0)
+    {
+        thread_yield();
+    }
+
+    c_perceptron *const current = atomic_load(&_published->current);
+
+    // Новая версия собирается в стороне от читателей.
+    const int compact = (_perceptron != NULL) && (_perceptron->weights == NULL);
+    c_perceptron *const next = c_perceptron_clone_ex((compact != 0) ? _perceptron : current,
+                                                     &_published->allocator, NULL);
+    if (next == NULL)
+    {
+        atomic_flag_clear(&_published->writer_lock);
+        return -1;
+    }
+    if (compact == 0)
+    {
+        // Клон компактной версии получает плотные веса.
+        if (weights_densify(next) < 0)
+        {
+            c_perceptron_delete(next);
+            atomic_flag_clear(&_published->writer_lock);
+            return -1;
+        }
+        memcpy(next->weights, _weights, sizeof(float) * next->weights_count);
+        weights_changed(next);
+    }
+    // Решение о разреженном выполнении принимается заранее, чтобы читатели не меняли версию.
+    csr_update(next);
+
+    atomic_store(&_published->current, next);
+    atomic_fetch_add(&_published->version, 1);
+
+    // Сменяем эпоху и дожидаемся читателей прошлой эпохи, только они могли получить старую версию.
+    const size_t epoch = atomic_fetch_add(&_published->epoch, 1);
+    while (atomic_load(&_published->readers[epoch & 1]) != 0)
+    {
+        thread_yield();
+    }
+
+    c_perceptron_delete(current);
+
+    atomic_flag_clear(&_published->writer_lock);
+
+    return 1;
+}
+
+// Создает опубликованную модель, первая версия которой - копия заданного перцептрона.
+// Память выделяется распределителем перцептрона.
+// В случае ошибки возвращает NULL, и если _error != NULL,
+// в заданное расположение помещается код причины ошибки (> 0).
+c_published *c_published_create(const c_perceptron *const _perceptron,
+                                size_t *const _error)
+{
+    if (_perceptron == NULL)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+
+    const c_allocator *const allocator = &_perceptron->block->allocator;
+
+    // Определим, сколько памяти нужно под опубликованную модель вместе с топологией и функциями активации.
+    // Контроль целочисленного переполнения не нужен, так как
+    // он выполняется на этапе конструирования перцептрона.
+    const size_t o_topology = align_up(sizeof(c_published), _Alignof(size_t));
+    const size_t o_activations = o_topology + sizeof(size_t) * _perceptron->layers_count;
+    const size_t new_size = o_activations + sizeof(size_t) * _perceptron->layers_count;
+
+    // Пытаемся выделить память под опубликованную модель.
+    c_published *const new_published = mem_alloc(allocator, new_size);
+    // Контроль успешности выделения памяти.
+    if (new_published == NULL)
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+
+    // Пытаемся создать первую версию.
+    c_perceptron *const first = c_perceptron_clone_ex(_perceptron, allocator, NULL);
+    // Контроль успешности создания.
+    if (first == NULL)
+    {
+        mem_free(allocator, new_published, new_size);
+        error_set(_error, 3);
+        return NULL;
+    }
+    csr_update(first);
+
+    // Собираем опубликованную модель.
+    atomic_init(&new_published->current, first);
+    atomic_init(&new_published->version, 1);
+    atomic_init(&new_published->epoch, 0);
+    atomic_init(&new_published->readers[0], 0);
+    atomic_init(&new_published->readers[1], 0);
+    atomic_flag_clear(&new_published->writer_lock);
+    new_published->layers_count = _perceptron->layers_count;
+    new_published->topology = (size_t*)((char*)new_published + o_topology);
+    memcpy(new_published->topology, _perceptron->topology, sizeof(size_t) * _perceptron->layers_count);
+    new_published->activations = (size_t*)((char*)new_published + o_activations);
+    memcpy(new_published->activations, _perceptron->activations, sizeof(size_t) * _perceptron->layers_count);
+    new_published->size = new_size;
+    new_published->allocator = *allocator;
+
+    return new_published;
+}
+
+// Удаляет опубликованную модель.
+// К этому моменту не должно быть читателей и писателей модели,
+// а также селекционеров, публикующих в нее (см. c_pgs_set_published()).
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_published_delete(c_published *const _published)
+{
+    if (_published == NULL)
+    {
+        return -1;
+    }
+
+    c_perceptron_delete(atomic_load(&_published->current));
+
+    // Распределитель копируется, так как он хранится в освобождаемой памяти.
+    const c_allocator allocator = _published->allocator;
+    mem_free(&allocator, _published, _published->size);
+
+    return 1;
+}
+
+// Публикует веса заданного перцептрона как новую версию модели.
+// Топология и функции активации перцептрона должны совпадать с топологией и функциями активации модели.
+// Может вызываться одновременно с чтением модели из других потоков, читатели не блокируются.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_published_publish(c_published *const _published,
+                              const c_perceptron *const _perceptron)
+{
+    if (_published == NULL)
+    {
+        return -1;
+    }
+    if (_perceptron == NULL)
+    {
+        return -2;
+    }
+
+    if (_published->layers_count != _perceptron->layers_count)
+    {
+        return -3;
+    }
+    for (size_t l = 0; l < _published->layers_count; ++l)
+    {
+        if ( (_published->topology[l] != _perceptron->topology[l]) ||
+             (_published->activations[l] != _perceptron->activations[l]) )
+        {
+            return -4;
+        }
+    }
+
+    if (published_publish_weights(_published, _perceptron, _perceptron->weights) < 0)
+    {
+        return -5;
+    }
+
+    return 1;
+}
+
+// Возвращает номер текущей версии модели (первая версия - 1).
+// В случае, если _published == NULL, возвращает 0.
+size_t c_published_get_version(c_published *const _published)
+{
+    if (_published == NULL)
+    {
+        return 0;
+    }
+
+    return atomic_load(&_published->version);
+}
+
+// Пропускает сигнал через текущую версию модели, см. c_perceptron_execute_io().
+// Может вызываться из любого количества потоков одновременно с публикацией новых версий.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_published_execute_io(c_published *const _published,
+                                 const float *const _in,
+                                 const size_t _in_stride,
+                                 float *const _out)
+{
+    if (_published == NULL)
+    {
+        return -1;
+    }
+    if (_in == NULL)
+    {
+        return -2;
+    }
+    if (_in_stride == 0)
+    {
+        return -3;
+    }
+    if (_out == NULL)
+    {
+        return -4;
+    }
+
+    const size_t epoch = published_enter(_published);
+
+    // Версия не меняется после публикации, решение о CSR принято заранее.
+    const c_perceptron *const current = atomic_load(&_published->current);
+    forward(current, current->weights, current->csr_state == CSR_READY, _in, _in_stride, _out, NULL);
+
+    published_leave(_published, epoch);
+
+    return 1;
+}
+
+// --------------------
+
+// Количество членов ансамбля, суммы которых накапливаются одновременно.
+#define ENSEMBLE_LANES 8
+
+// Наибольшая вспомогательная память выполнения ансамбля (в сигналах), которая размещается в стеке.
+#define ENSEMBLE_STACK_SCRATCH 1024
+
+// Ансамбль перцептронов одной топологии с одинаковыми функциями активации.
+// Веса членов ансамбля чередуются: для каждого слоя и каждой пары (нейрон, вход) подряд идут веса
+// всех членов, поэтому одинаковые слои всех членов вычисляются как один широкий слой, внутренний
+// цикл которого идет по членам ансамбля. Активации хранятся так же: значение нейрона n члена m - [n * M + m].
+// Ансамбль вместе с топологией и весами располагается в одном блоке памяти.
+struct s_c_ensemble
+{
+    size_t members_count;
+    size_t layers_count;
+    size_t *topology;
+    size_t *activations;
+
+    size_t weights_count;// Весов одного члена.
+    float *weights;// weights_count * members_count чередующихся весов.
+
+    size_t h_buffer_count;// Нейронов в самом "жирном" активном слое.
+    size_t scratch_count;// Сигналов во вспомогательной памяти одного выполнения.
+
+    size_t size;
+    c_allocator allocator;
+};
+
+// Копирует веса перцептрона в члена ансамбля _m.
+// Веса компактного перцептрона восстанавливаются из CSR.
+static void ensemble_member_set(c_ensemble *const _ensemble,
+                                const size_t _m,
+                                const c_perceptron *const _perceptron)
+{
+    const size_t members_count = _ensemble->members_count;
+    if (_perceptron->weights == NULL)
+    {
+        for (size_t w = 0; w < _ensemble->weights_count; ++w)
+        {
+            _ensemble->weights[w * members_count + _m] = 0.f;
+        }
+    }
+
+    size_t w = 0;
+    size_t r = 0;
+    for (size_t l = 1; l < _ensemble->layers_count; ++l)
+    {
+        const size_t pn_count = _ensemble->topology[l - 1];
+        const size_t count = pn_count * _ensemble->topology[l];
+        float *const weights = &_ensemble->weights[w * members_count];
+        if (_perceptron->weights != NULL)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                weights[i * members_count + _m] = _perceptron->weights[w + i];
+            }
+        } else {
+            for (size_t cn = 0; cn < _ensemble->topology[l]; ++cn, ++r)
+            {
+                for (size_t k = _perceptron->csr_rows[r]; k < _perceptron->csr_rows[r + 1]; ++k)
+                {
+                    weights[(cn * pn_count + _perceptron->csr_cols[k]) * members_count + _m] = _perceptron->csr_values[k];
+                }
+            }
+        }
+        w += count;
+    }
+}
+
+// Проверяет, совпадают ли топология и функции активации перцептрона с топологией и функциями активации ансамбля.
+static int ensemble_compatible(const c_ensemble *const _ensemble,
+                               const c_perceptron *const _perceptron)
+{
+    if (_perceptron->layers_count != _ensemble->layers_count)
+    {
+        return 0;
+    }
+    return (memcmp(_perceptron->topology, _ensemble->topology, sizeof(size_t) * _ensemble->layers_count) == 0) &&
+           (memcmp(_perceptron->activations, _ensemble->activations, sizeof(size_t) * _ensemble->layers_count) == 0);
+}
+
+// Создает ансамбль из _members_count (> 0) перцептронов одинаковой топологии
+// и с одинаковыми функциями активации, копируя их веса.
+// Память выделяется распределителем первого перцептрона.
+// В случае ошибки возвращает NULL, и если _error != NULL,
+// в заданное расположение помещается код причины ошибки (> 0).
+c_ensemble *c_ensemble_create(const c_perceptron *const *const _members,
+                              const size_t _members_count,
+                              size_t *const _error)
+{
+    if ( (_members == NULL) ||
+         (_members_count == 0) )
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    for (size_t m = 0; m < _members_count; ++m)
+    {
+        if (_members[m] == NULL)
+        {
+            error_set(_error, 1);
+            return NULL;
+        }
+        // Топологии и функции активации всех членов должны совпадать.
+        if ( (_members[m]->layers_count != _members[0]->layers_count) ||
+             (memcmp(_members[m]->topology, _members[0]->topology, sizeof(size_t) * _members[0]->layers_count) != 0) ||
+             (memcmp(_members[m]->activations, _members[0]->activations, sizeof(size_t) * _members[0]->layers_count) != 0) )
+        {
+            error_set(_error, 2);
+            return NULL;
+        }
+    }
+
+    const c_perceptron *const first = _members[0];
+
+    // Определим расположение частей ансамбля в блоке памяти: ансамбль, топология, функции активации, веса.
+    // Контроль целочисленного переполнения для размеров топологии и весов одного члена не нужен, так как
+    // он выполняется на этапе конструирования перцептрона.
+    const size_t o_topology = align_up(sizeof(c_ensemble), _Alignof(size_t));
+    const size_t o_activations = o_topology + sizeof(size_t) * first->layers_count;
+    const size_t o_weights = align_up(o_activations + sizeof(size_t) * first->layers_count, WEIGHTS_ALIGN);
+    // Контроль целочисленного переполнения.
+    if ( (o_weights == 0) ||
+         (first->weights_count > (SIZE_MAX - o_weights) / sizeof(float) / _members_count) )
+    {
+        error_set(_error, 3);
+        return NULL;
+    }
+    const size_t new_size = o_weights + sizeof(float) * first->weights_count * _members_count;
+
+    // Определяем, сколько нейронов имеется в самом "жирном" активном слое.
+    size_t h_buffer_count = 0;
+    for (size_t l = 1; l < first->layers_count; ++l)
+    {
+        if (first->topology[l] > h_buffer_count)
+        {
+            h_buffer_count = first->topology[l];
+        }
+    }
+    // Вспомогательная память выполнения: два буфера чередующихся активаций.
+    if (h_buffer_count > SIZE_MAX / sizeof(float) / 2 / _members_count)
+    {
+        error_set(_error, 3);
+        return NULL;
+    }
+
+    const c_allocator *const allocator = &first->block->allocator;
+    char *const h = mem_alloc(allocator, new_size);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+        error_set(_error, 4);
+        return NULL;
+    }
+
+    // Собираем ансамбль.
+    c_ensemble *const new_ensemble = (c_ensemble*)h;
+    new_ensemble->members_count = _members_count;
+    new_ensemble->layers_count = first->layers_count;
+    new_ensemble->topology = (size_t*)(h + o_topology);
+    memcpy(new_ensemble->topology, first->topology, sizeof(size_t) * first->layers_count);
+    new_ensemble->activations = (size_t*)(h + o_activations);
+    memcpy(new_ensemble->activations, first->activations, sizeof(size_t) * first->layers_count);
+    new_ensemble->weights_count = first->weights_count;
+    new_ensemble->weights = (float*)(h + o_weights);
+    new_ensemble->h_buffer_count = h_buffer_count;
+    new_ensemble->scratch_count = 2 * h_buffer_count * _members_count;
+    new_ensemble->size = new_size;
+    new_ensemble->allocator = *allocator;
+
+    for (size_t m = 0; m < _members_count; ++m)
+    {
+        ensemble_member_set(new_ensemble, m, _members[m]);
+    }
+
+    return new_ensemble;
+}
+
+// Удаляет ансамбль.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_ensemble_delete(c_ensemble *const _ensemble)
+{
+    if (_ensemble == NULL)
+    {
+        return -1;
+    }
+
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _ensemble->allocator;
+    mem_free(&allocator, _ensemble, _ensemble->size);
+
+    return 1;
+}
+
+// Заменяет веса члена ансамбля _member весами перцептрона той же топологии.
+// Нельзя вызывать одновременно с выполнением ансамбля.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_ensemble_set_member(c_ensemble *const _ensemble,
+                                const size_t _member,
+                                const c_perceptron *const _perceptron)
+{
+    if (_ensemble == NULL)
+    {
+        return -1;
+    }
+    if (_member >= _ensemble->members_count)
+    {
+        return -2;
+    }
+    if (_perceptron == NULL)
+    {
+        return -3;
+    }
+    if (ensemble_compatible(_ensemble, _perceptron) == 0)
+    {
+        return -4;
+    }
+
+    ensemble_member_set(_ensemble, _member, _perceptron);
+
+    return 1;
+}
+
+size_t c_ensemble_get_members_count(const c_ensemble *const _ensemble)
+{
+    if (_ensemble == NULL)
+    {
+        return 0;
+    }
+
+    return _ensemble->members_count;
+}
+
+// Пропускает сигнал через все члены ансамбля и сводит их выходы в _out.
+// Входные сигналы читаются один раз из _in (с шагом _in_stride), первый слой всех членов вычисляется
+// одним проходом по входам, следующие слои - одним проходом по чередующимся весам.
+// Выход каждого члена побитово совпадает с c_perceptron_execute() его перцептрона (в плотном режиме).
+// Сведение _reduction:
+// - C_ENSEMBLE_MEAN - _out[k] - среднее k-го выхода членов (outs_count значений);
+// - C_ENSEMBLE_VOTE - каждый член голосует за свой наибольший выход (при равенстве - за меньший номер),
+//   _out[k] - доля голосов за k-й выход (outs_count значений);
+// - C_ENSEMBLE_ALL - _out[m * outs_count + k] - k-й выход члена m (members_count * outs_count значений).
+// Вспомогательная память размещается в стеке, если она не больше ENSEMBLE_STACK_SCRATCH сигналов,
+// иначе выделяется на время вызова распределителем ансамбля.
+// Может вызываться из любого количества потоков одновременно.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_ensemble_execute_io(const c_ensemble *const _ensemble,
+                                const float *const _in,
+                                const size_t _in_stride,
+                                const size_t _reduction,
+                                float *const _out)
+{
+    if (_ensemble == NULL)
+    {
+        return -1;
+    }
+    if (_in == NULL)
+    {
+        return -2;
+    }
+    if (_in_stride == 0)
+    {
+        return -3;
+    }
+    if (_reduction > C_ENSEMBLE_ALL)
+    {
+        return -4;
+    }
+    if (_out == NULL)
+    {
+        return -5;
+    }
+
+    const size_t members_count = _ensemble->members_count;
+    const size_t outs_count = _ensemble->topology[_ensemble->layers_count - 1];
+
+    // Вспомогательная память пропорциональна количеству членов: большая выделяется распределителем.
+    float stack_scratch[ENSEMBLE_STACK_SCRATCH];
+    float *scratch = stack_scratch;
+    if (_ensemble->scratch_count > ENSEMBLE_STACK_SCRATCH)
+    {
+        scratch = mem_alloc(&_ensemble->allocator, sizeof(float) * _ensemble->scratch_count);
+        if (scratch == NULL)
+        {
+            return -6;
+        }
+    }
+
+    // Вспомогательные буфера чередующихся активаций.
+    float *const a = scratch;
+    float *const b = &a[_ensemble->h_buffer_count * members_count];
+
+    // Вход первого слоя общий для всех членов и не чередуется: сигнал входа pn - _in[pn * _in_stride].
+    const float *h_ins = _in;
+    float *h_outs = a;
+    size_t w = 0;
+    for (size_t l = 1; l < _ensemble->layers_count; ++l)
+    {
+        const size_t pn_count = _ensemble->topology[l - 1];
+        const size_t cn_count = _ensemble->topology[l];
+
+        for (size_t cn = 0; cn < cn_count; ++cn)
+        {
+            const float *const weights = &_ensemble->weights[(w + cn * pn_count) * members_count];
+            float *const sums = &h_outs[cn * members_count];
+            // Члены обрабатываются группами по ENSEMBLE_LANES: суммы группы живут в регистрах,
+            // а внутренний цикл постоянной длины векторизуется компилятором.
+            size_t m0 = 0;
+            for (; m0 + ENSEMBLE_LANES <= members_count; m0 += ENSEMBLE_LANES)
+            {
+                float acc[ENSEMBLE_LANES] = {0};
+                if (l == 1)
+                {
+                    // Сигнал входа читается один раз и умножается на веса всех членов группы.
+                    for (size_t pn = 0; pn < pn_count; ++pn)
+                    {
+                        const float in = h_ins[pn * _in_stride];
+                        const float *const pn_weights = &weights[pn * members_count + m0];
+                        for (size_t m = 0; m < ENSEMBLE_LANES; ++m)
+                        {
+                            acc[m] += in * pn_weights[m];
+                        }
+                    }
+                } else {
+                    for (size_t pn = 0; pn < pn_count; ++pn)
+                    {
+                        const float *const ins = &h_ins[pn * members_count + m0];
+                        const float *const pn_weights = &weights[pn * members_count + m0];
+                        for (size_t m = 0; m < ENSEMBLE_LANES; ++m)
+                        {
+                            acc[m] += ins[m] * pn_weights[m];
+                        }
+                    }
+                }
+                for (size_t m = 0; m < ENSEMBLE_LANES; ++m)
+                {
+                    sums[m0 + m] = acc[m];
+                }
+            }
+            // Оставшиеся члены.
+            for (size_t m = m0; m < members_count; ++m)
+            {
+                float sum = 0;
+                for (size_t pn = 0; pn < pn_count; ++pn)
+                {
+                    const float in = (l == 1) ? h_ins[pn * _in_stride] : h_ins[pn * members_count + m];
+                    sum += in * weights[pn * members_count + m];
+                }
+                sums[m] = sum;
+            }
+        }
+        activation_apply(_ensemble->activations[l], h_outs, cn_count * members_count);
+
+        w += pn_count * cn_count;
+
+        h_ins = h_outs;
+        h_outs = (h_outs == a) ? b : a;
+    }
+
+    // h_ins - выходы последнего слоя всех членов.
+    switch (_reduction)
+    {
+        case C_ENSEMBLE_MEAN:
+            for (size_t k = 0; k < outs_count; ++k)
+            {
+                float sum = 0;
+                for (size_t m = 0; m < members_count; ++m)
+                {
+                    sum += h_ins[k * members_count + m];
+                }
+                _out[k] = sum / (float)members_count;
+            }
+            break;
+        case C_ENSEMBLE_VOTE:
+            for (size_t k = 0; k < outs_count; ++k)
+            {
+                _out[k] = 0;
+            }
+            for (size_t m = 0; m < members_count; ++m)
+            {
+                size_t best = 0;
+                for (size_t k = 1; k < outs_count; ++k)
+                {
+                    if (h_ins[k * members_count + m] > h_ins[best * members_count + m])
+                    {
+                        best = k;
+                    }
+                }
+                _out[best] += 1.f;
+            }
+            for (size_t k = 0; k < outs_count; ++k)
+            {
+                _out[k] /= (float)members_count;
+            }
+            break;
+        default:
+            for (size_t m = 0; m < members_count; ++m)
+            {
+                for (size_t k = 0; k < outs_count; ++k)
+                {
+                    _out[m * outs_count + k] = h_ins[k * members_count + m];
+                }
+            }
+            break;
+    }
+
+    if (scratch != stack_scratch)
+    {
+        mem_free(&_ensemble->allocator, scratch, sizeof(float) * _ensemble->scratch_count);
+    }
+
+    return 1;
+}
+
+// --------------------
+
+// Конвейер и разделяемая память доступны только с POSIX, см. C_PERCEPTRON_POSIX.
+#ifdef C_PERCEPTRON_POSIX
+
+// Очередь одного производителя и одного потребителя между соседними стадиями конвейера.
+// Ячейка хранит активации слоя для мини-пакета строк.
+typedef struct s_c_spsc
+{
+    _Alignas(BLOCK_ALIGN) atomic_size_t head;// Номер следующей записываемой ячейки (пишет производитель).
+    _Alignas(BLOCK_ALIGN) atomic_size_t tail;// Номер следующей читаемой ячейки (пишет потребитель).
+    size_t width;// Количество сигналов в строке.
+    float *data;// depth ячеек по batch_rows * width сигналов.
+    size_t *rows;// Количество строк в каждой ячейке.
+    _Alignas(BLOCK_ALIGN) atomic_size_t waiters;// Количество потоков, уснувших в ожидании этой очереди.
+    pthread_cond_t wake;// Будит уснувших при изменении head или tail.
+} c_spsc;
+
+// Стадия конвейера: вычисляет один активный слой.
+typedef struct s_c_pipeline_stage
+{
+    _Alignas(BLOCK_ALIGN) atomic_uint_least64_t busy_ns;// Время, затраченное на вычисления.
+    atomic_size_t batches_count;
+    size_t l;// Номер слоя.
+    const float *weights;// Первый вес слоя.
+    size_t r;// Первая строка CSR слоя.
+    pthread_t thread;
+    struct s_c_pipeline *pipeline;
+} c_pipeline_stage;
+
+// Конвейер потокового выполнения.
+// Каждый активный слой перцептрона вычисляется своей стадией в своем потоке, привязанном к своему процессору,
+// поэтому веса слоя остаются в кэше этого процессора. Мини-пакеты передаются между стадиями через
+// очереди без блокировок: очередь l содержит активации слоя l (очередь 0 - входные сигналы).
+struct s_c_pipeline
+{
+    c_perceptron *perceptron;// Клон с разделяемыми весами.
+    int use_csr;
+
+    size_t batch_rows;
+    size_t depth;
+
+    size_t stages_count;
+    c_pipeline_stage *stages;
+    c_spsc *queues;
+
+    atomic_int stop;
+    pthread_mutex_t mutex;// Защищает засыпание в ожидании очередей.
+    struct timespec started;
+
+    size_t size;
+    c_allocator allocator;
+};
+
+// Количество попыток (с sched_yield()) дождаться изменения очереди, после которых поток засыпает.
+#define PIPELINE_SPIN 256
+
+// Ждет, пока *_index очереди _queue отличается от _value, или остановки конвейера.
+// Сначала ждет активно, затем засыпает до pipeline_wake() или pipeline_stop().
+// Возвращает 1, если значение изменилось, 0, если конвейер остановлен.
+static int pipeline_wait(c_pipeline *const _pipeline,
+                         c_spsc *const _queue,
+                         atomic_size_t *const _index,
+                         const size_t _value)
+{
+    for (size_t i = 0; i < PIPELINE_SPIN; ++i)
+    {
+        if (atomic_load_explicit(_index, memory_order_acquire) != _value)
+        {
+            return 1;
+        }
+        if (atomic_load_explicit(&_pipeline->stop, memory_order_relaxed) != 0)
+        {
+            return 0;
+        }
+        sched_yield();
+    }
+
+    // Увеличение waiters и повторная проверка индекса последовательно согласованы с записью индекса
+    // и проверкой waiters в pipeline_wake(), поэтому либо ожидающий видит новое значение,
+    // либо пробуждающий видит ожидающего.
+    pthread_mutex_lock(&_pipeline->mutex);
+    atomic_fetch_add(&_queue->waiters, 1);
+    while ( (atomic_load(_index) == _value) &&
+            (atomic_load(&_pipeline->stop) == 0) )
+    {
+        pthread_cond_wait(&_queue->wake, &_pipeline->mutex);
+    }
+    atomic_fetch_sub(&_queue->waiters, 1);
+    pthread_mutex_unlock(&_pipeline->mutex);
+
+    return atomic_load_explicit(_index, memory_order_acquire) != _value;
+}
+
+// Записывает новое значение *_index очереди _queue и будит уснувших в ожидании очереди.
+static void pipeline_wake(c_pipeline *const _pipeline,
+                          c_spsc *const _queue,
+                          atomic_size_t *const _index,
+                          const size_t _value)
+{
+    atomic_store(_index, _value);
+    if (atomic_load(&_queue->waiters) != 0)
+    {
+        pthread_mutex_lock(&_pipeline->mutex);
+        pthread_cond_broadcast(&_queue->wake);
+        pthread_mutex_unlock(&_pipeline->mutex);
+    }
+}
+
+// Поток стадии конвейера.
+static void *pipeline_stage_thread(void *const _stage)
+{
+    c_pipeline_stage *const stage = _stage;
+    c_pipeline *const pipeline = stage->pipeline;
+    const c_perceptron *const perceptron = pipeline->perceptron;
+
+    c_spsc *const in = &pipeline->queues[stage->l - 1];
+    c_spsc *const out = &pipeline->queues[stage->l];
+
+    for (;;)
+    {
+        const size_t tail = atomic_load_explicit(&in->tail, memory_order_relaxed);
+        const size_t head = atomic_load_explicit(&out->head, memory_order_relaxed);
+
+        // Ждем входной мини-пакет и свободную ячейку выходной очереди.
+        if ( (pipeline_wait(pipeline, in, &in->head, tail) == 0) ||
+             (pipeline_wait(pipeline, out, &out->tail, head - pipeline->depth) == 0) )
+        {
+            break;
+        }
+
+        const uint64_t t0 = monotonic_ns();
+
+        const size_t in_slot = tail % pipeline->depth;
+        const size_t out_slot = head % pipeline->depth;
+        const size_t rows = in->rows[in_slot];
+        const float *const in_data = &in->data[in_slot * pipeline->batch_rows * in->width];
+        float *const out_data = &out->data[out_slot * pipeline->batch_rows * out->width];
+
+        for (size_t row = 0; row < rows; ++row)
+        {
+            forward_layer(perceptron, stage->l, stage->weights, pipeline->use_csr, stage->r,
+                          &in_data[row * in->width], &out_data[row * out->width], 0, out->width);
+        }
+        out->rows[out_slot] = rows;
+
+        pipeline_wake(pipeline, in, &in->tail, tail + 1);
+        pipeline_wake(pipeline, out, &out->head, head + 1);
+
+        atomic_fetch_add_explicit(&stage->busy_ns, monotonic_ns() - t0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stage->batches_count, 1, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+static ptrdiff_t pipeline_stop(c_pipeline *const _pipeline,
+                               const size_t _threads_count);
+
+// Создает конвейер потокового выполнения заданного перцептрона.
+// Конвейер использует веса перцептрона без копирования (см. c_perceptron_clone_shared()), последующие
+// изменения весов перцептрона конвейер не видят.
+// Мини-пакет содержит до _batch_rows строк, каждая очередь между стадиями вмещает _depth мини-пакетов.
+// Стадия l (поток слоя l) привязывается к (l - 1)-му по счету процессору, доступному процессу (по кругу, только в Linux).
+// Потоки стадий и c_pipeline_push()/c_pipeline_pop() ждут очереди недолго активно (с sched_yield()),
+// затем засыпают до изменения очереди, поэтому простаивающий конвейер не занимает процессоры.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_pipeline *c_pipeline_create(const c_perceptron *const _perceptron,
+                              const size_t _batch_rows,
+                              const size_t _depth,
+                              size_t *const _error)
+{
+    if (_perceptron == NULL)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    if (_batch_rows == 0)
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+    if (_depth == 0)
+    {
+        error_set(_error, 3);
+        return NULL;
+    }
+
+    const c_allocator *const allocator = &_perceptron->block->allocator;
+    const size_t stages_count = _perceptron->layers_count - 1;
+
+    // Определим расположение частей конвейера в блоке памяти: конвейер, стадии, очереди,
+    // количества строк ячеек, сигналы ячеек.
+    const size_t o_stages = align_up(sizeof(c_pipeline), _Alignof(c_pipeline_stage));
+    const size_t o_queues = align_up(o_stages + sizeof(c_pipeline_stage) * stages_count, _Alignof(c_spsc));
+    const size_t o_rows = align_up(o_queues + sizeof(c_spsc) * _perceptron->layers_count, _Alignof(size_t));
+    // Контроль целочисленного переполнения для размеров стадий и очередей не нужен, так как
+    // количество слоев контролируется на этапе конструирования перцептрона.
+    if ( (o_stages == 0) ||
+         (o_queues == 0) ||
+         (o_rows == 0) ||
+         (_depth > (SIZE_MAX - o_rows) / sizeof(size_t) / _perceptron->layers_count) )
+    {
+        error_set(_error, 4);
+        return NULL;
+    }
+    size_t new_size = align_up(o_rows + sizeof(size_t) * _depth * _perceptron->layers_count, BLOCK_ALIGN);
+    if (new_size == 0)
+    {
+        error_set(_error, 4);
+        return NULL;
+    }
+    const size_t o_data = new_size;
+    for (size_t l = 0; l < _perceptron->layers_count; ++l)
+    {
+        // Размер ячеек очереди l: _depth * _batch_rows * topology[l] сигналов.
+        size_t h = _depth;
+        if ( (h > SIZE_MAX / _batch_rows) ||
+             (h * _batch_rows > SIZE_MAX / _perceptron->topology[l]) )
+        {
+            error_set(_error, 4);
+            return NULL;
+        }
+        h = h * _batch_rows * _perceptron->topology[l];
+        if (h > SIZE_MAX / sizeof(float))
+        {
+            error_set(_error, 4);
+            return NULL;
+        }
+        h = align_up(sizeof(float) * h, BLOCK_ALIGN);
+        if ( (h == 0) ||
+             (new_size > SIZE_MAX - h) )
+        {
+            error_set(_error, 4);
+            return NULL;
+        }
+        new_size += h;
+    }
+
+    // Клонируем перцептрон с разделяемыми весами.
+    c_perceptron *const new_perceptron = c_perceptron_clone_shared_ex(_perceptron, allocator, NULL);
+    if (new_perceptron == NULL)
+    {
+        error_set(_error, 5);
+        return NULL;
+    }
+    // Решение о разреженном выполнении принимается один раз, до запуска стадий.
+    csr_update(new_perceptron);
+
+    // Пытаемся выделить память под конвейер.
+    char *const h = allocator->alloc(allocator->context, new_size, BLOCK_ALIGN);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 6);
+        return NULL;
+    }
+
+    // Собираем конвейер.
+    c_pipeline *const new_pipeline = (c_pipeline*)h;
+    new_pipeline->perceptron = new_perceptron;
+    new_pipeline->use_csr = new_perceptron->csr_state == CSR_READY;
+    new_pipeline->batch_rows = _batch_rows;
+    new_pipeline->depth = _depth;
+    new_pipeline->stages_count = stages_count;
+    new_pipeline->stages = (c_pipeline_stage*)(h + o_stages);
+    new_pipeline->queues = (c_spsc*)(h + o_queues);
+    atomic_init(&new_pipeline->stop, 0);
+    if (pthread_mutex_init(&new_pipeline->mutex, NULL) != 0)
+    {
+        allocator->free(allocator->context, h, new_size);
+        c_perceptron_delete(new_perceptron);
+        error_set(_error, 8);
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &new_pipeline->started);
+    new_pipeline->size = new_size;
+    new_pipeline->allocator = *allocator;
+
+    size_t o = o_data;
+    for (size_t l = 0; l < _perceptron->layers_count; ++l)
+    {
+        c_spsc *const queue = &new_pipeline->queues[l];
+        atomic_init(&queue->head, 0);
+        atomic_init(&queue->tail, 0);
+        atomic_init(&queue->waiters, 0);
+        if (pthread_cond_init(&queue->wake, NULL) != 0)
+        {
+            for (size_t k = 0; k < l; ++k)
+            {
+                pthread_cond_destroy(&new_pipeline->queues[k].wake);
+            }
+            pthread_mutex_destroy(&new_pipeline->mutex);
+            allocator->free(allocator->context, h, new_size);
+            c_perceptron_delete(new_perceptron);
+            error_set(_error, 8);
+            return NULL;
+        }
+        queue->width = _perceptron->topology[l];
+        queue->data = (float*)(h + o);
+        queue->rows = (size_t*)(h + o_rows) + _depth * l;
+        o += align_up(sizeof(float) * _depth * _batch_rows * queue->width, BLOCK_ALIGN);
+    }
+
+    size_t w = 0;
+    size_t r = 0;
+    for (size_t s = 0; s < stages_count; ++s)
+    {
+        c_pipeline_stage *const stage = &new_pipeline->stages[s];
+        atomic_init(&stage->busy_ns, 0);
+        atomic_init(&stage->batches_count, 0);
+        stage->l = s + 1;
+        stage->weights = (new_pipeline->use_csr != 0) ? NULL : &new_perceptron->weights[w];
+        stage->r = r;
+        stage->pipeline = new_pipeline;
+        w += _perceptron->topology[s] * _perceptron->topology[s + 1];
+        r += _perceptron->topology[s + 1];
+    }
+
+    // Процессоры, доступные процессу.
+#ifdef __linux__
+    cpu_set_t available;
+    size_t available_count = 0;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &available) == 0)
+    {
+        available_count = CPU_COUNT(&available);
+    }
+#endif
+
+    // Запускаем стадии.
+    for (size_t s = 0; s < stages_count; ++s)
+    {
+        c_pipeline_stage *const stage = &new_pipeline->stages[s];
+        if (pthread_create(&stage->thread, NULL, pipeline_stage_thread, stage) != 0)
+        {
+            pipeline_stop(new_pipeline, s);
+            error_set(_error, 7);
+            return NULL;
+        }
+#ifdef __linux__
+        if (available_count > 0)
+        {
+            // Ищем (s % available_count)-й доступный процессор.
+            size_t k = s % available_count;
+            for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &available))
+                {
+                    if (k == 0)
+                    {
+                        cpu_set_t cpus;
+                        CPU_ZERO(&cpus);
+                        CPU_SET(cpu, &cpus);
+                        pthread_setaffinity_np(stage->thread, sizeof(cpu_set_t), &cpus);
+                        break;
+                    }
+                    --k;
+                }
+            }
+        }
+#endif
+    }
+
+    return new_pipeline;
+}
+
+// Останавливает первые _threads_count стадий и удаляет конвейер.
+static ptrdiff_t pipeline_stop(c_pipeline *const _pipeline,
+                               const size_t _threads_count)
+{
+    atomic_store(&_pipeline->stop, 1);
+    // Будим уснувшие стадии; stop записан до захвата мьютекса, поэтому засыпающие после этого его увидят.
+    pthread_mutex_lock(&_pipeline->mutex);
+    for (size_t l = 0; l <= _pipeline->stages_count; ++l)
+    {
+        pthread_cond_broadcast(&_pipeline->queues[l].wake);
+    }
+    pthread_mutex_unlock(&_pipeline->mutex);
+    for (size_t s = 0; s < _threads_count; ++s)
+    {
+        pthread_join(_pipeline->stages[s].thread, NULL);
+    }
+
+    for (size_t l = 0; l <= _pipeline->stages_count; ++l)
+    {
+        pthread_cond_destroy(&_pipeline->queues[l].wake);
+    }
+    pthread_mutex_destroy(&_pipeline->mutex);
+
+    c_perceptron_delete(_pipeline->perceptron);
+
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _pipeline->allocator;
+    allocator.free(allocator.context, _pipeline, _pipeline->size);
+
+    return 1;
+}
+
+// Останавливает стадии и удаляет конвейер. Непрочитанные результаты теряются.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pipeline_delete(c_pipeline *const _pipeline)
+{
+    if (_pipeline == NULL)
+    {
+        return -1;
+    }
+
+    return pipeline_stop(_pipeline, _pipeline->stages_count);
+}
+
+// Помещает в конвейер мини-пакет из _rows строк входных сигналов, лежащих подряд (_rows <= размера мини-пакета).
+// Если входная очередь заполнена, ждет освобождения ячейки.
+// Вызывать может только один поток одновременно.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pipeline_push(c_pipeline *const _pipeline,
+                          const float *const _in,
+                          const size_t _rows)
+{
+    if (_pipeline == NULL)
+    {
+        return -1;
+    }
+    if (_in == NULL)
+    {
+        return -2;
+    }
+    if ( (_rows == 0) ||
+         (_rows > _pipeline->batch_rows) )
+    {
+        return -3;
+    }
+
+    c_spsc *const queue = &_pipeline->queues[0];
+    const size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    pipeline_wait(_pipeline, queue, &queue->tail, head - _pipeline->depth);
+
+    const size_t slot = head % _pipeline->depth;
+    memcpy(&queue->data[slot * _pipeline->batch_rows * queue->width], _in, sizeof(float) * _rows * queue->width);
+    queue->rows[slot] = _rows;
+
+    pipeline_wake(_pipeline, queue, &queue->head, head + 1);
+
+    return 1;
+}
+
+// Забирает из конвейера результаты очередного мини-пакета (в порядке c_pipeline_push()):
+// строки выходных сигналов записываются в _out подряд, количество строк - в *_rows.
+// Если результатов еще нет, ждет их.
+// Вызывать может только один поток одновременно.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pipeline_pop(c_pipeline *const _pipeline,
+                         float *const _out,
+                         size_t *const _rows)
+{
+    if (_pipeline == NULL)
+    {
+        return -1;
+    }
+    if (_out == NULL)
+    {
+        return -2;
+    }
+    if (_rows == NULL)
+    {
+        return -3;
+    }
+
+    c_spsc *const queue = &_pipeline->queues[_pipeline->stages_count];
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    pipeline_wait(_pipeline, queue, &queue->head, tail);
+
+    const size_t slot = tail % _pipeline->depth;
+    *_rows = queue->rows[slot];
+    memcpy(_out, &queue->data[slot * _pipeline->batch_rows * queue->width], sizeof(float) * *_rows * queue->width);
+
+    pipeline_wake(_pipeline, queue, &queue->tail, tail + 1);
+
+    return 1;
+}
+
+// Возвращает количество стадий конвейера (количество активных слоев).
+// В случае ошибки возвращает 0.
+size_t c_pipeline_get_stages_count(const c_pipeline *const _pipeline)
+{
+    if (_pipeline == NULL)
+    {
+        return 0;
+    }
+
+    return _pipeline->stages_count;
+}
+
+// Помещает в _occupancy[s] загрузку стадии s - долю времени с создания конвейера, которую стадия
+// провела в вычислениях (не больше _count стадий). Самая загруженная стадия - узкое место конвейера.
+// Если _batches != NULL, в _batches[s] помещается количество мини-пакетов, обработанных стадией s.
+// В случае успеха возвращает количество заполненных стадий (> 0).
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pipeline_get_occupancy(c_pipeline *const _pipeline,
+                                   float *const _occupancy,
+                                   size_t *const _batches,
+                                   const size_t _count)
+{
+    if (_pipeline == NULL)
+    {
+        return -1;
+    }
+    if ( (_occupancy == NULL) ||
+         (_count == 0) )
+    {
+        return -2;
+    }
+
+    const uint64_t started = (uint64_t)_pipeline->started.tv_sec * 1000000000u + (uint64_t)_pipeline->started.tv_nsec;
+    const uint64_t elapsed = monotonic_ns() - started;
+
+    const size_t count = (_count < _pipeline->stages_count) ? _count : _pipeline->stages_count;
+    for (size_t s = 0; s < count; ++s)
+    {
+        const uint64_t busy = atomic_load_explicit(&_pipeline->stages[s].busy_ns, memory_order_relaxed);
+        _occupancy[s] = (elapsed != 0) ? (float)((double)busy / (double)elapsed) : 0.f;
+        if (_batches != NULL)
+        {
+            _batches[s] = atomic_load_explicit(&_pipeline->stages[s].batches_count, memory_order_relaxed);
+        }
+    }
+
+    return count;
+}
+
+// --------------------
+
+// Наибольшее время ожидания инициализации объекта разделяемой памяти его создателем (нс).
+#define SHM_WAIT_NS 500000000u
+
+// Дожидается, пока создатель задаст размер объекта разделяемой памяти, но не дольше SHM_WAIT_NS.
+// В случае успеха возвращает > 0 и помещает размер объекта в _size.
+// Если размер не задан за время ожидания, возвращает 0.
+// В случае ошибки fstat() возвращает < 0.
+static int shm_wait_size(const int _fd,
+                         size_t *const _size)
+{
+    const uint64_t deadline = monotonic_ns() + SHM_WAIT_NS;
+    for (;;)
+    {
+        struct stat st;
+        if (fstat(_fd, &st) != 0)
+        {
+            return -1;
+        }
+        if (st.st_size != 0)
+        {
+            *_size = (size_t)st.st_size;
+            return 1;
+        }
+        if (monotonic_ns() >= deadline)
+        {
+            return 0;
+        }
+        sched_yield();
+    }
+}
+
+// Дожидается, пока создатель объявит объект разделяемой памяти инициализированным (_ready == _magic),
+// но не дольше SHM_WAIT_NS.
+// Возвращает > 0, если объект инициализирован, иначе (время ожидания истекло или объект чужой) - 0.
+static int shm_wait_ready(atomic_size_t *const _ready,
+                          const size_t _magic)
+{
+    const uint64_t deadline = monotonic_ns() + SHM_WAIT_NS;
+    for (;;)
+    {
+        const size_t ready = atomic_load_explicit(_ready, memory_order_acquire);
+        if (ready == _magic)
+        {
+            return 1;
+        }
+        // Объект создан для другой цели.
+        if (ready != 0)
+        {
+            return 0;
+        }
+        if (monotonic_ns() >= deadline)
+        {
+            return 0;
+        }
+        sched_yield();
+    }
+}
+
+// Заголовок кольца миграции в разделяемой памяти.
+// За заголовком следуют slots_count ячеек по slot_stride байт: c_shm_slot и веса генома.
+typedef struct s_c_shm_header
+{
+    atomic_size_t ready;// Становится SHM_READY после инициализации создателем.
+    size_t islands_count;
+    size_t slots_count;
+    size_t weights_count;
+    size_t slot_stride;
+    size_t size;
+    atomic_size_t head;// Номер следующей записи.
+} c_shm_header;
+
+// Ячейка кольца миграции.
+// sequence == 2 * n + 1 - идет запись n-го генома, sequence == 2 * n + 2 - n-й геном записан.
+typedef struct s_c_shm_slot
+{
+    atomic_size_t sequence;
+    size_t island;
+    size_t generation;
+    float sigma;
+} c_shm_slot;
+
+#define SHM_READY 0x63706773
+
+// Кольцо миграции островной модели в разделяемой памяти POSIX.
+// Острова (потоки или процессы одного узла) пишут лучшие геномы в общее кольцо без блокировок,
+// каждый остров читает кольцо со своей позиции, пропуская свои геномы.
+// Если остров отстал больше, чем на размер кольца, старые геномы пропускаются.
+struct s_c_shm_migration
+{
+    c_shm_header *header;
+    size_t *cursors;// Позиции чтения островов этого процесса.
+    size_t size;
+    c_allocator allocator;
+};
+
+// Возвращает ячейку кольца по номеру записи.
+static c_shm_slot *shm_slot(const c_shm_migration *const _migration,
+                            const size_t _n)
+{
+    c_shm_header *const header = _migration->header;
+    return (c_shm_slot*)((char*)header + BLOCK_ALIGN + header->slot_stride * (_n % header->slots_count));
+}
+
+// Отправляет геном в кольцо (c_migration.send).
+static ptrdiff_t shm_send(void *const _context,
+                          const size_t _island,
+                          const size_t _generation,
+                          const float *const _weights,
+                          const size_t _weights_count,
+                          const float _sigma)
+{
+    c_shm_migration *const migration = _context;
+    c_shm_header *const header = migration->header;
+
+    if ( (_island >= header->islands_count) ||
+         (_weights_count != header->weights_count) )
+    {
+        return -1;
+    }
+
+    const size_t n = atomic_fetch_add(&header->head, 1);
+    c_shm_slot *const slot = shm_slot(migration, n);
+
+    atomic_store_explicit(&slot->sequence, 2 * n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->island = _island;
+    slot->generation = _generation;
+    slot->sigma = _sigma;
+    memcpy(slot + 1, _weights, sizeof(float) * _weights_count);
+
+    atomic_store_explicit(&slot->sequence, 2 * n + 2, memory_order_release);
+
+    return 1;
+}
+
+// Получает из кольца очередной геном другого острова (c_migration.receive).
+// Возвращает 1, если геном получен, 0, если новых геномов нет.
+static ptrdiff_t shm_receive(void *const _context,
+                             const size_t _island,
+                             float *const _weights,
+                             const size_t _weights_count,
+                             float *const _sigma)
+{
+    c_shm_migration *const migration = _context;
+    c_shm_header *const header = migration->header;
+
+    if ( (_island >= header->islands_count) ||
+         (_weights_count != header->weights_count) )
+    {
+        return -1;
+    }
+
+    size_t *const cursor = &migration->cursors[_island];
+    const size_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+
+    // Геномы, которые уже перезаписаны, пропускаются.
+    if (head - *cursor > header->slots_count)
+    {
+        *cursor = head - header->slots_count;
+    }
+
+    for (; *cursor < head; ++*cursor)
+    {
+        const size_t n = *cursor;
+        const c_shm_slot *const slot = shm_slot(migration, n);
+
+        const size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        // Запись еще идет: продолжим с этой позиции в следующий раз.
+        if (sequence < 2 * n + 2)
+        {
+            return 0;
+        }
+        // Ячейка уже перезаписана более новым геномом.
+        if (sequence != 2 * n + 2)
+        {
+            continue;
+        }
+        if (slot->island == _island)
+        {
+            continue;
+        }
+
+        const float sigma = slot->sigma;
+        memcpy(_weights, slot + 1, sizeof(float) * _weights_count);
+
+        // Если во время копирования ячейку начали перезаписывать, геном отбрасывается.
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != sequence)
+        {
+            continue;
+        }
+
+        *_sigma = sigma;
+        ++*cursor;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Создает или открывает кольцо миграции в разделяемой памяти POSIX с именем _name (например, "/islands").
+// Все острова должны задавать одинаковые _islands_count и _slots_count и работать с перцептронами одной топологии.
+// Кольцо должно вмещать геномы, отправленные всеми островами за время между чтениями:
+// рекомендуется _slots_count >= 2 * _islands_count * (количество мигрантов).
+// Объект разделяемой памяти существует, пока не будет вызвана c_shm_migration_unlink().
+// Существующий объект должен быть инициализирован создателем в течение SHM_WAIT_NS, иначе возвращается ошибка.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_shm_migration *c_shm_migration_create(const char *const _name,
+                                        const size_t _islands_count,
+                                        const size_t _slots_count,
+                                        const c_perceptron *const _perceptron,
+                                        size_t *const _error)
+{
+    if ( (_name == NULL) ||
+         (strlen(_name) == 0) )
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    if ( (_islands_count == 0) ||
+         (_slots_count == 0) )
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+    if (_perceptron == NULL)
+    {
+        error_set(_error, 3);
+        return NULL;
+    }
+
+    // Определим размер ячейки и кольца.
+    // Контроль целочисленного переполнения при умножении для размера весов не нужен, так как
+    // он выполняется на этапе конструирования перцептрона.
+    const size_t slot_stride = align_up(sizeof(c_shm_slot) + sizeof(float) * _perceptron->weights_count, BLOCK_ALIGN);
+    const size_t slots_size = slot_stride * _slots_count;
+    // Контроль целочисленного переполнения.
+    if ( (slot_stride == 0) ||
+         (slots_size / slot_stride != _slots_count) ||
+         (slots_size > SIZE_MAX - BLOCK_ALIGN) ||
+         (BLOCK_ALIGN + slots_size > (size_t)PTRDIFF_MAX) )
+    {
+        error_set(_error, 4);
+        return NULL;
+    }
+    const size_t shm_size = BLOCK_ALIGN + slots_size;
+
+    // Определим размер локальной части: объект и позиции чтения островов.
+    const size_t cursors_size = sizeof(size_t) * _islands_count;
+    // Контроль целочисленного переполнения.
+    if ( (cursors_size / sizeof(size_t) != _islands_count) ||
+         (cursors_size > SIZE_MAX - sizeof(c_shm_migration)) )
+    {
+        error_set(_error, 4);
+        return NULL;
+    }
+    const size_t new_size = sizeof(c_shm_migration) + cursors_size;
+
+    // Первый процесс создает объект, остальные открывают существующий.
+    int created = 1;
+    int fd = shm_open(_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if ( (fd < 0) &&
+         (errno == EEXIST) )
+    {
+        created = 0;
+        fd = shm_open(_name, O_RDWR, 0600);
+    }
+    if (fd < 0)
+    {
+        error_set(_error, 5);
+        return NULL;
+    }
+
+    if (created != 0)
+    {
+        if (ftruncate(fd, (off_t)shm_size) != 0)
+        {
+            close(fd);
+            shm_unlink(_name);
+            error_set(_error, 6);
+            return NULL;
+        }
+    } else {
+        // Дожидаемся, пока создатель задаст размер объекта.
+        size_t size = 0;
+        const int waited = shm_wait_size(fd, &size);
+        if (waited < 0)
+        {
+            close(fd);
+            error_set(_error, 6);
+            return NULL;
+        }
+        if (waited == 0)
+        {
+            close(fd);
+            error_set(_error, 10);
+            return NULL;
+        }
+        if (size != shm_size)
+        {
+            close(fd);
+            error_set(_error, 7);
+            return NULL;
+        }
+    }
+
+    void *const m = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+    {
+        if (created != 0)
+        {
+            shm_unlink(_name);
+        }
+        error_set(_error, 8);
+        return NULL;
+    }
+
+    c_shm_header *const header = m;
+    if (created != 0)
+    {
+        // Новый объект заполнен нулями, поэтому все ячейки пусты.
+        header->islands_count = _islands_count;
+        header->slots_count = _slots_count;
+        header->weights_count = _perceptron->weights_count;
+        header->slot_stride = slot_stride;
+        header->size = shm_size;
+        atomic_init(&header->head, 0);
+        atomic_store_explicit(&header->ready, SHM_READY, memory_order_release);
+    } else {
+        // Дожидаемся окончания инициализации и проверяем совместимость.
+        if (shm_wait_ready(&header->ready, SHM_READY) == 0)
+        {
+            munmap(m, shm_size);
+            error_set(_error, 10);
+            return NULL;
+        }
+        if ( (header->islands_count != _islands_count) ||
+             (header->slots_count != _slots_count) ||
+             (header->weights_count != _perceptron->weights_count) )
+        {
+            munmap(m, shm_size);
+            error_set(_error, 7);
+            return NULL;
+        }
+    }
+
+    const c_allocator *const allocator = allocator_resolve(NULL);
+
+    // Пытаемся выделить память под локальную часть.
+    char *const h = mem_alloc(allocator, new_size);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+        munmap(m, shm_size);
+        if (created != 0)
+        {
+            shm_unlink(_name);
+        }
+        error_set(_error, 9);
+        return NULL;
+    }
+
+    // Собираем кольцо.
+    c_shm_migration *const new_migration = (c_shm_migration*)h;
+    new_migration->header = header;
+    new_migration->cursors = (size_t*)(h + sizeof(c_shm_migration));
+    new_migration->size = new_size;
+    new_migration->allocator = *allocator;
+
+    // Острова начинают читать с текущей позиции кольца.
+    const size_t head = atomic_load(&header->head);
+    for (size_t i = 0; i < _islands_count; ++i)
+    {
+        new_migration->cursors[i] = head;
+    }
+
+    return new_migration;
+}
+
+// Отключает процесс от кольца миграции. Селекционеры, использующие его транспорт, должны быть отключены от миграции.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_shm_migration_delete(c_shm_migration *const _migration)
+{
+    if (_migration == NULL)
+    {
+        return -1;
+    }
+
+    munmap(_migration->header, _migration->header->size);
+
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _migration->allocator;
+    mem_free(&allocator, _migration, _migration->size);
+
+    return 1;
+}
+
+// Удаляет имя объекта разделяемой памяти кольца, объект уничтожается после отключения всех процессов.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_shm_migration_unlink(const char *const _name)
+{
+    if (_name == NULL)
+    {
+        return -1;
+    }
+
+    if (shm_unlink(_name) != 0)
+    {
+        return -2;
+    }
+
+    return 1;
+}
+
+// Заполняет транспорт миграции для c_pgs_set_migration(), работающий через кольцо.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_shm_migration_get_transport(c_shm_migration *const _migration,
+                                        c_migration *const _transport)
+{
+    if (_migration == NULL)
+    {
+        return -1;
+    }
+    if (_transport == NULL)
+    {
+        return -2;
+    }
+
+    _transport->send = shm_send;
+    _transport->receive = shm_receive;
+    _transport->context = _migration;
+
+    return 1;
+}
+
+// --------------------
+
+// Заголовок модели в разделяемой памяти.
+// За заголовком следуют топология и функции активации, затем, с выравниванием на BLOCK_ALIGN, slots_count ячеек
+// по slot_stride байт: c_shm_model_slot и, со смещением BLOCK_ALIGN, веса.
+typedef struct s_c_shm_model_header
+{
+    atomic_size_t ready;// Становится SHM_MODEL_READY после инициализации создателем.
+    size_t layers_count;
+    size_t weights_count;
+    size_t slots_count;
+    size_t slot_stride;
+    size_t slots_offset;
+    size_t size;
+    atomic_size_t generation;// Последнее опубликованное поколение, 0 - модель еще не опубликована.
+} c_shm_model_header;
+
+// Ячейка модели. Поколение g хранится в ячейке g % slots_count.
+// sequence == 2 * g + 1 - идет запись поколения g, sequence == 2 * g + 2 - поколение g записано.
+typedef struct s_c_shm_model_slot
+{
+    atomic_size_t sequence;
+} c_shm_model_slot;
+
+#define SHM_MODEL_READY 0x63706d6c
+
+// Модель, опубликованная в разделяемой памяти POSIX.
+// Издатель пишет новое поколение весов в следующую ячейку и затем атомарно объявляет его текущим,
+// подписчики выполняют перцептрон прямо на весах из отображенной только для чтения памяти
+// без блокировок: если ячейку перезаписали во время выполнения, выполнение повторяется.
+struct s_c_shm_model
+{
+    c_shm_model_header *header;
+    int writable;
+    // Перцептрон без собственных весов: топология и функции активации для forward(), веса берутся из ячеек.
+    c_perceptron view;
+    size_t size;
+    c_allocator allocator;
+};
+
+// Возвращает ячейку поколения.
+static c_shm_model_slot *shm_model_slot(const c_shm_model *const _model,
+                                        const size_t _generation)
+{
+    c_shm_model_header *const header = _model->header;
+    return (c_shm_model_slot*)((char*)header + header->slots_offset +
+                               header->slot_stride * (_generation % header->slots_count));
+}
+
+// Возвращает веса ячейки.
+static const float *shm_model_weights(const c_shm_model_slot *const _slot)
+{
+    return (const float*)((const char*)_slot + BLOCK_ALIGN);
+}
+
+// Проверяет, совпадает ли топология перцептрона с топологией модели.
+static int shm_model_compatible(const c_shm_model_header *const _header,
+                                const c_perceptron *const _perceptron)
+{
+    if ( (_header->layers_count != _perceptron->layers_count) ||
+         (_header->weights_count != _perceptron->weights_count) )
+    {
+        return 0;
+    }
+    return memcmp(_header + 1, _perceptron->topology, sizeof(size_t) * _perceptron->layers_count) == 0;
+}
+
+// Возвращает функции активации модели.
+static size_t *shm_model_activations(c_shm_model_header *const _header)
+{
+    return (size_t*)(_header + 1) + _header->layers_count;
+}
+
+// Проверяет, совпадают ли функции активации перцептрона с функциями активации модели той же топологии.
+static int shm_model_activations_equal(c_shm_model_header *const _header,
+                                       const c_perceptron *const _perceptron)
+{
+    return memcmp(shm_model_activations(_header), _perceptron->activations,
+                  sizeof(size_t) * _perceptron->layers_count) == 0;
+}
+
+// Проверяет, что заголовок модели описывает допустимый перцептрон и что топология, функции активации
+// и ячейки помещаются в объект размера _size.
+static int shm_model_valid(const c_shm_model_header *const _header,
+                           const size_t _size)
+{
+    if ( (_header->size != _size) ||
+         (_header->layers_count < 2) ||
+         (_header->layers_count > (_size - sizeof(c_shm_model_header)) / (2 * sizeof(size_t))) ||
+         (_header->slots_offset < sizeof(c_shm_model_header) + 2 * sizeof(size_t) * _header->layers_count) ||
+         (_header->slots_offset % BLOCK_ALIGN != 0) ||
+         (_header->slots_offset > _size) ||
+         (_header->slots_count < 2) ||
+         (_header->slot_stride < BLOCK_ALIGN) ||
+         (_header->slot_stride % BLOCK_ALIGN != 0) ||
+         (_header->slots_count > (_size - _header->slots_offset) / _header->slot_stride) ||
+         (_header->weights_count > (_header->slot_stride - BLOCK_ALIGN) / sizeof(float)) )
+    {
+        return 0;
+    }
+
+    // Количество весов должно соответствовать топологии.
+    const size_t *const topology = (const size_t*)(_header + 1);
+    const size_t *const activations = topology + _header->layers_count;
+    size_t weights_count = 0;
+    for (size_t l = 1; l < _header->layers_count; ++l)
+    {
+        if ( (topology[l - 1] == 0) ||
+             (topology[l] == 0) ||
+             (topology[l] > _header->weights_count / topology[l - 1]) ||
+             (activations[l] > C_ACTIVATION_HARD_SIGMOID) )
+        {
+            return 0;
+        }
+        weights_count += topology[l - 1] * topology[l];
+        if (weights_count > _header->weights_count)
+        {
+            return 0;
+        }
+    }
+
+    return weights_count == _header->weights_count;
+}
+
+// Собирает локальную часть модели для отображенного объекта.
+// В случае ошибки возвращает NULL.
+static c_shm_model *shm_model_alloc(c_shm_model_header *const _header,
+                                    const int _writable)
+{
+    const c_allocator *const allocator = allocator_resolve(NULL);
+
+    // Пытаемся выделить память под локальную часть.
+    c_shm_model *const new_model = mem_alloc(allocator, sizeof(c_shm_model));
+    // Контроль успешности выделения памяти.
+    if (new_model == NULL)
+    {
+        return NULL;
+    }
+
+    new_model->header = _header;
+    new_model->writable = _writable;
+    memset(&new_model->view, 0, sizeof(c_perceptron));
+    new_model->view.layers_count = _header->layers_count;
+    new_model->view.topology = (size_t*)(_header + 1);
+    new_model->view.activations = shm_model_activations(_header);
+    new_model->view.weights_count = _header->weights_count;
+    new_model->view.csr_state = CSR_DENSE;
+    new_model->view.parallel_width = PARALLEL_WIDTH;
+    new_model->size = sizeof(c_shm_model);
+    new_model->allocator = *allocator;
+
+    return new_model;
+}
+
+// Создает или открывает для публикации модель в разделяемой памяти POSIX с именем _name (например, "/model").
+// Модель рассчитана на перцептроны топологии и функций активации _perceptron и хранит _slots_count (>= 2)
+// последних поколений: подписчик, выполняющий перцептрон дольше, чем издатель публикует _slots_count - 1 поколений,
+// повторяет выполнение.
+// Если объект уже существует (например, издатель перезапущен), он открывается, а топология, функции активации
+// и _slots_count должны совпадать; нумерация поколений продолжается. Существующий объект должен быть
+// инициализирован создателем в течение SHM_WAIT_NS, иначе возвращается ошибка.
+// Публиковать модель одновременно может только один издатель.
+// Объект разделяемой памяти существует, пока не будет вызвана c_shm_model_unlink().
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_shm_model *c_shm_model_create(const char *const _name,
+                                const c_perceptron *const _perceptron,
+                                const size_t _slots_count,
+                                size_t *const _error)
+{
+    if ( (_name == NULL) ||
+         (strlen(_name) == 0) )
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    if (_perceptron == NULL)
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+    if (_slots_count < 2)
+    {
+        error_set(_error, 3);
+        return NULL;
+    }
+
+    // Определим размер ячейки и объекта.
+    // Контроль целочисленного переполнения при умножении для размеров весов и топологии не нужен, так как
+    // он выполняется на этапе конструирования перцептрона.
+    const size_t slots_offset = align_up(sizeof(c_shm_model_header) + 2 * sizeof(size_t) * _perceptron->layers_count,
+                                         BLOCK_ALIGN);
+    const size_t slot_stride = align_up(BLOCK_ALIGN + sizeof(float) * _perceptron->weights_count, BLOCK_ALIGN);
+    const size_t slots_size = slot_stride * _slots_count;
+    // Контроль целочисленного переполнения.
+    if ( (slots_offset == 0) ||
+         (slot_stride == 0) ||
+         (slots_size / slot_stride != _slots_count) ||
+         (slots_size > SIZE_MAX - slots_offset) ||
+         (slots_offset + slots_size > (size_t)PTRDIFF_MAX) )
+    {
+        error_set(_error, 4);
+        return NULL;
+    }
+    const size_t shm_size = slots_offset + slots_size;
+
+    int created = 1;
+    int fd = shm_open(_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if ( (fd < 0) &&
+         (errno == EEXIST) )
+    {
+        created = 0;
+        fd = shm_open(_name, O_RDWR, 0644);
+    }
+    if (fd < 0)
+    {
+        error_set(_error, 5);
+        return NULL;
+    }
+
+    if (created != 0)
+    {
+        if (ftruncate(fd, (off_t)shm_size) != 0)
+        {
+            close(fd);
+            shm_unlink(_name);
+            error_set(_error, 6);
+            return NULL;
+        }
+    } else {
+        // Дожидаемся, пока создатель задаст размер объекта.
+        size_t size = 0;
+        const int waited = shm_wait_size(fd, &size);
+        if (waited < 0)
+        {
+            close(fd);
+            error_set(_error, 6);
+            return NULL;
+        }
+        if (waited == 0)
+        {
+            close(fd);
+            error_set(_error, 10);
+            return NULL;
+        }
+        if (size != shm_size)
+        {
+            close(fd);
+            error_set(_error, 7);
+            return NULL;
+        }
+    }
+
+    void *const m = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+    {
+        if (created != 0)
+        {
+            shm_unlink(_name);
+        }
+        error_set(_error, 8);
+        return NULL;
+    }
+
+    c_shm_model_header *const header = m;
+    if (created != 0)
+    {
+        // Новый объект заполнен нулями, поэтому ни одно поколение не записано.
+        header->layers_count = _perceptron->layers_count;
+        header->weights_count = _perceptron->weights_count;
+        header->slots_count = _slots_count;
+        header->slot_stride = slot_stride;
+        header->slots_offset = slots_offset;
+        header->size = shm_size;
+        memcpy(header + 1, _perceptron->topology, sizeof(size_t) * _perceptron->layers_count);
+        memcpy(shm_model_activations(header), _perceptron->activations, sizeof(size_t) * _perceptron->layers_count);
+        atomic_init(&header->generation, 0);
+        atomic_store_explicit(&header->ready, SHM_MODEL_READY, memory_order_release);
+    } else {
+        // Дожидаемся окончания инициализации и проверяем совместимость.
+        if (shm_wait_ready(&header->ready, SHM_MODEL_READY) == 0)
+        {
+            munmap(m, shm_size);
+            error_set(_error, 10);
+            return NULL;
+        }
+        if ( (shm_model_valid(header, shm_size) == 0) ||
+             (header->slots_count != _slots_count) ||
+             (shm_model_compatible(header, _perceptron) == 0) ||
+             (shm_model_activations_equal(header, _perceptron) == 0) )
+        {
+            munmap(m, shm_size);
+            error_set(_error, 7);
+            return NULL;
+        }
+    }
+
+    c_shm_model *const new_model = shm_model_alloc(header, 1);
+    if (new_model == NULL)
+    {
+        munmap(m, shm_size);
+        if (created != 0)
+        {
+            shm_unlink(_name);
+        }
+        error_set(_error, 9);
+        return NULL;
+    }
+
+    return new_model;
+}
+
+// Открывает модель в разделяемой памяти POSIX с именем _name для чтения (подписка).
+// Топология читается из объекта, поэтому подписчику не нужен файл модели.
+// Если издатель не инициализировал объект в течение SHM_WAIT_NS или объект не является моделью,
+// возвращается ошибка.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0).
+c_shm_model *c_shm_model_open(const char *const _name,
+                              size_t *const _error)
+{
+    if ( (_name == NULL) ||
+         (strlen(_name) == 0) )
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+
+    const int fd = shm_open(_name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        error_set(_error, 5);
+        return NULL;
+    }
+
+    // Размер объекта задается создателем сразу после создания.
+    size_t shm_size = 0;
+    const int waited = shm_wait_size(fd, &shm_size);
+    if (waited < 0)
+    {
+        close(fd);
+        error_set(_error, 6);
+        return NULL;
+    }
+    if (waited == 0)
+    {
+        close(fd);
+        error_set(_error, 10);
+        return NULL;
+    }
+    if (shm_size < sizeof(c_shm_model_header))
+    {
+        close(fd);
+        error_set(_error, 7);
+        return NULL;
+    }
+
+    void *const m = mmap(NULL, shm_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+    {
+        error_set(_error, 8);
+        return NULL;
+    }
+
+    c_shm_model_header *const header = m;
+    if (shm_wait_ready(&header->ready, SHM_MODEL_READY) == 0)
+    {
+        munmap(m, shm_size);
+        error_set(_error, 10);
+        return NULL;
+    }
+    if (shm_model_valid(header, shm_size) == 0)
+    {
+        munmap(m, shm_size);
+        error_set(_error, 7);
+        return NULL;
+    }
+
+    c_shm_model *const new_model = shm_model_alloc(header, 0);
+    if (new_model == NULL)
+    {
+        munmap(m, shm_size);
+        error_set(_error, 9);
+        return NULL;
+    }
+
+    return new_model;
+}
+
+// Отключает процесс от модели.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_shm_model_delete(c_shm_model *const _model)
+{
+    if (_model == NULL)
+    {
+        return -1;
+    }
+
+    munmap(_model->header, _model->header->size);
+
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _model->allocator;
+    mem_free(&allocator, _model, _model->size);
+
+    return 1;
+}
+
+// Удаляет имя объекта разделяемой памяти модели, объект уничтожается после отключения всех процессов.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_shm_model_unlink(const char *const _name)
+{
+    if (_name == NULL)
+    {
+        return -1;
+    }
+
+    if (shm_unlink(_name) != 0)
+    {
+        return -2;
+    }
+
+    return 1;
+}
+
+// Публикует веса перцептрона как новое поколение модели.
+// Подписчики начинают использовать новое поколение со следующего вызова.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_shm_model_publish(c_shm_model *const _model,
+                              const c_perceptron *const _perceptron)
+{
+    if (_model == NULL)
+    {
+        return -1;
+    }
+    if (_model->writable == 0)
+    {
+        return -2;
+    }
+    if (_perceptron == NULL)
+    {
+        return -3;
+    }
+    if ( (shm_model_compatible(_model->header, _perceptron) == 0) ||
+         (shm_model_activations_equal(_model->header, _perceptron) == 0) )
+    {
+        return -4;
+    }
+
+    c_shm_model_header *const header = _model->header;
+    const size_t generation = atomic_load_explicit(&header->generation, memory_order_relaxed) + 1;
+    c_shm_model_slot *const slot = shm_model_slot(_model, generation);
+
+    atomic_store_explicit(&slot->sequence, 2 * generation + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    weights_copy(_perceptron, (float*)((char*)slot + BLOCK_ALIGN));
+
+    atomic_store_explicit(&slot->sequence, 2 * generation + 2, memory_order_release);
+    atomic_store_explicit(&header->generation, generation, memory_order_release);
+
+    return 1;
+}
+
+// Возвращает последнее опубликованное поколение модели, 0 - модель еще не опубликована.
+size_t c_shm_model_get_generation(const c_shm_model *const _model)
+{
+    if (_model == NULL)
+    {
+        return 0;
+    }
+
+    return atomic_load_explicit(&_model->header->generation, memory_order_acquire);
+}
+
+// Возвращает топологию модели, см. c_perceptron_get_topology().
+const size_t *c_shm_model_get_topology(const c_shm_model *const _model,
+                                       size_t *const _layers_count)
+{
+    if (_model == NULL)
+    {
+        return NULL;
+    }
+
+    if (_layers_count != NULL)
+    {
+        *_layers_count = _model->view.layers_count;
+    }
+
+    return _model->view.topology;
+}
+
+// Пропускает сигнал через последнее опубликованное поколение модели, см. c_perceptron_execute_io().
+// Веса читаются прямо из разделяемой памяти. Может вызываться из любого количества потоков
+// одновременно с публикацией новых поколений.
+// В случае успеха возвращает номер использованного поколения (> 0).
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_shm_model_execute_io(c_shm_model *const _model,
+                                 const float *const _in,
+                                 const size_t _in_stride,
+                                 float *const _out)
+{
+    if (_model == NULL)
+    {
+        return -1;
+    }
+    if (_in == NULL)
+    {
+        return -2;
+    }
+    if (_in_stride == 0)
+    {
+        return -3;
+    }
+    if (_out == NULL)
+    {
+        return -4;
+    }
+
+    for (;;)
+    {
+        const size_t generation = atomic_load_explicit(&_model->header->generation, memory_order_acquire);
+        if (generation == 0)
+        {
+            return -5;
+        }
+
+        const c_shm_model_slot *const slot = shm_model_slot(_model, generation);
+        const size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        // Ячейку уже перезаписывают более новым поколением.
+        if (sequence != 2 * generation + 2)
+        {
+            continue;
+        }
+
+        forward(&_model->view, shm_model_weights(slot), 0, _in, _in_stride, _out, NULL);
+
+        // Если во время выполнения ячейку начали перезаписывать, выполнение повторяется.
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence)
+        {
+            return (ptrdiff_t)generation;
+        }
+    }
+}
+
+// Копирует веса последнего опубликованного поколения модели и функции активации модели в перцептрон
+// той же топологии, например, чтобы использовать их с остальными функциями c_perceptron.
+// В случае успеха возвращает номер скопированного поколения (> 0).
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_shm_model_snapshot(c_shm_model *const _model,
+                               c_perceptron *const _perceptron)
+{
+    if (_model == NULL)
+    {
+        return -1;
+    }
+    if (_perceptron == NULL)
+    {
+        return -2;
+    }
+    if (shm_model_compatible(_model->header, _perceptron) == 0)
+    {
+        return -3;
+    }
+
+    for (;;)
+    {
+        const size_t generation = atomic_load_explicit(&_model->header->generation, memory_order_acquire);
+        if (generation == 0)
+        {
+            return -4;
+        }
+
+        const c_shm_model_slot *const slot = shm_model_slot(_model, generation);
+        const size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence != 2 * generation + 2)
+        {
+            continue;
+        }
+
+        if (c_perceptron_set_weights(_perceptron, shm_model_weights(slot), _model->header->weights_count) < 0)
+        {
+            return -5;
+        }
+        // Функции активации неизменны на протяжении жизни модели, c_perceptron_set_weights()
+        // уже сбросил производные от них выходы.
+        memcpy(_perceptron->activations, shm_model_activations(_model->header),
+               sizeof(size_t) * _perceptron->layers_count);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence)
+        {
+            return (ptrdiff_t)generation;
+        }
+    }
+}
+
+#endif
+
+// --------------------
+
+#ifdef C_PERCEPTRON_POSIX
+
+// Узел NUMA селекционера: часть геномов, размещенная в памяти узла, и копия уроков.
+typedef struct s_c_pgs_node
+{
+    // Очередной номер потомка, который проверяют потоки узла.
+    _Alignas(BLOCK_ALIGN) atomic_size_t next;
+
+    char *genomes;
+    size_t genomes_size;
+
+    float *lessons;
+    size_t lessons_size;
+} c_pgs_node;
+
+// Режим NUMA селекционера.
+// Геномы всех особей распределены по узлам, i-й поток пула работает на узле i % nodes_count.
+// Каждого потомка тестирует поток узла, в памяти которого находится геном потомка.
+struct s_c_pgs_numa
+{
+    size_t nodes_count;
+    c_pgs_node *nodes;
+    c_workers *workers;
+
+    // Аргументы текущей задачи пула.
+    c_pgs *pgs;
+    const c_perceptron *perceptron;
+    const float *lessons;
+    size_t lessons_count;
+    size_t pool_last;// Потомки [next; pool_last) узла тестируются.
+    c_pgs_job *job;
+    atomic_int cancelled;
+
+    size_t size;
+    c_allocator allocator;
+};
+
+// Читает список процессоров узла NUMA (например, "0-7,16-23").
+// Возвращает количество процессоров узла, 0 - если узла нет или у него нет процессоров.
+static size_t numa_node_cpus(const size_t _node,
+                             void *const _cpus)
+{
+#ifdef __linux__
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "/sys/devices/system/node/node%zu/cpulist", _node);
+
+    FILE *f = fopen(file_name, "r");
+    if (f == NULL)
+    {
+        return 0;
+    }
+
+    cpu_set_t *const cpus = _cpus;
+    CPU_ZERO(cpus);
+
+    size_t count = 0;
+    unsigned long first;
+    while (fscanf(f, "%lu", &first) == 1)
+    {
+        unsigned long last = first;
+        int c = fgetc(f);
+        if (c == '-')
+        {
+            if (fscanf(f, "%lu", &last) != 1)
+            {
+                break;
+            }
+            c = fgetc(f);
+        }
+        for (unsigned long cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); ++cpu)
+        {
+            CPU_SET(cpu, cpus);
+            ++count;
+        }
+        if (c != ',')
+        {
+            break;
+        }
+    }
+
+    fclose(f);
+
+    return count;
+#else
+    (void)_node;
+    (void)_cpus;
+    return 0;
+#endif
+}
+
+// Размещает страницы геномов узла в его памяти: первое обращение выполняет поток узла.
+static void numa_touch_task(void *const _context,
+                            const size_t _worker)
+{
+    c_pgs_numa *const numa = _context;
+    if (_worker < numa->nodes_count)
+    {
+        c_pgs_node *const node = &numa->nodes[_worker];
+        memset(node->genomes, 0, node->genomes_size);
+    }
+}
+
+// Копирует уроки в память каждого узла: копию создает и заполняет поток узла.
+// Если копию создать не удалось, узел использует исходные уроки.
+static void numa_lessons_task(void *const _context,
+                              const size_t _worker)
+{
+    c_pgs_numa *const numa = _context;
+    if (_worker < numa->nodes_count)
+    {
+        c_pgs_node *const node = &numa->nodes[_worker];
+        const size_t ins_outs_count = numa->pgs->topology[0] + numa->pgs->topology[numa->pgs->layers_count - 1];
+        // Контроль целочисленного переполнения выполнен в pgs_run_check().
+        node->lessons_size = sizeof(float) * ins_outs_count * numa->lessons_count;
+        void *const m = mmap(NULL, node->lessons_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED)
+        {
+            node->lessons = NULL;
+            node->lessons_size = 0;
+            return;
+        }
+        memcpy(m, numa->lessons, node->lessons_size);
+        node->lessons = m;
+    }
+}
+
+// Удаляет копии уроков узлов.
+static void numa_lessons_release(c_pgs_numa *const _numa)
+{
+    for (size_t n = 0; n < _numa->nodes_count; ++n)
+    {
+        if (_numa->nodes[n].lessons != NULL)
+        {
+            munmap(_numa->nodes[n].lessons, _numa->nodes[n].lessons_size);
+            _numa->nodes[n].lessons = NULL;
+            _numa->nodes[n].lessons_size = 0;
+        }
+    }
+}
+
+// Возвращает номер узла, в памяти которого находится геном.
+static size_t numa_genome_node(const c_pgs_numa *const _numa,
+                               const float *const _weights)
+{
+    const char *const h = (const char*)_weights;
+    for (size_t n = 0; n < _numa->nodes_count; ++n)
+    {
+        const c_pgs_node *const node = &_numa->nodes[n];
+        if ( (h >= node->genomes) &&
+             (h < node->genomes + node->genomes_size) )
+        {
+            return n;
+        }
+    }
+
+    return 0;
+}
+
+// Удаляет режим NUMA вместе с геномами узлов.
+static void pgs_numa_delete(c_pgs_numa *const _numa)
+{
+    if (_numa->workers != NULL)
+    {
+        workers_delete(_numa->workers);
+    }
+
+    for (size_t n = 0; n < _numa->nodes_count; ++n)
+    {
+        if (_numa->nodes[n].genomes != NULL)
+        {
+            munmap(_numa->nodes[n].genomes, _numa->nodes[n].genomes_size);
+        }
+    }
+
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _numa->allocator;
+    allocator.free(allocator.context, _numa, _numa->size);
+}
+
+// Переносит геномы всех особей в новое расположение: k-я особь (популяция, затем пул) получает
+// геном по адресу _address(_context, k), содержимое геномов сохраняется.
+static void pgs_genomes_move(c_pgs *const _pgs,
+                             const size_t _weights_size,
+                             float *(*const _address)(void *_context, size_t _k),
+                             void *const _context)
+{
+    for (size_t p = 0; p < _pgs->pop_count; ++p)
+    {
+        float *const weights = _address(_context, p);
+        memcpy(weights, _pgs->pop[p].weights, _weights_size);
+        _pgs->pop[p].weights = weights;
+    }
+    for (size_t p = 0; p < _pgs->pool_count; ++p)
+    {
+        float *const weights = _address(_context, _pgs->pop_count + p);
+        memcpy(weights, _pgs->pool[p].weights, _weights_size);
+        _pgs->pool[p].weights = weights;
+    }
+}
+
+// Аргумент pgs_genomes_move() для распределения геномов по узлам.
+typedef struct s_c_numa_move
+{
+    c_pgs_numa *numa;
+    size_t genomes_count;
+    size_t genome_stride;
+} c_numa_move;
+
+// Возвращает адрес k-го генома при распределении геномов по узлам поровну.
+static float *numa_genome_address(void *const _context,
+                                  const size_t _k)
+{
+    const c_numa_move *const move = _context;
+    const size_t nodes_count = move->numa->nodes_count;
+    // Геномы [first(n); first(n + 1)) принадлежат узлу n.
+    const size_t n = (_k * nodes_count) / move->genomes_count;
+    const size_t first = (n * move->genomes_count + nodes_count - 1) / nodes_count;
+    return (float*)(move->numa->nodes[n].genomes + move->genome_stride * (_k - first));
+}
+
+// Возвращает адрес k-го генома в непрерывном блоке геномов селекционера.
+static float *genomes_address(void *const _context,
+                              const size_t _k)
+{
+    const c_numa_move *const move = _context;
+    return (float*)((char*)move->numa->pgs->genomes + move->genome_stride * _k);
+}
+
+#endif
+
+// Создает перцептронного генетического селекционера.
+// Популяция должна быть >= 10.
+// В случае ошибки возвращает NULL, и если _error != NULL,
+// в заданное расположение помещается код причины ошибки (> 0).
+c_pgs *c_pgs_create(const c_perceptron *const _perceptron,
+                    const size_t _pop_count,
+                    size_t *const _error)
+{
+    return c_pgs_create_ex(_perceptron, _pop_count, NULL, _error);
+}
+
+#ifdef C_PERCEPTRON_POSIX
+
+// Отображает в память файл подкачки геномов размером _size байт.
+// Файл удаляется из каталога сразу после отображения, место на диске освобождается вместе с отображением.
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение помещается код причины ошибки.
+static float *scratch_map(const char *const _file_name,
+                          const size_t _size,
+                          size_t *const _error)
+{
+    if (_size > (size_t)PTRDIFF_MAX)
+    {
+        error_set(_error, 9);
+        return NULL;
+    }
+
+    const int fd = open(_file_name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        error_set(_error, 9);
+        return NULL;
+    }
+
+    // Место на диске выделяется заранее: при его нехватке во время обучения запись в отображение завершила бы процесс.
+    if (posix_fallocate(fd, 0, (off_t)_size) != 0)
+    {
+        close(fd);
+        unlink(_file_name);
+        error_set(_error, 10);
+        return NULL;
+    }
+
+    void *const m = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    unlink(_file_name);
+    if (m == MAP_FAILED)
+    {
+        error_set(_error, 11);
+        return NULL;
+    }
+
+    return m;
+}
+
+#else
+
+// Без POSIX файл подкачки недоступен.
+static float *scratch_map(const char *const _file_name,
+                          const size_t _size,
+                          size_t *const _error)
+{
+    (void)_file_name;
+    (void)_size;
+    error_set(_error, 9);
+    return NULL;
+}
+
+#endif
+
+// Создает селекционера, см. c_pgs_create_ex() и c_pgs_create_scratch().
+// Если _scratch_name != NULL, геномы отображаются из файла подкачки, иначе выделяются распределителем.
+static c_pgs *pgs_create(const c_perceptron *const _perceptron,
+                         const size_t _pop_count,
+                         const c_allocator *const _allocator,
+                         const char *const _scratch_name,
+                         size_t *const _error)
+{
+    if (_perceptron == NULL)
+    {
+        error_set(_error, 1);
+        return NULL;
+    }
+    if (_pop_count < 10)
+    {
+        error_set(_error, 2);
+        return NULL;
+    }
+
+    const c_allocator *const allocator = allocator_resolve(_allocator);
+    if (allocator == NULL)
+    {
+        error_set(_error, 3);
+        return NULL;
+    }
+
+    // Определим количество мест в пуле.
+    size_t new_pool_count = _pop_count * _pop_count;
+    // Контроль целочисленного переполнения при умножении.
+    if (new_pool_count / _pop_count != _pop_count)
+    {
+        error_set(_error, 4);
+        return NULL;
+    }
+    new_pool_count -= _pop_count;
+
+    // Определим, сколько памяти необходимо под топологию, популяцию и пул.
+    // Контроль целочисленного переполнения при умножении для топологии не нужен, так как
+    // он выполняется на этапе конструирования перцептрона.
+    const size_t new_topology_size = sizeof(size_t) * _perceptron->layers_count;
+    const size_t new_pop_size = sizeof(c_weights_and_sigma) * _pop_count;
+    const size_t new_pool_size = sizeof(c_weights_and_sigma) * new_pool_count;
+    // Контроль целочисленного переполнения при умножении.
+    if ( (new_pop_size / sizeof(c_weights_and_sigma) != _pop_count) ||
+         (new_pool_size / sizeof(c_weights_and_sigma) != new_pool_count) )
+    {
+        error_set(_error, 5);
+        return NULL;
+    }
+
+    // Определим расположение частей селекционера в блоке памяти: селекционер, топология, популяция, пул
+    // и, в режиме файла подкачки, номера ячеек популяции.
+    // Размер номеров ячеек не превосходит размер популяции.
+    const size_t o_topology = align_up(sizeof(c_pgs), _Alignof(size_t));
+    const size_t o_pop = align_up(o_topology + new_topology_size, _Alignof(c_weights_and_sigma));
+    const size_t new_slots_size = (_scratch_name != NULL) ? sizeof(size_t) * _pop_count : 0;
+    // Контроль целочисленного переполнения при сложении.
+    if ( (o_pop == 0) ||
+         (o_pop > SIZE_MAX - new_pop_size) ||
+         (o_pop + new_pop_size > SIZE_MAX - new_pool_size) ||
+         (o_pop + new_pop_size + new_pool_size > SIZE_MAX - new_slots_size) )
+    {
+        error_set(_error, 5);
+        return NULL;
+    }
+    const size_t o_pool = o_pop + new_pop_size;
+    const size_t o_slots = o_pool + new_pool_size;
+    const size_t new_size = o_slots + new_slots_size;
+
+    // Определим, сколько памяти занимают геномы всех особей.
+    // Геном каждой особи выравнивается по WEIGHTS_ALIGN.
+    // Контроль целочисленного переполнения при умножении для размера весов не нужен, так как
+    // он выполняется на этапе конструирования перцептрона.
+    const size_t genome_stride = align_up(sizeof(float) * _perceptron->weights_count, WEIGHTS_ALIGN);
+    const size_t genomes_count = _pop_count + new_pool_count;
+    const size_t new_genomes_size = genome_stride * genomes_count;
+    // Контроль целочисленного переполнения.
+    if ( (genome_stride == 0) ||
+         (genomes_count < _pop_count) ||
+         (new_genomes_size / genome_stride != genomes_count) )
+    {
+        error_set(_error, 6);
+        return NULL;
+    }
+
+    // Пытаемся выделить память под селекционера.
+    char *const h = mem_alloc(allocator, new_size);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+        error_set(_error, 7);
+        return NULL;
+    }
+
+    // Пытаемся выделить память под геномы.
+    float *new_genomes;
+    if (_scratch_name != NULL)
+    {
+        new_genomes = scratch_map(_scratch_name, new_genomes_size, _error);
+    } else {
+        new_genomes = allocator->alloc(allocator->context, new_genomes_size, BLOCK_ALIGN);
+        if (new_genomes == NULL)
+        {
+            error_set(_error, 8);
+        }
+    }
+    // Контроль успешности выделения памяти.
+    if (new_genomes == NULL)
+    {
+        mem_free(allocator, h, new_size);
+        return NULL;
+    }
+
+    // Собираем c_pgs.
+    c_pgs *const new_pgs = (c_pgs*)h;
+    new_pgs->layers_count = _perceptron->layers_count;
+    new_pgs->topology = (size_t*)(h + o_topology);
+    memcpy(new_pgs->topology, _perceptron->topology, new_topology_size);
+    new_pgs->pop_count = _pop_count;
+    new_pgs->pop = (c_weights_and_sigma*)(h + o_pop);
+    new_pgs->pool_count = new_pool_count;
+    new_pgs->pool = (c_weights_and_sigma*)(h + o_pool);
+    new_pgs->genomes = new_genomes;
+    new_pgs->genomes_size = new_genomes_size;
+    new_pgs->size = new_size;
+    new_pgs->allocator = *allocator;
+    new_pgs->scratch = (_scratch_name != NULL);
+    new_pgs->scratch_slots = (_scratch_name != NULL) ? (size_t*)(h + o_slots) : NULL;
+    new_pgs->published = NULL;
+    new_pgs->checkpoint_name = NULL;
+    new_pgs->checkpoint_name_size = 0;
+    new_pgs->checkpoint_interval = 0;
+    memset(&new_pgs->migration, 0, sizeof(c_migration));
+    new_pgs->migration_island = 0;
+    new_pgs->migration_interval = 0;
+    new_pgs->migration_count = 0;
+    new_pgs->numa = NULL;
+    new_pgs->lesson_workers = NULL;
+    new_pgs->profiler = NULL;
+
+    // Обеспечиваем весами каждую сущность популяции и пула.
+    char *const g = (char*)new_genomes;
+    for (size_t p = 0; p < _pop_count; ++p)
+    {
+        new_pgs->pop[p].weights = (float*)(g + genome_stride * p);
+    }
+    for (size_t p = 0; p < new_pool_count; ++p)
+    {
+        new_pgs->pool[p].weights = (float*)(g + genome_stride * (_pop_count + p));
+    }
+
+    return new_pgs;
+}
+
+// Создает перцептронного генетического селекционера, память под который (в том числе под геномы
+// всех особей) выделяется заданным распределителем.
+// Если _allocator == NULL, используется распределитель по умолчанию (malloc()/free()).
+// Геномы всех особей выделяются одним непрерывным блоком, что позволяет разместить их, например, в больших страницах.
+// В случае ошибки возвращает NULL, и если _error != NULL,
+// в заданное расположение помещается код причины ошибки (> 0).
+c_pgs *c_pgs_create_ex(const c_perceptron *const _perceptron,
+                       const size_t _pop_count,
+                       const c_allocator *const _allocator,
+                       size_t *const _error)
+{
+    return pgs_create(_perceptron, _pop_count, _allocator, NULL, _error);
+}
+
+#ifdef C_PERCEPTRON_POSIX
+
+// Создает перцептронного генетического селекционера, геномы особей которого хранятся в файле подкачки
+// _file_name, отображенном в память, - для популяций, геномы пула которых не помещаются в память.
+// В памяти остаются только сам селекционер и ошибки особей с указателями на их геномы.
+// Место под геномы выделяется в файле сразу; файл удаляется из каталога сразу после создания
+// и освобождается вместе с селекционером (или при завершении процесса).
+// Потомки скрещиваются и тестируются последовательными порциями, следующая порция заранее читается с диска,
+// результат обучения совпадает с результатом селекционера, геномы которого находятся в памяти.
+// Несовместим с режимом NUMA (c_pgs_set_numa()).
+// В случае ошибки возвращает NULL, и если _error != NULL,
+// в заданное расположение помещается код причины ошибки (> 0).
+c_pgs *c_pgs_create_scratch(const c_perceptron *const _perceptron,
+                            const size_t _pop_count,
+                            const char *const _file_name,
+                            size_t *const _error)
+{
+    if ( (_file_name == NULL) ||
+         (strlen(_file_name) == 0) )
+    {
+        error_set(_error, 12);
+        return NULL;
+    }
+
+    return pgs_create(_perceptron, _pop_count, NULL, _file_name, _error);
+}
+
+#endif
+
+// Удаляет перцептронного генетического селекционера.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pgs_delete(c_pgs *const _pgs)
+{
+    if (_pgs == NULL)
+    {
+        return -1;
+    }
+
+    // Распределитель копируется, так как он хранится в освобождаемом блоке.
+    const c_allocator allocator = _pgs->allocator;
+    if (_pgs->checkpoint_name != NULL)
+    {
+        mem_free(&allocator, _pgs->checkpoint_name, _pgs->checkpoint_name_size);
+    }
+    if (_pgs->lesson_workers != NULL)
+    {
+        workers_delete(_pgs->lesson_workers);
+    }
+#ifdef C_PERCEPTRON_POSIX
+    if (_pgs->numa != NULL)
+    {
+        pgs_numa_delete(_pgs->numa);
+    } else if (_pgs->scratch != 0) {
+        munmap(_pgs->genomes, _pgs->genomes_size);
+    } else {
+        allocator.free(allocator.context, _pgs->genomes, _pgs->genomes_size);
+    }
+#else
+    allocator.free(allocator.context, _pgs->genomes, _pgs->genomes_size);
+#endif
+    allocator.free(allocator.context, _pgs, _pgs->size);
+
+    return 1;
+}
+
+// Подключает к селекционеру опубликованную модель: по ходу c_pgs_run() каждый раз, когда лучший потомок
+// поколения лучше всех опубликованных за запуск, его геном публикуется, не блокируя читателей модели.
+// Если публикация не удалась (не хватает памяти), обучение продолжается, а читатели видят прошлую версию.
+// Топология модели должна совпадать с топологией селекционера.
+// _published == NULL отключает публикацию.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pgs_set_published(c_pgs *const _pgs,
+                              c_published *const _published)
+{
+    if (_pgs == NULL)
+    {
+        return -1;
+    }
+
+    if (_published != NULL)
+    {
+        if (_published->layers_count != _pgs->layers_count)
+        {
+            return -2;
+        }
+        for (size_t l = 0; l < _pgs->layers_count; ++l)
+        {
+            if (_published->topology[l] != _pgs->topology[l])
+            {
+                return -3;
+            }
+        }
+    }
+
+    _pgs->published = _published;
+
+    return 1;
+}
+
+// Включает контрольные точки: по ходу c_pgs_run() и c_pgs_resume() после каждых _interval поколений
+// состояние обучения (геномы и ошибки популяции, номер поколения, состояние ГПСЧ) записывается в файл,
+// из которого обучение можно продолжить вызовом c_pgs_resume().
+// Файл записывается через временный файл "<_file_name>.tmp" и переименовывается, поэтому
+// прерывание во время записи не портит прошлую контрольную точку. Ошибка записи не прерывает обучение.
+// При отмене асинхронного обучения контрольная точка записывается для последнего завершенного поколения.
+// _file_name == NULL или _interval == 0 отключает контрольные точки.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pgs_set_checkpoint(c_pgs *const _pgs,
+                               const char *const _file_name,
+                               const size_t _interval)
+{
+    if (_pgs == NULL)
+    {
+        return -1;
+    }
+
+    char *new_name = NULL;
+    size_t new_name_size = 0;
+
+    if ( (_file_name != NULL) &&
+         (_interval != 0) )
+    {
+        const size_t name_length = strlen(_file_name);
+        if (name_length == 0)
+        {
+            return -2;
+        }
+
+        // Место под имя, суффикс ".tmp" временного файла и завершающий ноль.
+        new_name_size = name_length + sizeof(".tmp");
+        // Контроль целочисленного переполнения при сложении.
+        if (new_name_size < name_length)
+        {
+            return -3;
+        }
+
+        new_name = mem_alloc(&_pgs->allocator, new_name_size);
+        // Контроль успешности выделения памяти.
+        if (new_name == NULL)
+        {
+            return -4;
+        }
+        memcpy(new_name, _file_name, name_length + 1);
+    }
+
+    if (_pgs->checkpoint_name != NULL)
+    {
+        mem_free(&_pgs->allocator, _pgs->checkpoint_name, _pgs->checkpoint_name_size);
+    }
+
+    _pgs->checkpoint_name = new_name;
+    _pgs->checkpoint_name_size = new_name_size;
+    _pgs->checkpoint_interval = (new_name != NULL) ? _interval : 0;
+
+    return 1;
+}
+
+// Подключает к селекционеру транспорт миграции островной модели: селекционер становится островом _island,
+// и по ходу c_pgs_run() каждые _interval поколений _count лучших особей популяции отправляются
+// через транспорт, а полученные от других островов геномы (не более _count) замещают худших особей.
+// Транспорт не ждет другие острова: если пришельцев нет, поколение продолжается без них.
+// Каждый остров должен использовать свое зерно.
+// _migration == NULL или _interval == 0 отключает миграцию.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pgs_set_migration(c_pgs *const _pgs,
+                              const c_migration *const _migration,
+                              const size_t _island,
+                              const size_t _interval,
+                              const size_t _count)
+{
+    if (_pgs == NULL)
+    {
+        return -1;
+    }
+
+    if ( (_migration == NULL) ||
+         (_interval == 0) )
+    {
+        memset(&_pgs->migration, 0, sizeof(c_migration));
+        _pgs->migration_interval = 0;
+        return 1;
+    }
+
+    if ( (_migration->send == NULL) ||
+         (_migration->receive == NULL) )
+    {
+        return -2;
+    }
+
+    // Лучшая особь острова никогда не замещается пришельцем.
+    if ( (_count == 0) ||
+         (_count >= _pgs->pop_count) )
+    {
+        return -3;
+    }
+
+    _pgs->migration = *_migration;
+    _pgs->migration_island = _island;
+    _pgs->migration_interval = _interval;
+    _pgs->migration_count = _count;
+
+    return 1;
+}
+
+#ifdef C_PERCEPTRON_POSIX
+
+// Включает режим NUMA: геномы всех особей распределяются поровну по узлам NUMA и размещаются в их памяти,
+// создается пул из _threads_count потоков, привязанных к процессорам узлов (i-й поток - к узлу i % количество узлов),
+// на время каждого запуска обучения уроки копируются в память каждого узла.
+// Каждого потомка тестирует поток того узла, в памяти которого находится его геном; скрещивание и
+// отбор выполняются вызывающим потоком, поэтому результат обучения совпадает с результатом без режима NUMA.
+// Если узлы NUMA не найдены (или платформа не Linux), используется один узел без привязки потоков.
+// Используется не больше _threads_count узлов.
+// _threads_count == 0 выключает режим NUMA, геномы возвращаются в непрерывный блок.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0, режим селекционера не меняется.
+ptrdiff_t c_pgs_set_numa(c_pgs *const _pgs,
+                         const size_t _threads_count)
+{
+    if (_pgs == NULL)
+    {
+        return -1;
+    }
+
+    // Режим NUMA параллелит тестирование по потомкам и несовместим с параллельным тестированием по урокам.
+    if ( (_threads_count != 0) &&
+         (_pgs->lesson_workers != NULL) )
+    {
+        return -7;
+    }
+    // Геномы в файле подкачки не переносятся в память узлов.
+    if (_pgs->scratch != 0)
+    {
+        return -8;
+    }
+
+    // Геномы переносятся целиком, вместе с выравниванием.
+    const size_t genomes_count = _pgs->pop_count + _pgs->pool_count;
+    const size_t genome_stride = _pgs->genomes_size / genomes_count;
+
+    // Выключаем режим NUMA.
+    if (_threads_count == 0)
+    {
+        if (_pgs->numa == NULL)
+        {
+            return 1;
+        }
+
+        float *const new_genomes = _pgs->allocator.alloc(_pgs->allocator.context, _pgs->genomes_size, BLOCK_ALIGN);
+        // Контроль успешности выделения памяти.
+        if (new_genomes == NULL)
+        {
+            return -2;
+        }
+
+        _pgs->genomes = new_genomes;
+        c_numa_move move = {_pgs->numa, genomes_count, genome_stride};
+        _pgs->numa->pgs = _pgs;
+        pgs_genomes_move(_pgs, genome_stride, genomes_address, &move);
+
+        pgs_numa_delete(_pgs->numa);
+        _pgs->numa = NULL;
+
+        return 1;
+    }
+
+    // Ищем узлы NUMA и их процессоры.
+#ifdef __linux__
+    cpu_set_t node_cpus[NUMA_NODES_MAX];
+#else
+    char node_cpus[NUMA_NODES_MAX];
+#endif
+    size_t nodes_count = 0;
+    for (size_t n = 0; (n < NUMA_NODES_MAX) && (nodes_count < _threads_count); ++n)
+    {
+        if (numa_node_cpus(n, &node_cpus[nodes_count]) > 0)
+        {
+            ++nodes_count;
+        }
+    }
+    const int pinned = (nodes_count > 0);
+    if (nodes_count == 0)
+    {
+        nodes_count = 1;
+    }
+
+    // Определим размер режима: режим и узлы.
+    const size_t o_nodes = align_up(sizeof(c_pgs_numa), _Alignof(c_pgs_node));
+    const size_t nodes_size = sizeof(c_pgs_node) * nodes_count;
+    const size_t new_size = o_nodes + nodes_size;
+
+    // Процессоры каждого потока пула.
+#ifdef __linux__
+    cpu_set_t *affinity = NULL;
+    if (pinned != 0)
+    {
+        // Контроль целочисленного переполнения при умножении.
+        if (_threads_count > SIZE_MAX / sizeof(cpu_set_t))
+        {
+            return -3;
+        }
+        affinity = mem_alloc(&_pgs->allocator, sizeof(cpu_set_t) * _threads_count);
+        // Контроль успешности выделения памяти.
+        if (affinity == NULL)
+        {
+            return -4;
+        }
+        for (size_t w = 0; w < _threads_count; ++w)
+        {
+            affinity[w] = node_cpus[w % nodes_count];
+        }
+    }
+#else
+    void *const affinity = NULL;
+    (void)pinned;
+#endif
+
+    char *const h = _pgs->allocator.alloc(_pgs->allocator.context, new_size, BLOCK_ALIGN);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
+    {
+#ifdef __linux__
+        if (affinity != NULL)
+        {
+            mem_free(&_pgs->allocator, affinity, sizeof(cpu_set_t) * _threads_count);
+        }
+#endif
+        return -4;
+    }
+
+    // Собираем режим.
+    c_pgs_numa *const new_numa = (c_pgs_numa*)h;
+    new_numa->nodes_count = nodes_count;
+    new_numa->nodes = (c_pgs_node*)(h + o_nodes);
+    new_numa->workers = NULL;
+    new_numa->pgs = _pgs;
+    new_numa->perceptron = NULL;
+    new_numa->lessons = NULL;
+    new_numa->lessons_count = 0;
+    new_numa->job = NULL;
+    atomic_init(&new_numa->cancelled, 0);
+    new_numa->size = new_size;
+    new_numa->allocator = _pgs->allocator;
+
+    ptrdiff_t r_code = 1;
+
+    // Выделяем память под геномы узлов. Страницы не затрагиваются до привязки потоков.
+    for (size_t n = 0; n < nodes_count; ++n)
+    {
+        c_pgs_node *const node = &new_numa->nodes[n];
+        atomic_init(&node->next, 0);
+        node->lessons = NULL;
+        node->lessons_size = 0;
+
+        const size_t first = (n * genomes_count + nodes_count - 1) / nodes_count;
+        const size_t last = ((n + 1) * genomes_count + nodes_count - 1) / nodes_count;
+        node->genomes_size = genome_stride * (last - first);
+        node->genomes = NULL;
+
+        if (node->genomes_size == 0)
+        {
+            continue;
+        }
+        void *const m = mmap(NULL, node->genomes_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED)
+        {
+            r_code = -5;
+            continue;
+        }
+        node->genomes = m;
+    }
+
+    // Создаем пул потоков.
+    if (r_code > 0)
+    {
+        new_numa->workers = workers_create(&_pgs->allocator, _threads_count, affinity);
+        if (new_numa->workers == NULL)
+        {
+            r_code = -6;
+        }
+    }
+
+#ifdef __linux__
+    if (affinity != NULL)
+    {
+        mem_free(&_pgs->allocator, affinity, sizeof(cpu_set_t) * _threads_count);
+    }
+#endif
+
+    if (r_code < 0)
+    {
+        pgs_numa_delete(new_numa);
+        return r_code;
+    }
+
+    // Потоки узлов размещают страницы геномов в памяти своих узлов, затем геномы переносятся.
+    workers_run(new_numa->workers, numa_touch_task, new_numa);
+
+    c_numa_move move = {new_numa, genomes_count, genome_stride};
+    pgs_genomes_move(_pgs, genome_stride, numa_genome_address, &move);
+
+    if (_pgs->numa != NULL)
+    {
+        pgs_numa_delete(_pgs->numa);
+    } else {
+        _pgs->allocator.free(_pgs->allocator.context, _pgs->genomes, _pgs->genomes_size);
+    }
+    _pgs->genomes = NULL;
+    _pgs->numa = new_numa;
+
+    return 1;
+}
+
+#endif
+
+// Включает параллельное по урокам тестирование: каждый потомок тестируется на _threads_count потоках,
+// каждый из которых вычисляет ошибки своих блоков уроков, ошибки блоков складываются в фиксированном порядке.
+// Режим полезен при большом количестве уроков и небольшой популяции. Результат обучения не зависит от
+// количества потоков, но может отличаться от результата без этого режима из-за другого порядка сложения ошибок.
+// Если уроков слишком мало, чтобы окупить запуск потоков, блоки уроков вычисляются вызывающим потоком.
+// Несовместим с режимом NUMA (c_pgs_set_numa()).
+// _threads_count == 0 выключает режим.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pgs_set_lesson_threads(c_pgs *const _pgs,
+                                   const size_t _threads_count)
+{
+    if (_pgs == NULL)
+    {
+        return -1;
+    }
+    if ( (_threads_count != 0) &&
+         (_pgs->numa != NULL) )
+    {
+        return -2;
+    }
+
+    c_workers *new_workers = NULL;
+    if (_threads_count != 0)
+    {
+        new_workers = workers_create(&_pgs->allocator, _threads_count, NULL);
+        if (new_workers == NULL)
+        {
+            return -3;
+        }
+    }
+
+    if (_pgs->lesson_workers != NULL)
+    {
+        workers_delete(_pgs->lesson_workers);
+    }
+    _pgs->lesson_workers = new_workers;
+
+    return 1;
+}
+
+// Подключает к селекционеру профилировщик: фазы каждого поколения c_pgs_run() и c_pgs_resume()
+// учитываются в C_PROFILE_CROSS (скрещивание), C_PROFILE_EVALUATE (тестирование) и C_PROFILE_SELECT (отбор).
+// Профилировщик должен быть создан до потоков, которые выполняют обучение (c_pgs_run_async(), c_pgs_set_numa(),
+// c_pgs_set_lesson_threads()), иначе их события не попадут в счетчики.
+// Счетчики фаз суммируются по всем потокам, унаследовавшим их (см. c_profiler_create()): при c_pgs_run_async()
+// в C_PROFILE_EVALUATE попадает и работа, которую создавший профилировщик поток выполняет в это время.
+// _profiler == NULL отключает профилирование.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pgs_set_profiler(c_pgs *const _pgs,
+                             c_profiler *const _profiler)
+{
+    if (_pgs == NULL)
+    {
+        return -1;
     }
 
-    // Помещаем итоговые сигналы на выход перцептрона.
-    memcpy(_perceptron->outs, h_outs, outs_size);
+    _pgs->profiler = _profiler;
 
     return 1;
 }
 
-// Клонирует перцептрон.
-// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
-// помещается код причины ошибки (> 0).
-c_perceptron *c_perceptron_clone(const c_perceptron *const _perceptron,
-                                 size_t *const _error)
+// Проверяет аргументы запуска обучения, см. c_pgs_run().
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0 (коды совпадают с кодами c_pgs_run()).
+static ptrdiff_t pgs_run_check(const c_pgs *const _pgs,
+                               const c_perceptron *const _perceptron,
+                               const float *const _lessons,
+                               const size_t _lessons_count,
+                               const size_t _iterations_count,
+                               const uint64_t *const _seed)
 {
+    if (_pgs == NULL)
+    {
+        return -1;
+    }
     if (_perceptron == NULL)
     {
-        error_set(_error, 1);
-        return NULL;
+        return -2;
     }
 
-    // Определим, сколько памяти необходимо под тополгию.
-    const size_t new_topology_size = sizeof(size_t) * _perceptron->layers_count;
-    // Контроль целочисленного переполнения не нужен, так как
-    // это переполнение првоеряется на этапе конструирования перцептрона.
+    // Количество слоев в _perceptron и в _pgs должно совпадать.
+    if (_pgs->layers_count != _perceptron->layers_count)
+    {
+        return -3;
+    }
 
-    // Попытаемся выделить память под топологию.
-    size_t *const new_topology = malloc(new_topology_size);
+    // Топологии _perceptron и _pgs должны совпадать.
+    for (size_t l = 0; l < _pgs->layers_count; ++l)
+    {
+        if (_pgs->topology[l] != _perceptron->topology[l])
+        {
+            return -4;
+        }
+    }
+    // Опубликованная модель выполняет публикуемые геномы своими функциями активации,
+    // поэтому они должны совпадать с функциями активации _perceptron.
+    if ( (_pgs->published != NULL) &&
+         (memcmp(_pgs->published->activations, _perceptron->activations, sizeof(size_t) * _pgs->layers_count) != 0) )
+    {
+        return -4;
+    }
 
-    // Проверка успешности выделения памяти.
-    if (new_topology == NULL)
+    // Уроки должны быть заданы.
+    if (_lessons == NULL)
     {
-        error_set(_error, 2);
-        return NULL;
+        return -5;
     }
 
-    // Определим, сколько памяти необходимо под веса.
-    const size_t new_weights_size = sizeof(float) * _perceptron->weights_count;
-    // Контроль целочисленного переполнения не нужен, так как
-    // это переполнение контролируется на этапе конструирования перцептрона.
+    // Уроков должно быть больше нуля.
+    if (_lessons_count == 0)
+    {
+        return -6;
+    }
 
-    // Попытаемся выделить память под веса.
-    float *const new_weights = malloc(new_weights_size);
+    // Итераций должно быть минимум 10.
+    if (_iterations_count < 10)
+    {
+        return -7;
+    }
 
-    // Проверка успешности выделения памяти.
-    if (new_weights == NULL)
+    // Зерно должно быть задано.
+    if (_seed == NULL)
     {
-        free(new_topology);
-        error_set(_error, 3);
-        return NULL;
+        return -8;
     }
 
-    // Определим, сколько памяти необходимо под входа.
-    const size_t new_ins_size = sizeof(float) * _perceptron->topology[0];
-    // Контроль целочисленного переполнения не нужен, так как
-    // это переполнение контролируется на этапе конструирования перцептрона.
+    // Определяем сумму количества входных и выходных сигналов целевого перцептрона.
+    const size_t ins_outs_count = _perceptron->topology[0] + _perceptron->topology[_pgs->layers_count - 1];
+    // Контроль целочисленного переполнения при сложении не нужен, так как он
+    // осуществляется на этапе конструирования перцептрона, на основе которого конструируется pgs.
 
-    // Попытаемся выделить память под входа.
-    float *const new_ins = malloc(new_ins_size);
+    // Определим, сколько памяти занимают входные и выходные сигналы в сумме.
+    const size_t ins_outs_size = sizeof(float) * ins_outs_count;
+    // Контроль целочисленного переполнения не нужен, так как он
+    // осуществляется на этапе конструирования перцептрона.
 
-    // Проверка успешности выделения памяти.
-    if (new_ins == NULL)
+    // Определим, сколько памяти занимают все уроки, переданные нам.
+    const size_t lessons_size = ins_outs_size * _lessons_count;
+    // Контроль целочисленного переполнения при умножении.
+    if ( (lessons_size == 0) ||
+         (lessons_size / ins_outs_size != _lessons_count) )
     {
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 4);
-        return NULL;
+        return -9;
     }
 
-    // Определим, сколько памяти необходимо под выхода.
-    const size_t new_outs_size = sizeof(float) * _perceptron->topology[_perceptron->layers_count - 1];
-    // Контроль целочисленного переполнения не нужен, так как
-    // это переполнение контролируется на этапе конструирования перцептрона.
+    // Нужно ли контролировать возможное переполнение указателя при навигации по урокам?
+    // Стандарт крайне невнятно описывает это.
+    // ...
 
-    // Попытаемся выделить память под выхода.
-    float *const new_outs = malloc(new_outs_size);
+    return 1;
+}
 
-    // Проверка успешности выделения памяти.
-    if (new_outs == NULL)
+// Скрещивает геномы особей популяции, заполняя потомками [_first; _last) пула.
+static void pgs_cross(c_pgs *const _pgs,
+                      const size_t _first,
+                      const size_t _last,
+                      const size_t _weights_count,
+                      const float _mut_force,
+                      uint64_t *const _seed)
+{
+    // Потомок p3 - потомок пары (p1, p2), p1 != p2, в порядке перебора p1, затем p2.
+    for (size_t p3 = _first; p3 < _last; ++p3)
     {
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 5);
-        return NULL;
+        const size_t p1 = p3 / (_pgs->pop_count - 1);
+        size_t p2 = p3 % (_pgs->pop_count - 1);
+        if (p2 >= p1)
+        {
+            ++p2;
+        }
+        weights_cross_and_mut(_pgs->pop[p1].weights,
+                              _pgs->pop[p2].weights,
+                              _pgs->pool[p3].weights,
+                              _weights_count,
+                              _mut_force,
+                              _seed);
     }
+}
 
-    // Попытаемся выделить память под перцептрон.
-    c_perceptron *const new_perceptron = malloc(sizeof(c_perceptron));
+// Задача асинхронного обучения.
+// Без POSIX задачи не создаются, и селекционер всегда получает _job == NULL.
+struct s_c_pgs_job
+{
+#ifdef C_PERCEPTRON_POSIX
+    pthread_t thread;
+    int joined;
+#endif
+
+    // Защищает лучший геном популяции (pop[0]) от подмены во время снимка.
+    c_mutex mutex;
+    size_t generations_count;// Количество завершенных поколений.
+    float best_sigma;// Ошибка лучшей особи последнего поколения.
+
+    atomic_int cancel;
+    atomic_int done;
+    atomic_size_t iteration;
+    ptrdiff_t result;
+
+    c_pgs *pgs;
+    c_perceptron *perceptron;
+    const float *lessons;
+    size_t lessons_count;
+    size_t iterations_count;
+    float noise_force;
+    float mut_force;
+    uint64_t *seed;
+};
 
-    // Контроль успешности выделения памяти.
-    if (new_perceptron == NULL)
-    {
-        free(new_outs);
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 6);
-        return NULL;
-    }
+// Проверяет, запрошена ли отмена задачи.
+static int pgs_job_cancelled(c_pgs_job *const _job)
+{
+    return (_job != NULL) && (atomic_load(&_job->cancel) != 0);
+}
 
-    // Собираем перцептрон.
-    new_perceptron->layers_count = _perceptron->layers_count;
-    new_perceptron->topology = new_topology;
-    memcpy(new_topology, _perceptron->topology, new_topology_size);
-    new_perceptron->weights_count = _perceptron->weights_count;
-    new_perceptron->weights = new_weights;
-    memcpy(new_weights, _perceptron->weights, new_weights_size);
-    new_perceptron->ins = new_ins;
-    memcpy(new_ins, _perceptron->ins, new_ins_size);
-    new_perceptron->outs = new_outs;
-    memcpy(new_outs, _perceptron->outs, new_outs_size);
+#ifdef C_PERCEPTRON_POSIX
 
-    return new_perceptron;
+// Тестирует потомков, геномы которых находятся в памяти узла потока, на копии уроков узла.
+static void numa_evaluate_task(void *const _context,
+                               const size_t _worker)
+{
+    c_pgs_numa *const numa = _context;
+    c_pgs *const pgs = numa->pgs;
+    const size_t n = _worker % numa->nodes_count;
+    c_pgs_node *const node = &numa->nodes[n];
+    const float *const lessons = (node->lessons != NULL) ? node->lessons : numa->lessons;
+
+    // Потоки узла разбирают потомков по одному и пропускают потомков других узлов.
+    for (;;)
+    {
+        const size_t p = atomic_fetch_add(&node->next, 1);
+        if (p >= numa->pool_last)
+        {
+            break;
+        }
+        if (numa_genome_node(numa, pgs->pool[p].weights) != n)
+        {
+            continue;
+        }
+        if (pgs_job_cancelled(numa->job) != 0)
+        {
+            atomic_store(&numa->cancelled, 1);
+            break;
+        }
+        pgs->pool[p].sigma = weights_sigma(numa->perceptron, pgs->pool[p].weights, 0, lessons, numa->lessons_count);
+    }
 }
 
-// Сохраняет перцептрон в двоичный файл в платформозависимом формате (порядок байт и размер size_t платформозависимы).
-// Если файл с заданным именем существует, то он перезаписывается, если это возможно (если невозможно, функция вернет < 0).
-// В случае успеха возвращает > 0.
-// В случае ошибки возвращает < 0.
-ptrdiff_t c_perceptron_save(const c_perceptron *const _perceptron,
-                            const char *const _file_name)
+#endif
+
+// Тестирует потомков [_first; _last) пула на заданных уроках.
+// Если задача отменена во время тестирования, возвращает 0, иначе 1.
+static int pgs_evaluate(c_pgs *const _pgs,
+                        const size_t _first,
+                        const size_t _last,
+                        const c_perceptron *const _perceptron,
+                        const float *const _lessons,
+                        const size_t _lessons_count,
+                        c_pgs_job *const _job)
 {
-    if (_perceptron == NULL)
+#ifdef C_PERCEPTRON_POSIX
+    if (_pgs->numa != NULL)
     {
-        return -1;
+        c_pgs_numa *const numa = _pgs->numa;
+        numa->perceptron = _perceptron;
+        numa->lessons = _lessons;
+        numa->lessons_count = _lessons_count;
+        numa->pool_last = _last;
+        numa->job = _job;
+        atomic_store(&numa->cancelled, 0);
+        for (size_t n = 0; n < numa->nodes_count; ++n)
+        {
+            atomic_store(&numa->nodes[n].next, _first);
+        }
+
+        workers_run(numa->workers, numa_evaluate_task, numa);
+
+        return atomic_load(&numa->cancelled) == 0;
     }
-    if (_file_name == NULL)
+#endif
+
+    if (_pgs->lesson_workers != NULL)
     {
-        return -2;
+        c_lessons_eval eval;
+        eval.perceptron = _perceptron;
+        eval.use_csr = 0;
+        eval.lessons = _lessons;
+        eval.lessons_count = _lessons_count;
+
+        // Порядок сложения ошибок не зависит от того, используется ли пул.
+        c_workers *const workers = (lessons_parallel(_perceptron, _lessons_count,
+                                                     _pgs->lesson_workers->threads_count) != 0) ?
+                                   _pgs->lesson_workers : NULL;
+
+        for (size_t p = _first; p < _last; ++p)
+        {
+            if (pgs_job_cancelled(_job) != 0)
+            {
+                return 0;
+            }
+            eval.weights = _pgs->pool[p].weights;
+            _pgs->pool[p].sigma = lessons_sigma(&eval, workers);
+        }
+
+        return 1;
     }
-    if (strlen(_file_name) == 0)
+
+    for (size_t p = _first; p < _last; ++p)
     {
-        return -3;
+        if (pgs_job_cancelled(_job) != 0)
+        {
+            return 0;
+        }
+        _pgs->pool[p].sigma = weights_sigma(_perceptron, _pgs->pool[p].weights, 0, _lessons, _lessons_count);
     }
 
-    // Вещи, которые зависят от платформы:
-    // 1 - размер size_t;
-    // 2 - порядок size_t;
-    // 3 - порядок float.
+    return 1;
+}
 
-    FILE *f = fopen(_file_name, "wb");
+static int comp_size(const void *_p1,
+                     const void *_p2)
+{
+    const size_t s1 = *(const size_t*)_p1;
+    const size_t s2 = *(const size_t*)_p2;
+    return (s1 > s2) - (s1 < s2);
+}
 
-    // Контроль успешности открытия.
-    if (f == NULL)
+// Раздает потомкам пула свободные ячейки геномов (все, кроме ячеек популяции) в порядке их расположения
+// в файле подкачки, чтобы скрещивание писало, а тестирование читало геномы последовательно.
+// Содержимое геномов пула до скрещивания не используется, а номер потомка в пуле не меняется,
+// поэтому результат обучения не зависит от расположения геномов.
+static void pgs_scratch_order(c_pgs *const _pgs,
+                              const size_t _genome_stride)
+{
+    const size_t genomes_count = _pgs->pop_count + _pgs->pool_count;
+    char *const g = (char*)_pgs->genomes;
+
+    for (size_t p = 0; p < _pgs->pop_count; ++p)
     {
-        return -4;
+        _pgs->scratch_slots[p] = (size_t)((char*)_pgs->pop[p].weights - g) / _genome_stride;
     }
+    qsort(_pgs->scratch_slots, _pgs->pop_count, sizeof(size_t), comp_size);
 
-    int r_code;
-    // Записываем в файл количество слоев.
-    r_code = fwrite(&_perceptron->layers_count, sizeof(size_t), 1, f);
-
-    // Контроль успешности записи.
-    if (r_code != 1)
+    size_t s = 0;
+    size_t k = 0;
+    for (size_t slot = 0; slot < genomes_count; ++slot)
     {
-        fclose(f);
-        return -5;
+        if ( (s < _pgs->pop_count) &&
+             (_pgs->scratch_slots[s] == slot) )
+        {
+            ++s;
+            continue;
+        }
+        _pgs->pool[k++].weights = (float*)(g + _genome_stride * slot);
     }
-    // Записываем в файл топологию.
-    r_code = fwrite(_perceptron->topology, sizeof(size_t) * _perceptron->layers_count, 1, f);
+}
 
-    // Контроль успешности записи.
-    if (r_code != 1)
+// Просит ядро заранее прочитать с диска геномы потомков [_first; _last) пула, упорядоченного pgs_scratch_order().
+static void pgs_scratch_prefetch(const c_pgs *const _pgs,
+                                 const size_t _first,
+                                 const size_t _last,
+                                 const size_t _genome_stride)
+{
+#ifdef C_PERCEPTRON_POSIX
+    if (_first >= _last)
     {
-        fclose(f);
-        return -6;
+        return;
     }
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = (uintptr_t)_pgs->pool[_first].weights & ~(uintptr_t)(page_size - 1);
+    const uintptr_t end = (uintptr_t)_pgs->pool[_last - 1].weights + _genome_stride;
+    madvise((void*)begin, end - begin, MADV_WILLNEED);
+#else
+    (void)_pgs;
+    (void)_first;
+    (void)_last;
+    (void)_genome_stride;
+#endif
+}
 
-    // Записываем в файл количество весов.
-    r_code = fwrite(&_perceptron->weights_count, sizeof(size_t), 1, f);
+// Создает и тестирует потомков поколения.
+// В режиме файла подкачки потомки обрабатываются порциями по SCRATCH_CHUNK_SIZE байт: пока порция
+// скрещивается и тестируется, следующая порция читается с диска. Порядок вызовов ГПСЧ и
+// тестирования не зависит от порций, поэтому результат совпадает с обработкой всего пула сразу.
+// Если задача отменена во время тестирования, возвращает 0, иначе 1.
+static int pgs_generate(c_pgs *const _pgs,
+                        const c_perceptron *const _perceptron,
+                        const float *const _lessons,
+                        const size_t _lessons_count,
+                        const float _mut_force,
+                        uint64_t *const _seed,
+                        c_pgs_job *const _job)
+{
+    const size_t genome_stride = _pgs->genomes_size / (_pgs->pop_count + _pgs->pool_count);
+    size_t chunk_count = _pgs->pool_count;
+    if (_pgs->scratch != 0)
+    {
+        pgs_scratch_order(_pgs, genome_stride);
+        chunk_count = (SCRATCH_CHUNK_SIZE > genome_stride) ? SCRATCH_CHUNK_SIZE / genome_stride : 1;
+        pgs_scratch_prefetch(_pgs, 0, (chunk_count < _pgs->pool_count) ? chunk_count : _pgs->pool_count,
+                             genome_stride);
+    }
 
-    // Контроль успешности записи.
-    if (r_code != 1)
+    for (size_t first = 0; first < _pgs->pool_count; first += chunk_count)
     {
-        fclose(f);
-        return -7;
+        const size_t last = (_pgs->pool_count - first > chunk_count) ? first + chunk_count : _pgs->pool_count;
+        if (_pgs->scratch != 0)
+        {
+            const size_t next_last = (_pgs->pool_count - last > chunk_count) ? last + chunk_count : _pgs->pool_count;
+            pgs_scratch_prefetch(_pgs, last, next_last, genome_stride);
+        }
+
+        c_profile_mark mark;
+
+        // Скрещиваем геномы особей популяции.
+        profile_begin(_pgs->profiler, &mark);
+        pgs_cross(_pgs, first, last, _perceptron->weights_count, _mut_force, _seed);
+        profile_end(_pgs->profiler, C_PROFILE_CROSS, &mark);
+
+        // Тестируем каждого потомка.
+        profile_begin(_pgs->profiler, &mark);
+        const int evaluated = pgs_evaluate(_pgs, first, last, _perceptron, _lessons, _lessons_count, _job);
+        profile_end(_pgs->profiler, C_PROFILE_EVALUATE, &mark);
+        if (evaluated == 0)
+        {
+            return 0;
+        }
     }
 
-    // Записываем в файл веса.
-    r_code = fwrite(_perceptron->weights, sizeof(float) * _perceptron->weights_count, 1, f);
+    return 1;
+}
 
-    // Контроль успешности записи.
-    if (r_code != 1)
+// Сортирует потомков по возрастанию ошибки и переносит геномы лучших в популяцию.
+static void pgs_select(c_pgs *const _pgs,
+                       c_pgs_job *const _job)
+{
+    // Сортируем массив сущностей по возрастанию ошибки.
+    qsort(_pgs->pool, _pgs->pool_count, sizeof(c_weights_and_sigma), comp);
+
+    if (_job != NULL)
     {
-        fclose(f);
-        return -8;
+        mutex_lock(&_job->mutex);
     }
 
-    // Записываем в файл входные сигналы.
-    r_code = fwrite(_perceptron->ins, sizeof(float)*_perceptron->topology[0], 1, f);
+    // Отбираем из пула столько лучших, чтобы полностью заполнить популяцию.
+    for (size_t p = 0; p < _pgs->pop_count ; ++p)
+    {
+        float_ptr_swap(&_pgs->pop[p].weights, &_pgs->pool[p].weights);
+        _pgs->pop[p].sigma = _pgs->pool[p].sigma;
+    }
 
-    // Контроль успешности записи.
-    if (r_code != 1)
+    if (_job != NULL)
     {
-        fclose(f);
-        return -9;
+        ++_job->generations_count;
+        _job->best_sigma = _pgs->pool[0].sigma;
+        mutex_unlock(&_job->mutex);
     }
+}
 
-    // Записываем в файл выходные сигналы.
-    r_code = fwrite(_perceptron->outs, sizeof(float) * _perceptron->topology[_perceptron->layers_count - 1], 1, f);
+// Обменивается геномами с другими островами, см. c_pgs_set_migration().
+// Пришельцы принимаются в геномы пула, которые до следующего скрещивания не используются,
+// и подменяют худших особей популяции обменом указателей.
+static void pgs_migrate(c_pgs *const _pgs,
+                        const size_t _weights_count,
+                        const size_t _generation)
+{
+    const c_migration *const m = &_pgs->migration;
 
-    // Контроль успешности записи.
-    if (r_code != 1)
+    for (size_t p = 0; p < _pgs->migration_count; ++p)
     {
-        fclose(f);
-        return -10;
+        m->send(m->context, _pgs->migration_island, _generation,
+                _pgs->pop[p].weights, _weights_count, _pgs->pop[p].sigma);
     }
 
-    fclose(f);
+    for (size_t p = 0; p < _pgs->migration_count; ++p)
+    {
+        float sigma;
+        if (m->receive(m->context, _pgs->migration_island,
+                       _pgs->pool[p].weights, _weights_count, &sigma) <= 0)
+        {
+            break;
+        }
+
+        c_weights_and_sigma *const worst = &_pgs->pop[_pgs->pop_count - 1 - p];
+        float_ptr_swap(&worst->weights, &_pgs->pool[p].weights);
+        worst->sigma = sigma;
+    }
+}
+
+#ifdef C_PERCEPTRON_POSIX
+
+// Буфер записи в файл.
+typedef struct iovec c_iovec;
+
+// Записывает все заданные буферы в файл, продолжая после частичных записей.
+// В случае успеха возвращает 1, в случае ошибки 0.
+static int writev_all(const int _fd,
+                      struct iovec *_iov,
+                      size_t _iov_count)
+{
+    while (_iov_count > 0)
+    {
+        const int count = (_iov_count > CHECKPOINT_IOV_MAX) ? CHECKPOINT_IOV_MAX : (int)_iov_count;
+        ssize_t written = writev(_fd, _iov, count);
+        if (written < 0)
+        {
+            return 0;
+        }
+
+        // Пропускаем полностью записанные буферы и сдвигаем частично записанный.
+        while ( (_iov_count > 0) &&
+                ((size_t)written >= _iov->iov_len) )
+        {
+            written -= _iov->iov_len;
+            ++_iov;
+            --_iov_count;
+        }
+        if (written > 0)
+        {
+            _iov->iov_base = (char*)_iov->iov_base + written;
+            _iov->iov_len -= written;
+        }
+    }
 
     return 1;
 }
 
-// Загружает перцептрон из файла в платформозависимом формате (порядок байт и размер size_t платформозависимы).
-// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
-// помещается код причины ошибки (> 0).
-c_perceptron *c_perceptron_load(const char *const _file_name,
-                                size_t *const _error)
+// Записывает буферы в новый файл _file_name и сбрасывает его на диск.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0, файл удаляется.
+static ptrdiff_t buffers_write(const char *const _file_name,
+                               c_iovec *const _iov,
+                               const size_t _iov_count)
 {
-    if (_file_name == NULL)
+    const int fd = open(_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
     {
-        error_set(_error, 1);
-        return NULL;
+        return -2;
     }
-    if (strlen(_file_name) == 0)
+
+    ptrdiff_t r_code = 1;
+    if (writev_all(fd, _iov, _iov_count) == 0)
     {
-        error_set(_error, 2);
-        return NULL;
+        r_code = -3;
+    } else if (fsync(fd) != 0) {
+        r_code = -4;
+    }
+    if (close(fd) != 0)
+    {
+        r_code = -5;
+    }
+    if (r_code < 0)
+    {
+        remove(_file_name);
     }
 
-    FILE *f = fopen(_file_name, "rb");
+    return r_code;
+}
 
-    // Контроль успешности открытия.
+#else
+
+// Буфер записи в файл.
+typedef struct s_c_iovec
+{
+    void *iov_base;
+    size_t iov_len;
+} c_iovec;
+
+// Записывает буферы в новый файл _file_name средствами стандартной библиотеки.
+// Стандарт C не позволяет сбросить файл на диск, данные лишь передаются системе.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0, файл удаляется.
+static ptrdiff_t buffers_write(const char *const _file_name,
+                               c_iovec *const _iov,
+                               const size_t _iov_count)
+{
+    FILE *f = fopen(_file_name, "wb");
     if (f == NULL)
     {
-        error_set(_error, 3);
-        return NULL;
+        return -2;
     }
 
-    int r_code;
-
-    // Считываем количество слоев.
-    size_t new_layers_count;
-    r_code = fread(&new_layers_count, sizeof(size_t), 1, f);
-
-    // Контроль успешности считывания.
-    if (r_code != 1)
+    ptrdiff_t r_code = 1;
+    for (size_t i = 0; i < _iov_count; ++i)
     {
-        fclose(f);
-        error_set(_error, 4);
-        return NULL;
+        if (fwrite(_iov[i].iov_base, 1, _iov[i].iov_len, f) != _iov[i].iov_len)
+        {
+            r_code = -3;
+            break;
+        }
     }
-
-    // Проверяем число слоев на валидность.
-    if (new_layers_count < 2)
+    if ( (r_code > 0) &&
+         (fflush(f) != 0) )
     {
-        fclose(f);
-        error_set(_error, 5);
-        return NULL;
+        r_code = -4;
     }
-
-    // Определяем, сколько памяти нужно под топологию.
-    const size_t new_topology_size = sizeof(size_t) * new_layers_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_topology_size == 0) ||
-         (new_topology_size / sizeof(size_t) != new_layers_count) )
+    if (fclose(f) != 0)
     {
-        fclose(f);
-        error_set(_error, 6);
-        return NULL;
+        r_code = -5;
     }
+    if (r_code < 0)
+    {
+        remove(_file_name);
+    }
+
+    return r_code;
+}
 
-    // Пытаемся выделить память под топологию.
-    size_t *const new_topology = malloc(new_topology_size);
+#endif
 
+// Записывает контрольную точку селекционера, см. c_pgs_set_checkpoint().
+// С POSIX все части состояния записываются одним вызовом writev() (если буферов не больше CHECKPOINT_IOV_MAX).
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+static ptrdiff_t pgs_checkpoint_write(const c_pgs *const _pgs,
+                                      const size_t _weights_count,
+                                      const size_t _iterations_count,
+                                      const size_t _generation,
+                                      const uint64_t _seed,
+                                      const float _mut_force,
+                                      const float _published_sigma)
+{
+    c_pgs_checkpoint header;
+    memset(&header, 0, sizeof(c_pgs_checkpoint));
+    header.layers_count = _pgs->layers_count;
+    header.pop_count = _pgs->pop_count;
+    header.weights_count = _weights_count;
+    header.iterations_count = _iterations_count;
+    header.generation = _generation;
+    header.seed = _seed;
+    header.mut_force = _mut_force;
+    header.published_sigma = _published_sigma;
+
+    // Буферы: заголовок, топология, ошибки, геномы особей популяции; затем имя временного файла.
+    // Контроль целочисленного переполнения не нужен, так как на этапе конструирования селекционера
+    // контролируется размер массивов популяции и пула, которые больше этих массивов.
+    const size_t iov_count = 3 + _pgs->pop_count;
+    const size_t iov_size = sizeof(c_iovec) * iov_count;
+    const size_t sigmas_size = sizeof(float) * _pgs->pop_count;
+    const size_t h_size = iov_size + sigmas_size + _pgs->checkpoint_name_size;
+
+    char *const h = mem_alloc(&_pgs->allocator, h_size);
     // Контроль успешности выделения памяти.
-    if (new_topology == NULL)
+    if (h == NULL)
     {
-        fclose(f);
-        error_set(_error, 7);
-        return NULL;
+        return -1;
     }
+    c_iovec *const iov = (c_iovec*)h;
+    float *const sigmas = (float*)(h + iov_size);
+    char *const tmp_name = h + iov_size + sigmas_size;
 
-    // Попытаемся считать из файла топологию.
-    r_code = fread(new_topology, new_topology_size, 1, f);
+    for (size_t p = 0; p < _pgs->pop_count; ++p)
+    {
+        sigmas[p] = _pgs->pop[p].sigma;
+    }
 
-    // Контроль успешности считывания.
-    if (r_code != 1)
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(c_pgs_checkpoint);
+    iov[1].iov_base = _pgs->topology;
+    iov[1].iov_len = sizeof(size_t) * _pgs->layers_count;
+    iov[2].iov_base = sigmas;
+    iov[2].iov_len = sigmas_size;
+    for (size_t p = 0; p < _pgs->pop_count; ++p)
     {
-        fclose(f);
-        free(new_topology);
-        error_set(_error, 8);
-        return NULL;
+        iov[3 + p].iov_base = _pgs->pop[p].weights;
+        iov[3 + p].iov_len = sizeof(float) * _weights_count;
     }
 
-    // Контроль корректности топологии.
-    for (size_t l = 0; l < new_layers_count; ++l)
+    // Имя временного файла: "<имя>.tmp", его размер учтен в c_pgs_set_checkpoint().
+    const size_t name_length = strlen(_pgs->checkpoint_name);
+    memcpy(tmp_name, _pgs->checkpoint_name, name_length);
+    memcpy(tmp_name + name_length, ".tmp", sizeof(".tmp"));
+
+    ptrdiff_t r_code = buffers_write(tmp_name, iov, iov_count);
+
+    // Заменяем прошлую контрольную точку новой.
+    if (r_code > 0)
     {
-        if (new_topology[l] == 0)
+        int renamed = (rename(tmp_name, _pgs->checkpoint_name) == 0);
+#ifndef C_PERCEPTRON_POSIX
+        // Стандарт C не обещает, что rename() заменит существующий файл.
+        if (renamed == 0)
         {
-            fclose(f);
-            free(new_topology);
-            error_set(_error, 9);
-            return NULL;
+            remove(_pgs->checkpoint_name);
+            renamed = (rename(tmp_name, _pgs->checkpoint_name) == 0);
+        }
+#endif
+        if (renamed == 0)
+        {
+            remove(tmp_name);
+            r_code = -6;
         }
     }
 
-    // Считываем количество весов.
-    size_t new_weights_count;
-    r_code = fread(&new_weights_count, sizeof(size_t), 1, f);
+    mem_free(&_pgs->allocator, h, h_size);
 
-    // Контроль успешности считывания.
-    if (r_code != 1)
+    return r_code;
+}
+
+// Выполняет поколения генетического алгоритма с _generation по _iterations_count - 1 над текущей популяцией
+// и копирует в перцептрон геном лучшей особи.
+// Если задана задача, обучение можно отменить между поколениями и во время тестирования потомков,
+// в этом случае перцептрон получает лучший геном последнего завершенного поколения, а функция возвращает 2.
+static ptrdiff_t pgs_loop(c_pgs *const _pgs,
+                          c_perceptron *const _perceptron,
+                          const float *const _lessons,
+                          const size_t _lessons_count,
+                          const size_t _generation,
+                          const size_t _iterations_count,
+                          const float _mut_force,
+                          uint64_t *const _seed,
+                          float _published_sigma,
+                          c_pgs_job *const _job)
+{
+    int cancelled = 0;
+
+#ifdef C_PERCEPTRON_POSIX
+    // В режиме NUMA каждый узел получает свою копию уроков.
+    if (_pgs->numa != NULL)
     {
-        fclose(f);
-        free(new_topology);
-        error_set(_error, 10);
-        return NULL;
+        _pgs->numa->lessons = _lessons;
+        _pgs->numa->lessons_count = _lessons_count;
+        workers_run(_pgs->numa->workers, numa_lessons_task, _pgs->numa);
     }
+#endif
 
-    // Определяем, сколько весов должно быть у загруженной топологии.
-    size_t h_weights_count = 0;
-    for (size_t l = 1; l < new_layers_count; ++l)
+    // Выполняем итерации генетического алгоритма:
+    // - Скрещивание предков и добавление мутаций;
+    // - Тестирование каждого потомка на заданных уроках, подставляя геном потомка в заданный перцептрон;
+    // - Сортировка потомков по возрастанию их суммарной ошибки;
+    // - Перенос геномов лучших потомков в популяцию;
+    // - Повтор.
+    size_t i = _generation;
+    for (; i < _iterations_count; ++i)
     {
-        const size_t m = new_topology[l - 1] * new_topology[l];
-        // Контроль целочисленного переполнения при умножении.
-        if ( (m == 0) ||
-             (m / new_topology[l - 1] != new_topology[l]) )
+        // Состояние ГПСЧ перед поколением нужно для контрольной точки при отмене.
+        const uint64_t generation_seed = *_seed;
+
+        if (pgs_job_cancelled(_job) != 0)
         {
-            fclose(f);
-            free(new_topology);
-            error_set(_error, 11);
-            return NULL;
+            cancelled = 1;
+            break;
         }
-        const size_t s = h_weights_count + m;
-        // Контроль целочисленного переполнения при сложении.
-        if (s < h_weights_count)
+
+        // Скрещиваем геномы особей популяции и тестируем каждого потомка.
+        const int evaluated = pgs_generate(_pgs, _perceptron, _lessons, _lessons_count, _mut_force, _seed, _job);
+        if (evaluated == 0)
         {
-            fclose(f);
-            free(new_topology);
-            error_set(_error, 11);
-            return NULL;
+            // Популяция не изменилась, откатываем ГПСЧ к началу незавершенного поколения.
+            *_seed = generation_seed;
+            cancelled = 1;
+            break;
+        }
+
+        // Отбираем лучших потомков в популяцию.
+        c_profile_mark mark;
+        profile_begin(_pgs->profiler, &mark);
+        pgs_select(_pgs, _job);
+        profile_end(_pgs->profiler, C_PROFILE_SELECT, &mark);
+
+        // Публикуем лучший геном, если он лучше опубликованного.
+        if ( (_pgs->published != NULL) &&
+             (_pgs->pool[0].sigma < _published_sigma) )
+        {
+            if (published_publish_weights(_pgs->published, NULL, _pgs->pop[0].weights) > 0)
+            {
+                _published_sigma = _pgs->pool[0].sigma;
+            }
+        }
+
+        // Обмениваемся геномами с другими островами.
+        if ( (_pgs->migration_interval != 0) &&
+             ((i + 1) % _pgs->migration_interval == 0) )
+        {
+            pgs_migrate(_pgs, _perceptron->weights_count, i + 1);
+        }
+
+        // Записываем контрольную точку.
+        if ( (_pgs->checkpoint_interval != 0) &&
+             ((i + 1) % _pgs->checkpoint_interval == 0) &&
+             (i + 1 < _iterations_count) )
+        {
+            pgs_checkpoint_write(_pgs, _perceptron->weights_count, _iterations_count, i + 1,
+                                 *_seed, _mut_force, _published_sigma);
+        }
+
+        if (_job != NULL)
+        {
+            atomic_store(&_job->iteration, i + 1);
         }
-        h_weights_count += m;
+
+        // Показываем суммарную ошибку самой умной сети.
+        //printf("sigma: %f\n", _pgs->pool[0].sigma);
     }
 
-    // Проверяем, совпадает ли это число, с загруженным из файла.
-    if (h_weights_count != new_weights_count)
+    // При отмене сохраняем последнее завершенное поколение.
+    if ( (cancelled != 0) &&
+         (_pgs->checkpoint_interval != 0) )
     {
-        fclose(f);
-        free(new_topology);
-        error_set(_error, 12);
-        return NULL;
+        pgs_checkpoint_write(_pgs, _perceptron->weights_count, _iterations_count, i,
+                             *_seed, _mut_force, _published_sigma);
     }
 
-    // Определим размер весов, которые необходимо загрузить из файла.
-    const size_t new_weights_size = sizeof(float) * new_weights_count;
-
-    // Контроль целочисленного переполнения при умножении.
-    if (new_weights_size < sizeof(float))
+#ifdef C_PERCEPTRON_POSIX
+    if (_pgs->numa != NULL)
     {
-        fclose(f);
-        free(new_topology);
-        error_set(_error, 13);
-        return NULL;
+        numa_lessons_release(_pgs->numa);
     }
+#endif
 
-    // Попытаемся выделить память под веса.
-    float *const new_weights = malloc(new_weights_size);
+    // Копируем в перцептрон веса (геном) лучшей особи популяции.
+    // Перцептрон продолжает владеть своим массивом весов, который мог быть выделен не селекционером.
+    memcpy(_perceptron->weights, _pgs->pop[0].weights, sizeof(float) * _perceptron->weights_count);
+    weights_changed(_perceptron);
 
-    // Контроль успешности выделения памяти.
-    if (new_weights == NULL)
+    return (cancelled != 0) ? 2 : 1;
+}
+
+// Заполняет начальную популяцию: одна особь получает геном заданного перцептрона,
+// геномы остальных особей заполняются шумом.
+static void pgs_init(c_pgs *const _pgs,
+                     const c_perceptron *const _perceptron,
+                     const float _noise_force,
+                     uint64_t *const _seed)
+{
+    memcpy(_pgs->pop[0].weights, _perceptron->weights, sizeof(float) * _perceptron->weights_count);
+    for (size_t p = 1; p < _pgs->pop_count; ++p)
     {
-        fclose(f);
-        free(new_topology);
-        error_set(_error, 14);
-        return NULL;
+        weights_noise(_pgs->pop[p].weights, _perceptron->weights_count, _noise_force, _seed);
     }
+}
 
-    // Попытаемся считать веса из файла.
-    r_code = fread(new_weights, new_weights_size, 1, f);
+// Выполняет обучение, см. c_pgs_run() и pgs_loop().
+static ptrdiff_t pgs_run(c_pgs *const _pgs,
+                         c_perceptron *const _perceptron,
+                         const float *const _lessons,
+                         const size_t _lessons_count,
+                         const size_t _iterations_count,
+                         const float _noise_force,
+                         const float _mut_force,
+                         uint64_t *const _seed,
+                         c_pgs_job *const _job)
+{
+    const ptrdiff_t r_code = pgs_run_check(_pgs, _perceptron, _lessons, _lessons_count, _iterations_count, _seed);
+    if (r_code < 0)
+    {
+        return r_code;
+    }
 
-    // Контроль успешности считывания.
-    if (r_code != 1)
+    // Обучение изменит веса перцептрона, поэтому разделяемые веса копируются заранее.
+    if (weights_unshare(_perceptron) < 0)
     {
-        fclose(f);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 15);
-        return NULL;
+        return -10;
     }
 
-    // Определим, сколько памяти нужно под входа перцептрона.
-    const size_t new_ins_size = sizeof(float) * new_topology[0];
+    pgs_init(_pgs, _perceptron, _noise_force, _seed);
 
-    // Контроль целочисленного переполнения при сложении.
-    if (new_ins_size < sizeof(float))
+    // Наименьшая ошибка, опубликованная за этот запуск, еще не определена.
+    return pgs_loop(_pgs, _perceptron, _lessons, _lessons_count, 0, _iterations_count,
+                    _mut_force, _seed, INFINITY, _job);
+}
+
+// Запускает процесс обучения заданного перцептрона.
+// Селекционер должен быть совместим с перцептроном.
+// Уроки должны храниться в виде: ins outs ins outs...
+// Уроки должны хранить достаточное количество сигналов.
+// В случае успеха возвращает > 0, перцептрон меняет состояние весов.
+// В случае ошибки возвращает < 0, перцептрон не меняет состояние весов.
+ptrdiff_t c_pgs_run(c_pgs *const _pgs,
+                    c_perceptron *const _perceptron,
+                    const float *const _lessons,
+                    const size_t _lessons_count,
+                    const size_t _iterations_count,
+                    const float _noise_force,
+                    const float _mut_force,
+                    uint64_t *const _seed)
+{
+    return pgs_run(_pgs, _perceptron, _lessons, _lessons_count, _iterations_count,
+                   _noise_force, _mut_force, _seed, NULL);
+}
+
+// Продолжает обучение из контрольной точки, записанной селекционером с той же топологией и
+// размером популяции (см. c_pgs_set_checkpoint()).
+// Количество итераций и сила мутации берутся из контрольной точки, состояние ГПСЧ из контрольной точки
+// помещается в *_seed, по завершении *_seed содержит итоговое состояние.
+// При тех же уроках результат (веса перцептрона и зерно) побитово совпадает с результатом непрерывного c_pgs_run().
+// В случае успеха возвращает > 0, перцептрон меняет состояние весов.
+// В случае ошибки возвращает < 0, перцептрон не меняет состояние весов:
+// -1..-9 - как у c_pgs_run(), -10 - не удалось обособить веса, -11..-15 - ошибки контрольной точки.
+ptrdiff_t c_pgs_resume(c_pgs *const _pgs,
+                       c_perceptron *const _perceptron,
+                       const float *const _lessons,
+                       const size_t _lessons_count,
+                       const char *const _file_name,
+                       uint64_t *const _seed)
+{
+    if ( (_file_name == NULL) ||
+         (strlen(_file_name) == 0) )
     {
-        fclose(f);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 16);
-        return NULL;
+        return -11;
     }
 
-    // Попытаемся выделить память под входа перцептрона.
-    float *const new_ins = malloc(new_ins_size);
+    FILE *f = fopen(_file_name, "rb");
 
-    // Контроль успешности выделения памяти.
-    if (new_ins == NULL)
+    // Контроль успешности открытия.
+    if (f == NULL)
     {
-        fclose(f);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 17);
-        return NULL;
+        return -12;
     }
 
-    // Попытаемся считать входа.
-    r_code = fread(new_ins, new_ins_size, 1, f);
-
-    // Контроль успешности считывания.
-    if (r_code != 1)
+    // Читаем заголовок.
+    c_pgs_checkpoint header;
+    if (fread(&header, sizeof(c_pgs_checkpoint), 1, f) != 1)
     {
         fclose(f);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 18);
-        return NULL;
+        return -13;
     }
 
-    // Определим, сколько памяти нужно под выхода перцептрона.
-    const size_t new_outs_size = sizeof(float) * new_topology[new_layers_count - 1];
-
-    // Контроль целочисленного переполнения при сложении.
-    if ( (new_outs_size == 0) ||
-         (new_outs_size / sizeof(float) != new_topology[new_layers_count - 1]) )
+    const ptrdiff_t r_code = pgs_run_check(_pgs, _perceptron, _lessons, _lessons_count, header.iterations_count, _seed);
+    if (r_code < 0)
     {
         fclose(f);
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 19);
-        return NULL;
+        return r_code;
     }
 
-    // Попытаемся выделить память под выхода.
-    float *const new_outs = malloc(new_outs_size);
-
-    // Контроль успешности выделения памяти.
-    if (new_outs == NULL)
+    // Контрольная точка должна быть записана селекционером с той же топологией и популяцией.
+    if ( (header.layers_count != _pgs->layers_count) ||
+         (header.pop_count != _pgs->pop_count) ||
+         (header.weights_count != _perceptron->weights_count) ||
+         (header.generation > header.iterations_count) )
     {
         fclose(f);
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 20);
-        return NULL;
+        return -14;
+    }
+    for (size_t l = 0; l < header.layers_count; ++l)
+    {
+        size_t layer_size;
+        if ( (fread(&layer_size, sizeof(size_t), 1, f) != 1) ||
+             (layer_size != _pgs->topology[l]) )
+        {
+            fclose(f);
+            return -14;
+        }
     }
 
-    // Попытаемся считать выхода.
-    r_code = fread(new_outs, new_outs_size, 1, f);
-
-    // Контроль успешности считывания.
-    if (r_code != 1)
+    if (weights_unshare(_perceptron) < 0)
     {
         fclose(f);
-        free(new_outs);
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 21);
-        return NULL;
+        return -10;
     }
 
-    fclose(f);
-
-    // Попытаемся выделить память под перцептрон.
-    c_perceptron *const new_perceptron = malloc(sizeof(c_perceptron));
-
-    // Контроль успешности выделения памяти.
-    if (new_perceptron == NULL)
+    // Читаем ошибки и геномы особей популяции.
+    for (size_t p = 0; p < _pgs->pop_count; ++p)
     {
-        free(new_outs);
-        free(new_ins);
-        free(new_weights);
-        free(new_topology);
-        error_set(_error, 22);
-        return NULL;
+        if (fread(&_pgs->pop[p].sigma, sizeof(float), 1, f) != 1)
+        {
+            fclose(f);
+            return -15;
+        }
+    }
+    for (size_t p = 0; p < _pgs->pop_count; ++p)
+    {
+        if (fread(_pgs->pop[p].weights, sizeof(float) * header.weights_count, 1, f) != 1)
+        {
+            fclose(f);
+            return -15;
+        }
     }
 
-    // Собираем перцептрон.
-    new_perceptron->layers_count = new_layers_count;
-    new_perceptron->topology = new_topology;
-    new_perceptron->weights_count = new_weights_count;
-    new_perceptron->weights = new_weights;
-    new_perceptron->ins = new_ins;
-    new_perceptron->outs = new_outs;
+    fclose(f);
 
-    return new_perceptron;
+    *_seed = header.seed;
+
+    return pgs_loop(_pgs, _perceptron, _lessons, _lessons_count, header.generation, header.iterations_count,
+                    header.mut_force, _seed, header.published_sigma, NULL);
 }
 
-// Создает перцептронного генетического селекционера.
-// Популяция должна быть >= 10.
-// В случае ошибки возвращает NULL, и если _error != NULL,
-// в заданное расположение помещается код причины ошибки (> 0).
-c_pgs *c_pgs_create(const c_perceptron *const _perceptron,
-                    const size_t _pop_count,
-                    size_t *const _error)
+#ifdef C_PERCEPTRON_POSIX
+
+// Поток асинхронного обучения.
+static void *pgs_job_thread(void *const _job)
 {
-    if (_perceptron == NULL)
-    {
-        error_set(_error, 1);
-        return NULL;
-    }
-    if (_pop_count < 10)
-    {
-        error_set(_error, 2);
-        return NULL;
-    }
+    c_pgs_job *const job = _job;
 
-    // Определим, сколько памяти необходимо под топологию.
-    const size_t new_topology_size = sizeof(size_t) * _perceptron->layers_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_topology_size == 0) ||
-         (new_topology_size / sizeof(size_t) != _perceptron->layers_count) )
-    {
-        error_set(_error, 3);
-        return NULL;
-    }
+    job->result = pgs_run(job->pgs, job->perceptron, job->lessons, job->lessons_count, job->iterations_count,
+                          job->noise_force, job->mut_force, job->seed, job);
+    atomic_store(&job->done, 1);
 
-    // Попытаемся выделить память под топологию.
-    size_t *const new_topology = malloc(new_topology_size);
-    // Контроль успешности выделения памяти.
-    if (new_topology == NULL)
+    return NULL;
+}
+
+// Запускает процесс обучения заданного перцептрона в фоновом потоке, см. c_pgs_run().
+// До завершения задачи (c_pgs_job_wait() или c_pgs_job_delete()) селекционер, перцептрон, уроки и зерно
+// принадлежат задаче: их нельзя изменять, удалять или использовать в других вызовах
+// (кроме снимка лучших весов через c_pgs_job_snapshot()).
+// В случае ошибки возвращает NULL, и если _error != NULL, в заданное расположение
+// помещается код причины ошибки (> 0): для ошибок аргументов - модуль кода ошибки c_pgs_run().
+c_pgs_job *c_pgs_run_async(c_pgs *const _pgs,
+                           c_perceptron *const _perceptron,
+                           const float *const _lessons,
+                           const size_t _lessons_count,
+                           const size_t _iterations_count,
+                           const float _noise_force,
+                           const float _mut_force,
+                           uint64_t *const _seed,
+                           size_t *const _error)
+{
+    const ptrdiff_t r_code = pgs_run_check(_pgs, _perceptron, _lessons, _lessons_count, _iterations_count, _seed);
+    if (r_code < 0)
     {
-        error_set(_error, 4);
+        error_set(_error, -r_code);
         return NULL;
     }
 
-    // Определим, сколько памяти необходимо под популяцию.
-    const size_t new_pop_size = sizeof(c_weights_and_sigma) * _pop_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_pop_size == 0) ||
-         (new_pop_size / sizeof(c_weights_and_sigma) != _pop_count) )
+    // Пытаемся выделить память под задачу.
+    c_pgs_job *const new_job = mem_alloc(&_pgs->allocator, sizeof(c_pgs_job));
+    // Контроль успешности выделения памяти.
+    if (new_job == NULL)
     {
-        free(new_topology);
-        error_set(_error, 5);
+        error_set(_error, 11);
         return NULL;
     }
 
-    // Попытаемся выделить память под популяцию.
-    c_weights_and_sigma *const new_pop = malloc(new_pop_size);
-    // Контроль успешности выделения памяти.
-    if (new_pop == NULL)
+    // Собираем задачу.
+    new_job->joined = 0;
+    new_job->generations_count = 0;
+    new_job->best_sigma = INFINITY;
+    atomic_init(&new_job->cancel, 0);
+    atomic_init(&new_job->done, 0);
+    atomic_init(&new_job->iteration, 0);
+    new_job->result = 0;
+    new_job->pgs = _pgs;
+    new_job->perceptron = _perceptron;
+    new_job->lessons = _lessons;
+    new_job->lessons_count = _lessons_count;
+    new_job->iterations_count = _iterations_count;
+    new_job->noise_force = _noise_force;
+    new_job->mut_force = _mut_force;
+    new_job->seed = _seed;
+
+    if (mutex_init(&new_job->mutex) == 0)
     {
-        free(new_topology);
-        error_set(_error, 6);
+        mem_free(&_pgs->allocator, new_job, sizeof(c_pgs_job));
+        error_set(_error, 12);
         return NULL;
     }
 
-    // Определим количество мест в пуле.
-    size_t new_pool_count = _pop_count * _pop_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_pool_count == 0) ||
-         (new_pool_count / _pop_count != _pop_count) )
+    // Запускаем поток.
+    if (pthread_create(&new_job->thread, NULL, pgs_job_thread, new_job) != 0)
     {
-        free(new_pop);
-        free(new_topology);
-        error_set(_error, 7);
+        mutex_destroy(&new_job->mutex);
+        mem_free(&_pgs->allocator, new_job, sizeof(c_pgs_job));
+        error_set(_error, 13);
         return NULL;
     }
-    new_pool_count -= _pop_count;
 
-    // Определим, сколько памяти необходимо под пул.
-    const size_t new_pool_size = sizeof(c_weights_and_sigma) * new_pool_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_pool_size == 0) ||
-         (new_pool_size / sizeof(c_weights_and_sigma) != new_pool_count) )
+    return new_job;
+}
+
+// Возвращает количество завершенных итераций задачи.
+// В случае, если _job == NULL, возвращает 0.
+size_t c_pgs_job_get_iteration(c_pgs_job *const _job)
+{
+    if (_job == NULL)
     {
-        free(new_pop);
-        free(new_topology);
-        error_set(_error, 8);
-        return NULL;
+        return 0;
     }
 
-    // Попытаемся выделить память под пул.
-    c_weights_and_sigma *const new_pool = malloc(new_pool_size);
-    // Контроль успешности выделения памяти.
-    if (new_pool == NULL)
+    return atomic_load(&_job->iteration);
+}
+
+// Возвращает суммарную ошибку лучшей особи последнего завершенного поколения.
+// Если ни одно поколение еще не завершено или _job == NULL, возвращает INFINITY.
+float c_pgs_job_get_sigma(c_pgs_job *const _job)
+{
+    if (_job == NULL)
     {
-        free(new_pop);
-        free(new_topology);
-        error_set(_error, 9);
-        return NULL;
+        return INFINITY;
     }
 
-    // Определим, сколько памяти занимают все веса перцептрона.
-    const size_t new_weights_size = sizeof(float) * _perceptron->weights_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (new_weights_size == 0) ||
-         (new_weights_size / sizeof(float) != _perceptron->weights_count) )
+    mutex_lock(&_job->mutex);
+    const float sigma = _job->best_sigma;
+    mutex_unlock(&_job->mutex);
+
+    return sigma;
+}
+
+// Проверяет, завершилась ли задача.
+// Возвращает > 0, если завершилась, 0, если еще выполняется, < 0 в случае ошибки.
+ptrdiff_t c_pgs_job_is_done(c_pgs_job *const _job)
+{
+    if (_job == NULL)
     {
-        free(new_pool);
-        free(new_pop);
-        free(new_topology);
-        error_set(_error, 10);
-        return NULL;
+        return -1;
     }
 
-    // Обеспечиваем весами каждую сущность популяции.
-    for (size_t p = 0; p < _pop_count; ++p)
+    return atomic_load(&_job->done) != 0;
+}
+
+// Копирует в заданный перцептрон веса лучшей особи последнего завершенного поколения.
+// Снимок согласован: поколение не может смениться во время копирования.
+// Перцептрон должен иметь топологию селекционера и не должен принадлежать задаче.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0, перцептрон не меняет состояние весов.
+ptrdiff_t c_pgs_job_snapshot(c_pgs_job *const _job,
+                             c_perceptron *const _perceptron)
+{
+    if (_job == NULL)
     {
-        // Пытаемся выделить память под веса.
-        float *const new_weights = malloc(new_weights_size);
-        // Контроль успешности выделения памяти.
-        if (new_weights == NULL)
-        {
-            for (size_t d = 0; d < p; ++d)
-            {
-                free(new_pop[d].weights);
-            }
-            free(new_pool);
-            free(new_pop);
-            free(new_topology);
-            error_set(_error, 11);
-            return NULL;
-        }
-        new_pop[p].weights = new_weights;
+        return -1;
+    }
+    if ( (_perceptron == NULL) ||
+         (_perceptron == _job->perceptron) )
+    {
+        return -2;
     }
 
-    // Обеспечиваем весами каждую сущность пула.
-    for (size_t p = 0; p < new_pool_count; ++p)
+    // Топология перцептрона должна совпадать с топологией селекционера.
+    if (_perceptron->layers_count != _job->pgs->layers_count)
+    {
+        return -3;
+    }
+    for (size_t l = 0; l < _perceptron->layers_count; ++l)
     {
-        // Пытаемся выделить память под веса.
-        float *const new_weights = malloc(new_weights_size);
-        // Контроль успещности выделения памяти.
-        if (new_weights == NULL)
+        if (_perceptron->topology[l] != _job->pgs->topology[l])
         {
-            for (size_t d = 0; d < p; ++d)
-            {
-                free(new_pool[d].weights);
-            }
-            for (size_t d = 0; d < _pop_count; ++d)
-            {
-                free(new_pop[d].weights);
-            }
-            free(new_pool);
-            free(new_pop);
-            free(new_topology);
-            error_set(_error, 12);
-            return NULL;
+            return -3;
         }
-        new_pool[p].weights = new_weights;
     }
 
-    // Пытаемся выделить память под c_pgs.
-    c_pgs *const new_pgs = malloc(sizeof(c_pgs));
-    // Контроль успешности выделения памяти.
-    if (new_pgs == NULL)
+    mutex_lock(&_job->mutex);
+
+    // До завершения первого поколения лучшего генома еще нет.
+    if (_job->generations_count == 0)
     {
-        for (size_t d = 0; d < new_pool_count; ++d)
-        {
-            free(new_pool[d].weights);
-        }
-        for (size_t d = 0; d < _pop_count; ++d)
-        {
-            free(new_pop[d].weights);
-        }
-        free(new_pool);
-        free(new_pop);
-        free(new_topology);
-        error_set(_error, 13);
-        return NULL;
+        mutex_unlock(&_job->mutex);
+        return -4;
     }
 
-    // Собираем c_pgs.
-    new_pgs->layers_count = _perceptron->layers_count;
-    new_pgs->topology = new_topology;
-    memcpy(new_topology, _perceptron->topology, new_topology_size);
-    new_pgs->pop_count = _pop_count;
-    new_pgs->pop = new_pop;
-    new_pgs->pool_count = new_pool_count;
-    new_pgs->pool = new_pool;
+    const ptrdiff_t r_code = c_perceptron_set_weights(_perceptron, _job->pgs->pop[0].weights,
+                                                      _perceptron->weights_count);
 
-    return new_pgs;
+    mutex_unlock(&_job->mutex);
+
+    if (r_code < 0)
+    {
+        return -5;
+    }
+
+    return 1;
 }
 
-// Удаляет перцептронного генетического селекционера.
+// Запрашивает отмену задачи.
+// Обучение прекращается в ближайшей точке проверки (между поколениями или между потомками),
+// перцептрон получает лучший геном последнего завершенного поколения.
 // В случае успеха возвращает > 0.
 // В случае ошибки возвращает < 0.
-ptrdiff_t c_pgs_delete(c_pgs *const _pgs)
+ptrdiff_t c_pgs_job_cancel(c_pgs_job *const _job)
 {
-    if (_pgs == NULL)
+    if (_job == NULL)
     {
         return -1;
     }
 
-    for (size_t p = 0; p < _pgs->pool_count; ++p)
+    atomic_store(&_job->cancel, 1);
+
+    return 1;
+}
+
+// Дожидается завершения задачи.
+// Возвращает результат обучения: код c_pgs_run(), или 2, если обучение было отменено.
+// В случае ошибки самой функции возвращает < 0 (-100).
+ptrdiff_t c_pgs_job_wait(c_pgs_job *const _job)
+{
+    if (_job == NULL)
     {
-        free(_pgs->pool[p].weights);
+        return -100;
     }
-    for (size_t p = 0; p < _pgs->pop_count; ++p)
+
+    if (_job->joined == 0)
+    {
+        pthread_join(_job->thread, NULL);
+        _job->joined = 1;
+    }
+
+    return _job->result;
+}
+
+// Отменяет задачу, дожидается ее завершения и удаляет ее.
+// В случае успеха возвращает > 0.
+// В случае ошибки возвращает < 0.
+ptrdiff_t c_pgs_job_delete(c_pgs_job *const _job)
+{
+    if (_job == NULL)
     {
-        free(_pgs->pop[p].weights);
+        return -1;
     }
-    free(_pgs->pool);
-    free(_pgs->pop);
-    free(_pgs->topology);
 
-    free(_pgs);
+    c_pgs_job_cancel(_job);
+    c_pgs_job_wait(_job);
+
+    mutex_destroy(&_job->mutex);
+
+    // Распределитель копируется, так как задача может пережить его владельца не дольше этого вызова.
+    const c_allocator allocator = _job->pgs->allocator;
+    mem_free(&allocator, _job, sizeof(c_pgs_job));
 
     return 1;
 }
 
-// Запускает процесс обучения заданного перцептрона.
-// Селекционер должен быть совместим с перцептроном.
-// Уроки должны храниться в виде: ins outs ins outs...
-// Уроки должны хранить достаточное количество сигналов.
-// В случае успеха возвращает > 0, перцептрон меняет состояние весов.
+#endif
+
+// --------------------
+
+// Прогон одной конфигурации перебора: собственные перцептрон, селекционер и ГПСЧ.
+typedef struct s_c_sweep_run
+{
+    c_perceptron *perceptron;
+    c_pgs *pgs;
+    uint64_t seed;
+    size_t generation;// Завершенных поколений.
+    uint64_t elapsed_ns;
+} c_sweep_run;
+
+// Очередь прогонов рабочего на ступени: диапазон [begin; end) массива order, упакованный
+// в одно слово (begin - младшие 32 бита, end - старшие), чтобы владелец и воры забирали прогоны одним CAS.
+typedef struct s_c_sweep_deque
+{
+    _Alignas(BLOCK_ALIGN) atomic_uint_least64_t range;
+} c_sweep_deque;
+
+// Перебор конфигураций, см. c_pgs_sweep().
+typedef struct s_c_sweep
+{
+    const c_sweep_config *configs;
+    c_sweep_run *runs;
+    size_t *order;// Номера конфигураций ступени, разложенные по очередям рабочих.
+    c_sweep_deque *deques;
+    size_t threads_count;
+
+    const float *lessons;
+    size_t lessons_count;
+    size_t target;// Поколение, до которого ступень обучает прогоны.
+} c_sweep;
+
+// Забирает из очереди номер прогона: владелец - из начала, вор - из конца.
+// Возвращает 1, если номер получен, 0, если очередь пуста.
+static int sweep_take(c_sweep_deque *const _deque,
+                      const int _own,
+                      size_t *const _index)
+{
+    uint_least64_t range = atomic_load_explicit(&_deque->range, memory_order_relaxed);
+    for (;;)
+    {
+        const uint_least64_t begin = range & 0xFFFFFFFFu;
+        const uint_least64_t end = range >> 32;
+        if (begin >= end)
+        {
+            return 0;
+        }
+        const uint_least64_t next = (_own != 0) ? ((end << 32) | (begin + 1)) : (((end - 1) << 32) | begin);
+        if (atomic_compare_exchange_weak_explicit(&_deque->range, &range, next,
+                                                  memory_order_acq_rel, memory_order_relaxed) != 0)
+        {
+            *_index = (size_t)((_own != 0) ? begin : end - 1);
+            return 1;
+        }
+    }
+}
+
+// Задача пула: рабочий обучает прогоны своей очереди, затем ворует прогоны из очередей остальных рабочих.
+static void sweep_task(void *const _context,
+                       const size_t _worker)
+{
+    c_sweep *const sweep = _context;
+
+    for (size_t v = 0; v < sweep->threads_count; ++v)
+    {
+        c_sweep_deque *const deque = &sweep->deques[(_worker + v) % sweep->threads_count];
+        size_t index;
+        while (sweep_take(deque, v == 0, &index) != 0)
+        {
+            const size_t c = sweep->order[index];
+            c_sweep_run *const run = &sweep->runs[c];
+
+            const uint64_t started = monotonic_ns();
+            pgs_loop(run->pgs, run->perceptron, sweep->lessons, sweep->lessons_count, run->generation, sweep->target,
+                     sweep->configs[c].mut_force, &run->seed, INFINITY, NULL);
+            run->elapsed_ns += monotonic_ns() - started;
+            run->generation = sweep->target;
+        }
+    }
+}
+
+// Ошибка прогона для отбора: лучшая ошибка популяции, при равенстве раньше идет меньший номер конфигурации.
+static int sweep_comp(const c_sweep *const _sweep,
+                      const size_t _c1,
+                      const size_t _c2)
+{
+    const float s1 = _sweep->runs[_c1].pgs->pop[0].sigma;
+    const float s2 = _sweep->runs[_c2].pgs->pop[0].sigma;
+    if (s1 != s2)
+    {
+        return (s1 < s2) ? -1 : 1;
+    }
+    return (_c1 < _c2) ? -1 : 1;
+}
+
+// Удаляет перцептрон и селекционер прогона.
+static void sweep_run_release(c_sweep_run *const _run)
+{
+    c_pgs_delete(_run->pgs);
+    c_perceptron_delete(_run->perceptron);
+    _run->pgs = NULL;
+    _run->perceptron = NULL;
+}
+
+// Обучает перцептрон с каждой из _configs_count конфигураций (размер популяции, силы шума и мутации, зерно)
+// на одних и тех же уроках, параллельно на _threads_count потоках. Прогоны распределяются по очередям
+// потоков (сначала с большими популяциями), освободившийся поток ворует прогоны из чужих очередей.
+// Все прогоны читают один и тот же массив уроков, не копируя его.
+// Слабые конфигурации отсеиваются последовательным делением пополам: обучение идет _rungs_count ступенями,
+// ступень r обучает оставшиеся конфигурации до поколения _iterations_count / 2^(_rungs_count - 1 - r),
+// после каждой ступени, кроме последней, остается лучшая половина (по наименьшей ошибке, с округлением вверх).
+// _rungs_count == 1 обучает все конфигурации на полное количество итераций.
+// Продолжение обучения на следующей ступени побитово совпадает с непрерывным c_pgs_run(), поэтому
+// результаты не зависят от количества потоков.
+// Для каждой конфигурации в _results помещается ошибка, время обучения, количество поколений и последняя ступень,
+// а перцептрон получает веса лучшей конфигурации последней ступени.
+// В случае успеха возвращает номер лучшей конфигурации + 1 (> 0).
 // В случае ошибки возвращает < 0, перцептрон не меняет состояние весов.
-ptrdiff_t c_pgs_run(c_pgs *const _pgs,
-                    c_perceptron *const _perceptron,
-                    const float *const _lessons,
-                    const size_t _lessons_count,
-                    const size_t _iterations_count,
-                    const float _noise_force,
-                    const float _mut_force,
-                    uint64_t *const _seed)
+ptrdiff_t c_pgs_sweep(c_perceptron *const _perceptron,
+                      const float *const _lessons,
+                      const size_t _lessons_count,
+                      const c_sweep_config *const _configs,
+                      const size_t _configs_count,
+                      const size_t _iterations_count,
+                      const size_t _rungs_count,
+                      const size_t _threads_count,
+                      c_sweep_result *const _results)
 {
-    if (_pgs == NULL)
+    if (_perceptron == NULL)
     {
         return -1;
     }
-    if (_perceptron == NULL)
+    if ( (_configs == NULL) ||
+         (_configs_count == 0) ||
+         (_configs_count > UINT32_MAX) )
     {
         return -2;
     }
-
-    // Количество слоев в _perceptron и в _pgs должно совпадать.
-    if (_pgs->layers_count != _perceptron->layers_count)
+    if ( (_rungs_count == 0) ||
+         (_rungs_count > 32) ||
+         ((_iterations_count >> (_rungs_count - 1)) == 0) )
     {
         return -3;
     }
-
-    // Топологии _perceptron и _pgs должны совпадать.
-    for (size_t l = 0; l < _pgs->layers_count; ++l)
+    if (_results == NULL)
     {
-        if (_pgs->topology[l] != _perceptron->topology[l])
+        return -4;
+    }
+    for (size_t c = 0; c < _configs_count; ++c)
+    {
+        if ( (isfinite(_configs[c].noise_force) == 0) ||
+             (isfinite(_configs[c].mut_force) == 0) )
         {
-            return -4;
+            return -5;
         }
     }
 
-    // Уроки должны быть заданы.
-    if (_lessons == NULL)
-    {
-        return -5;
-    }
+    const size_t threads_count = (_threads_count > _configs_count) ? _configs_count :
+                                 (_threads_count != 0) ? _threads_count : 1;
 
-    // Уроков должно быть больше нуля.
-    if (_lessons_count == 0)
+    // Определим размер перебора: перебор, прогоны, порядок, ранжирование, очереди.
+    const size_t o_runs = align_up(sizeof(c_sweep), _Alignof(c_sweep_run));
+    const size_t o_order = align_up(o_runs + sizeof(c_sweep_run) * _configs_count, _Alignof(size_t));
+    const size_t o_ranked = o_order + sizeof(size_t) * _configs_count;
+    const size_t o_deques = align_up(o_ranked + sizeof(size_t) * _configs_count, _Alignof(c_sweep_deque));
+    const size_t new_size = o_deques + sizeof(c_sweep_deque) * threads_count;
+    // Контроль целочисленного переполнения не нужен: количество конфигураций ограничено UINT32_MAX.
+
+    // Очереди выравниваются по BLOCK_ALIGN, чтобы рабочие не делили строки кэша.
+    const c_allocator *const allocator = &_perceptron->block->allocator;
+    char *const h = allocator->alloc(allocator->context, new_size, BLOCK_ALIGN);
+    // Контроль успешности выделения памяти.
+    if (h == NULL)
     {
         return -6;
     }
 
-    // Итераций должно быть минимум 10.
-    if (_iterations_count < 10)
+    c_sweep *const sweep = (c_sweep*)h;
+    sweep->configs = _configs;
+    sweep->runs = (c_sweep_run*)(h + o_runs);
+    sweep->order = (size_t*)(h + o_order);
+    sweep->deques = (c_sweep_deque*)(h + o_deques);
+    sweep->threads_count = threads_count;
+    sweep->lessons = _lessons;
+    sweep->lessons_count = _lessons_count;
+    for (size_t w = 0; w < threads_count; ++w)
     {
-        return -7;
+        atomic_init(&sweep->deques[w].range, 0);
     }
 
-    // Зерно должно быть задано.
-    if (_seed == NULL)
+    // Создаем прогоны и заполняем их начальные популяции, как c_pgs_run().
+    ptrdiff_t r_code = 1;
+    for (size_t c = 0; c < _configs_count; ++c)
     {
-        return -8;
-    }
+        c_sweep_run *const run = &sweep->runs[c];
+        run->perceptron = NULL;
+        run->pgs = NULL;
+        run->seed = _configs[c].seed;
+        run->generation = 0;
+        run->elapsed_ns = 0;
+
+        if (r_code < 0)
+        {
+            continue;
+        }
 
-    // Определяем количество входных сигналов перцептрона.
-    const size_t ins_count = _perceptron->topology[0];
-    // Определяем количество выходных сигналов перцептрона.
-    const size_t outs_count = _perceptron->topology[_pgs->layers_count - 1];
-    // Определяем сумму количества входных и выходных сигналов целевого перцептрона.
-    const size_t ins_outs_count = ins_count + outs_count;
-    // Контроль целочисленного переполнения при сложении не нужен, так как он
-    // осуществляется на этапе конструирования перцептрона, на основе которого конструируется pgs.
+        // Обучаемый клон нуждается в плотных весах, даже если исходный перцептрон компактный.
+        run->perceptron = c_perceptron_clone_ex(_perceptron, allocator, NULL);
+        if ( (run->perceptron != NULL) &&
+             (weights_densify(run->perceptron) < 0) )
+        {
+            r_code = -7;
+            continue;
+        }
+        run->pgs = (run->perceptron != NULL) ? c_pgs_create_ex(_perceptron, _configs[c].pop_count, allocator, NULL) : NULL;
+        if (run->pgs == NULL)
+        {
+            r_code = -7;
+            continue;
+        }
 
-    // Определим, сколько памяти занимают входные и выходные сигналы в сумме.
-    const size_t ins_outs_size = sizeof(float) * ins_outs_count;
-    // Контроль целочисленного переполнения не нужен, так как он
-    // осуществляется на этапе конструирования перцептрона.
+        const ptrdiff_t check = pgs_run_check(run->pgs, run->perceptron, _lessons, _lessons_count,
+                                              _iterations_count, &run->seed);
+        if (check < 0)
+        {
+            r_code = -8;
+            continue;
+        }
 
-    // Определим, сколько памяти занимают все уроки, переданные нам.
-    const size_t lessons_size = ins_outs_size * _lessons_count;
-    // Контроль целочисленного переполнения при умножении.
-    if ( (lessons_size == 0) ||
-         (lessons_size / ins_outs_size != _lessons_count) )
-    {
-        return -9;
+        pgs_init(run->pgs, run->perceptron, _configs[c].noise_force, &run->seed);
     }
 
-    // Нужно ли контролировать возможное переполнение указателя при навигации по урокам?
-    // Стандарт крайне невнятно описывает это.
-    // ...
-
-    // Заполняем начальную популяцию.
+    c_workers *workers = NULL;
+    if ( (r_code > 0) &&
+         (threads_count > 1) )
+    {
+        workers = workers_create(allocator, threads_count, NULL);
+        if (workers == NULL)
+        {
+            r_code = -6;
+        }
+    }
 
-    // Одна особь популяции обменивается геномом с заданным перцептроном.
-    float_ptr_swap(&_perceptron->weights, &_pgs->pop[0].weights);
-    // Геномы остальных особей заполняются шумом.
-    for (size_t p = 1; p < _pgs->pop_count; ++p)
+    // Сортируем конфигурации по убыванию размера популяции (при равенстве - по номеру).
+    size_t active_count = _configs_count;
+    for (size_t c = 0; c < _configs_count; ++c)
     {
-        weights_noise(_pgs->pop[p].weights, _perceptron->weights_count, _noise_force, _seed);
+        size_t i = c;
+        while ( (i > 0) &&
+                (_configs[sweep->order[i - 1]].pop_count < _configs[c].pop_count) )
+        {
+            sweep->order[i] = sweep->order[i - 1];
+            --i;
+        }
+        sweep->order[i] = c;
     }
 
-    // Выполняем итерации генетического алгоритма:
-    // - Скрещивание предков и добавление мутаций;
-    // - Тестирование каждого потомка на заданных уроках, подставляя геном потомка в заданный перцептрон;
-    // - Сортировка потомков по возрастанию их суммарной ошибки;
-    // - Перенос геномов лучших потомков в популяцию;
-    // - Повтор.
-    for (size_t i = 0; i < _iterations_count; ++i)
+    // Порядок прогонов перед раскладкой по очередям.
+    size_t *const ranked = (size_t*)(h + o_ranked);
+    for (size_t r = 0; (r_code > 0) && (r < _rungs_count); ++r)
     {
-        // Скрещиваем геномы особей популяции.
-        size_t p3 = 0;
-        for (size_t p1 = 0; p1 < _pgs->pop_count; ++p1)
+        // Раскладываем прогоны по очередям поочередно, чтобы большие популяции достались разным потокам.
+        for (size_t i = 0; i < active_count; ++i)
         {
-            for (size_t p2 = 0; p2 < _pgs->pop_count; ++p2)
+            ranked[i] = sweep->order[i];
+        }
+        size_t index = 0;
+        for (size_t w = 0; w < threads_count; ++w)
+        {
+            const size_t begin = index;
+            for (size_t i = w; i < active_count; i += threads_count)
             {
-                if (p1 != p2)
-                {
-                    weights_cross_and_mut(_pgs->pop[p1].weights,
-                                          _pgs->pop[p2].weights,
-                                          _pgs->pool[p3++].weights,
-                                          _perceptron->weights_count,
-                                          _mut_force,
-                                          _seed);
-                }
+                sweep->order[index++] = ranked[i];
             }
+            atomic_store_explicit(&sweep->deques[w].range, ((uint_least64_t)index << 32) | begin, memory_order_relaxed);
         }
 
-        // Обходим каждого потомка.
-        for (size_t p = 0; p < _pgs->pool_count; ++p)
+        sweep->target = _iterations_count >> (_rungs_count - 1 - r);
+        if (workers != NULL)
         {
-            // Обмениваем местами веса потомка и веса перцептрона.
-            float_ptr_swap(&_perceptron->weights, &_pgs->pool[p].weights);
-            // Сбрасываем ошибку потомка.
-            _pgs->pool[p].sigma = 0.f;
+            workers_run(workers, sweep_task, sweep);
+        } else {
+            sweep_task(sweep, 0);
+        }
 
-            // Обходим все уроки.
-            for (size_t l = 0; l < _lessons_count; ++l)
+        // Упорядочиваем прогоны по ошибке.
+        for (size_t i = 0; i < active_count; ++i)
+        {
+            const size_t c = ranked[i];
+            size_t j = i;
+            while ( (j > 0) &&
+                    (sweep_comp(sweep, c, sweep->order[j - 1]) < 0) )
             {
-                const float *const l_ins = &_lessons[l * ins_outs_count];
-                const float *const l_outs = &_lessons[l * ins_outs_count + ins_count];
-
-                // Помещаем входные сигналы урока на вход перцептрона.
-                memcpy(_perceptron->ins, l_ins, sizeof(float) * ins_count);
+                sweep->order[j] = sweep->order[j - 1];
+                --j;
+            }
+            sweep->order[j] = c;
+        }
 
-                // Пропускаем сигнал через перцептрон.
-                c_perceptron_execute(_perceptron);
+        for (size_t i = 0; i < active_count; ++i)
+        {
+            const size_t c = sweep->order[i];
+            _results[c].sigma = sweep->runs[c].pgs->pop[0].sigma;
+            _results[c].elapsed = (double)sweep->runs[c].elapsed_ns / 1e9;
+            _results[c].iterations_count = sweep->runs[c].generation;
+            _results[c].rung = r;
+        }
 
-                // Вычисляем суммарную ошибку по всем выходным сигналам.
-                for (size_t o = 0; o < outs_count; ++o)
+        // Отсеиваем худшую половину, сохраняя порядок по убыванию размера популяции для следующей ступени.
+        if (r + 1 < _rungs_count)
+        {
+            const size_t kept_count = (active_count + 1) / 2;
+            for (size_t i = kept_count; i < active_count; ++i)
+            {
+                sweep_run_release(&sweep->runs[sweep->order[i]]);
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < active_count; ++i)
+            {
+                if (sweep->runs[ranked[i]].pgs != NULL)
                 {
-                    _pgs->pool[p].sigma += fabs(l_outs[o] - _perceptron->outs[o]);
+                    sweep->order[kept++] = ranked[i];
                 }
             }
-
-            // Возвращаем геномы на места.
-            float_ptr_swap(&_perceptron->weights, &_pgs->pool[p].weights);
+            active_count = kept_count;
+        } else {
+            // Лучшая конфигурация последней ступени передает веса перцептрону.
+            const size_t best = sweep->order[0];
+            if (c_perceptron_set_weights(_perceptron, sweep->runs[best].perceptron->weights,
+                                         _perceptron->weights_count) < 0)
+            {
+                r_code = -6;
+            } else {
+                r_code = (ptrdiff_t)best + 1;
+            }
         }
+    }
 
-        // Сортируем массив сущностей по возрастанию ошибки.
-        qsort(_pgs->pool, _pgs->pool_count, sizeof(c_weights_and_sigma), comp);
-
-        // Отбираем из пула столько лучших, чтобы полностью заполнить популяцию.
-        for (size_t p = 0; p < _pgs->pop_count ; ++p)
+    if (workers != NULL)
+    {
+        workers_delete(workers);
+    }
+    for (size_t c = 0; c < _configs_count; ++c)
+    {
+        if (sweep->runs[c].pgs != NULL)
         {
-            float_ptr_swap(&_pgs->pop[p].weights, &_pgs->pool[p].weights);
+            c_pgs_delete(sweep->runs[c].pgs);
+        }
+        if (sweep->runs[c].perceptron != NULL)
+        {
+            c_perceptron_delete(sweep->runs[c].perceptron);
         }
-
-        // Показываем суммарную ошибку самой умной сети.
-        //printf("sigma: %f\n", _pgs->pool[0].sigma);
     }
+    mem_free(allocator, h, new_size);
 
-    // Свопаем веса (геном) перцептрона с весами (геномом) лучшей особи популяции.
-    float_ptr_swap(&_perceptron->weights, &_pgs->pop[0].weights);
-
-    return 1;
+    return r_code;
 }
@@ -4,14 +4,144 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Потоки, разделяемая память, отображение файлов в память и аппаратные счетчики требуют POSIX.
+// Без POSIX (или если определен C_PERCEPTRON_NO_POSIX) собирается переносимое ядро на C11:
+// пулы потоков выполняют задачи по очереди в вызывающем потоке, профилировщик измеряет только время,
+// а конвейер, разделяемая память, файл подкачки, режим NUMA и асинхронное обучение недоступны.
+#if !defined(C_PERCEPTRON_NO_POSIX) && defined(__unix__)
+#define C_PERCEPTRON_POSIX
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct s_c_perceptron c_perceptron;
 
+// Функции активации слоев (см. c_perceptron_set_activation()).
+#define C_ACTIVATION_SIGMOID 0// 1 / (1 + e^-x), значения (0; 1), по умолчанию.
+#define C_ACTIVATION_TANH 1// Гиперболический тангенс, значения (-1; 1).
+#define C_ACTIVATION_RELU 2// max(x, 0).
+#define C_ACTIVATION_LEAKY_RELU 3// x при x > 0, иначе 0.01 * x.
+#define C_ACTIVATION_HARD_SIGMOID 4// Кусочно-линейное приближение сигмоиды: 0.2 * x + 0.5, ограниченное [0; 1].
+
+// Наклон C_ACTIVATION_LEAKY_RELU при x <= 0 и наклон C_ACTIVATION_HARD_SIGMOID.
+#define C_LEAKY_RELU_SLOPE 0.01f
+#define C_HARD_SIGMOID_SLOPE 0.2f
+
 typedef struct s_c_pgs c_pgs;
 
+typedef struct s_c_published c_published;
+
+typedef struct s_c_pgs_job c_pgs_job;
+
+typedef struct s_c_shm_migration c_shm_migration;
+
+typedef struct s_c_shm_model c_shm_model;
+
+typedef struct s_c_pipeline c_pipeline;
+
+typedef struct s_c_ensemble c_ensemble;
+
+// Сведение выходов членов ансамбля (см. c_ensemble_execute_io()).
+#define C_ENSEMBLE_MEAN 0// Среднее выходов.
+#define C_ENSEMBLE_VOTE 1// Доли голосов за наибольший выход.
+#define C_ENSEMBLE_ALL 2// Выходы всех членов.
+
+typedef struct s_c_profiler c_profiler;
+
+// Фазы профилировщика.
+#define C_PROFILE_CROSS 0// Скрещивание и мутация (c_pgs_run()).
+#define C_PROFILE_EVALUATE 1// Тестирование потомков на уроках (c_pgs_run()).
+#define C_PROFILE_SELECT 2// Сортировка и отбор (c_pgs_run()).
+#define C_PROFILE_EXECUTE 3// Выполнение перцептрона (c_perceptron_execute*()).
+#define C_PROFILE_PHASES 4
+
+// Биты доступных аппаратных счетчиков (поле available статистики).
+#define C_COUNTER_CYCLES 0x01u
+#define C_COUNTER_INSTRUCTIONS 0x02u
+#define C_COUNTER_L1D_MISSES 0x04u
+#define C_COUNTER_LLC_MISSES 0x08u
+#define C_COUNTER_BRANCH_MISSES 0x10u
+
+// Накопленная статистика фазы профилировщика.
+// Значения недоступных счетчиков равны нулю.
+typedef struct s_c_profile_stats
+{
+    uint64_t calls;
+    uint64_t wall_ns;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t l1d_misses;
+    uint64_t llc_misses;
+    uint64_t branch_misses;
+    uint32_t available;
+} c_profile_stats;
+
+// Статистика кэша результатов выполнения (см. c_perceptron_set_cache()).
+typedef struct s_c_cache_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t invalidations;// Сбросы кэша из-за изменения весов.
+    size_t entries_count;
+    size_t capacity;
+} c_cache_stats;
+
+// Конфигурация перебора гиперпараметров (см. c_pgs_sweep()).
+typedef struct s_c_sweep_config
+{
+    size_t pop_count;
+    float noise_force;
+    float mut_force;
+    uint64_t seed;
+} c_sweep_config;
+
+// Результат конфигурации перебора гиперпараметров.
+typedef struct s_c_sweep_result
+{
+    float sigma;// Суммарная ошибка лучшей особи после последней пройденной ступени.
+    double elapsed;// Время обучения конфигурации, секунды.
+    size_t iterations_count;// Пройденных поколений.
+    size_t rung;// Последняя пройденная ступень, конфигурация отсеяна, если rung < _rungs_count - 1.
+} c_sweep_result;
+
+// Распределитель памяти.
+// alloc() должна вернуть память размером _size байт, выровненную по _alignment (степень двойки),
+// или NULL; free() получает тот же размер, что был запрошен при выделении.
+// context передается в обе функции без изменений.
+typedef struct s_c_allocator
+{
+    void *(*alloc)(void *_context, size_t _size, size_t _alignment);
+    void (*free)(void *_context, void *_ptr, size_t _size);
+    void *context;
+} c_allocator;
+
+// Транспорт миграции островной модели (см. c_pgs_set_migration()).
+// send() отправляет геном особи острова _island другим островам.
+// receive() помещает в _weights и _sigma очередной геном другого острова и возвращает > 0,
+// или возвращает 0, если новых геномов нет (не дожидаясь их), или < 0 в случае ошибки;
+// если receive() вернула <= 0, содержимое _weights не определено.
+// context передается в обе функции без изменений.
+typedef struct s_c_migration
+{
+    ptrdiff_t (*send)(void *_context, size_t _island, size_t _generation,
+                      const float *_weights, size_t _weights_count, float _sigma);
+    ptrdiff_t (*receive)(void *_context, size_t _island,
+                         float *_weights, size_t _weights_count, float *_sigma);
+    void *context;
+} c_migration;
+
 c_perceptron *c_perceptron_create(const size_t _layers_count,
                                   const size_t *const _topology,
                                   size_t *const _error);
 
+c_perceptron *c_perceptron_create_ex(const size_t _layers_count,
+                                     const size_t *const _topology,
+                                     const c_allocator *const _allocator,
+                                     size_t *const _error);
+
 ptrdiff_t c_perceptron_delete(c_perceptron *const _perceptron);
 
 ptrdiff_t c_perceptron_noise(c_perceptron *const _perceptron,
@@ -22,25 +152,299 @@ float *c_perceptron_get_ins(c_perceptron *const _perceptron);
 
 const float *c_perceptron_get_outs(c_perceptron *const _perceptron);
 
+size_t c_perceptron_get_layers_count(const c_perceptron *const _perceptron);
+
+const size_t *c_perceptron_get_topology(const c_perceptron *const _perceptron);
+
+ptrdiff_t c_perceptron_set_activation(c_perceptron *const _perceptron,
+                                      const size_t _layer,
+                                      const size_t _activation);
+
+ptrdiff_t c_perceptron_get_activation(const c_perceptron *const _perceptron,
+                                      const size_t _layer);
+
+size_t c_perceptron_get_weights_count(const c_perceptron *const _perceptron);
+
+const float *c_perceptron_get_weights(const c_perceptron *const _perceptron);
+
+ptrdiff_t c_perceptron_copy_weights(const c_perceptron *const _perceptron,
+                                    float *const _weights,
+                                    const size_t _weights_count);
+
+ptrdiff_t c_perceptron_set_weights(c_perceptron *const _perceptron,
+                                   const float *const _weights,
+                                   const size_t _weights_count);
+
+ptrdiff_t c_perceptron_prune(c_perceptron *const _perceptron,
+                             const float _threshold);
+
+ptrdiff_t c_perceptron_prune_sparsity(c_perceptron *const _perceptron,
+                                      const float _sparsity);
+
+ptrdiff_t c_perceptron_set_sparse_threshold(c_perceptron *const _perceptron,
+                                            const float _threshold);
+
+float c_perceptron_get_sparsity(const c_perceptron *const _perceptron);
+
+ptrdiff_t c_perceptron_set_threads(c_perceptron *const _perceptron,
+                                   const size_t _threads_count,
+                                   const size_t _width);
+
+ptrdiff_t c_perceptron_set_profiler(c_perceptron *const _perceptron,
+                                    c_profiler *const _profiler);
+
+ptrdiff_t c_perceptron_set_incremental(c_perceptron *const _perceptron,
+                                       const float _epsilon,
+                                       const size_t _full_interval);
+
+ptrdiff_t c_perceptron_set_cache(c_perceptron *const _perceptron,
+                                 const size_t _capacity);
+
+ptrdiff_t c_perceptron_get_cache_stats(const c_perceptron *const _perceptron,
+                                       c_cache_stats *const _stats);
+
 ptrdiff_t c_perceptron_execute(c_perceptron *const _perceptron);
 
+ptrdiff_t c_perceptron_execute_io(c_perceptron *const _perceptron,
+                                  const float *const _in,
+                                  const size_t _in_stride,
+                                  float *const _out);
+
+ptrdiff_t c_perceptron_execute_rows(c_perceptron *const _perceptron,
+                                    const float *const _in,
+                                    const size_t _in_row_stride,
+                                    float *const _out,
+                                    const size_t _out_row_stride,
+                                    const size_t _rows_count);
+
+ptrdiff_t c_perceptron_evaluate(c_perceptron *const _perceptron,
+                                const float *const _lessons,
+                                const size_t _lessons_count,
+                                const size_t _threads_count,
+                                float *const _sigma);
+
 c_perceptron *c_perceptron_clone(const c_perceptron *const _perceptron,
                                  size_t *const _error);
 
+c_perceptron *c_perceptron_clone_ex(const c_perceptron *const _perceptron,
+                                    const c_allocator *const _allocator,
+                                    size_t *const _error);
+
+c_perceptron *c_perceptron_clone_shared(const c_perceptron *const _perceptron,
+                                        size_t *const _error);
+
+c_perceptron *c_perceptron_clone_shared_ex(const c_perceptron *const _perceptron,
+                                           const c_allocator *const _allocator,
+                                           size_t *const _error);
+
+c_perceptron *c_perceptron_clone_compact(const c_perceptron *const _perceptron,
+                                         size_t *const _error);
+
+c_perceptron *c_perceptron_clone_compact_ex(const c_perceptron *const _perceptron,
+                                            const c_allocator *const _allocator,
+                                            size_t *const _error);
+
 ptrdiff_t c_perceptron_save(const c_perceptron *const _perceptron,
                             const char *const _file_name);
 
 c_perceptron *c_perceptron_load(const char *const _file_name,
                                 size_t *const _error);
 
+c_perceptron *c_perceptron_load_ex(const char *const _file_name,
+                                   const c_allocator *const _allocator,
+                                   size_t *const _error);
+
+ptrdiff_t c_perceptron_save_sparse(const c_perceptron *const _perceptron,
+                                   const char *const _file_name);
+
+c_perceptron *c_perceptron_load_sparse(const char *const _file_name,
+                                       size_t *const _error);
+
+c_perceptron *c_perceptron_load_sparse_ex(const char *const _file_name,
+                                          const c_allocator *const _allocator,
+                                          size_t *const _error);
+
+c_perceptron *c_perceptron_load_compact(const char *const _file_name,
+                                        size_t *const _error);
+
+c_perceptron *c_perceptron_load_compact_ex(const char *const _file_name,
+                                           const c_allocator *const _allocator,
+                                           size_t *const _error);
+
+ptrdiff_t c_perceptron_codegen(const c_perceptron *const _perceptron,
+                               const char *const _file_name,
+                               const char *const _function_name);
+
+// --------------------
+
+c_published *c_published_create(const c_perceptron *const _perceptron,
+                                size_t *const _error);
+
+ptrdiff_t c_published_delete(c_published *const _published);
+
+ptrdiff_t c_published_publish(c_published *const _published,
+                              const c_perceptron *const _perceptron);
+
+size_t c_published_get_version(c_published *const _published);
+
+ptrdiff_t c_published_execute_io(c_published *const _published,
+                                 const float *const _in,
+                                 const size_t _in_stride,
+                                 float *const _out);
+
+// --------------------
+
+c_ensemble *c_ensemble_create(const c_perceptron *const *const _members,
+                              const size_t _members_count,
+                              size_t *const _error);
+
+ptrdiff_t c_ensemble_delete(c_ensemble *const _ensemble);
+
+ptrdiff_t c_ensemble_set_member(c_ensemble *const _ensemble,
+                                const size_t _member,
+                                const c_perceptron *const _perceptron);
+
+size_t c_ensemble_get_members_count(const c_ensemble *const _ensemble);
+
+ptrdiff_t c_ensemble_execute_io(const c_ensemble *const _ensemble,
+                                const float *const _in,
+                                const size_t _in_stride,
+                                const size_t _reduction,
+                                float *const _out);
+
+// --------------------
+
+c_profiler *c_profiler_create(const size_t _trace_capacity,
+                              size_t *const _error);
+
+ptrdiff_t c_profiler_delete(c_profiler *const _profiler);
+
+ptrdiff_t c_profiler_reset(c_profiler *const _profiler);
+
+ptrdiff_t c_profiler_get_stats(const c_profiler *const _profiler,
+                               const size_t _phase,
+                               c_profile_stats *const _stats);
+
+ptrdiff_t c_profiler_write_trace(const c_profiler *const _profiler,
+                                 const char *const _file_name);
+
+// --------------------
+
+#ifdef C_PERCEPTRON_POSIX
+
+c_pipeline *c_pipeline_create(const c_perceptron *const _perceptron,
+                              const size_t _batch_rows,
+                              const size_t _depth,
+                              size_t *const _error);
+
+ptrdiff_t c_pipeline_delete(c_pipeline *const _pipeline);
+
+ptrdiff_t c_pipeline_push(c_pipeline *const _pipeline,
+                          const float *const _in,
+                          const size_t _rows);
+
+ptrdiff_t c_pipeline_pop(c_pipeline *const _pipeline,
+                         float *const _out,
+                         size_t *const _rows);
+
+size_t c_pipeline_get_stages_count(const c_pipeline *const _pipeline);
+
+ptrdiff_t c_pipeline_get_occupancy(c_pipeline *const _pipeline,
+                                   float *const _occupancy,
+                                   size_t *const _batches,
+                                   const size_t _count);
+
+// --------------------
+
+c_shm_migration *c_shm_migration_create(const char *const _name,
+                                        const size_t _islands_count,
+                                        const size_t _slots_count,
+                                        const c_perceptron *const _perceptron,
+                                        size_t *const _error);
+
+ptrdiff_t c_shm_migration_delete(c_shm_migration *const _migration);
+
+ptrdiff_t c_shm_migration_unlink(const char *const _name);
+
+ptrdiff_t c_shm_migration_get_transport(c_shm_migration *const _migration,
+                                        c_migration *const _transport);
+
+// --------------------
+
+c_shm_model *c_shm_model_create(const char *const _name,
+                                const c_perceptron *const _perceptron,
+                                const size_t _slots_count,
+                                size_t *const _error);
+
+c_shm_model *c_shm_model_open(const char *const _name,
+                              size_t *const _error);
+
+ptrdiff_t c_shm_model_delete(c_shm_model *const _model);
+
+ptrdiff_t c_shm_model_unlink(const char *const _name);
+
+ptrdiff_t c_shm_model_publish(c_shm_model *const _model,
+                              const c_perceptron *const _perceptron);
+
+size_t c_shm_model_get_generation(const c_shm_model *const _model);
+
+const size_t *c_shm_model_get_topology(const c_shm_model *const _model,
+                                       size_t *const _layers_count);
+
+ptrdiff_t c_shm_model_execute_io(c_shm_model *const _model,
+                                 const float *const _in,
+                                 const size_t _in_stride,
+                                 float *const _out);
+
+ptrdiff_t c_shm_model_snapshot(c_shm_model *const _model,
+                               c_perceptron *const _perceptron);
+
+#endif
+
 // --------------------
 
 c_pgs *c_pgs_create(const c_perceptron *const _perceptron,
                     const size_t _pop_count,
                     size_t *const _error);
 
+c_pgs *c_pgs_create_ex(const c_perceptron *const _perceptron,
+                       const size_t _pop_count,
+                       const c_allocator *const _allocator,
+                       size_t *const _error);
+
+#ifdef C_PERCEPTRON_POSIX
+c_pgs *c_pgs_create_scratch(const c_perceptron *const _perceptron,
+                            const size_t _pop_count,
+                            const char *const _file_name,
+                            size_t *const _error);
+#endif
+
 ptrdiff_t c_pgs_delete(c_pgs *const _pgs);
 
+ptrdiff_t c_pgs_set_published(c_pgs *const _pgs,
+                              c_published *const _published);
+
+ptrdiff_t c_pgs_set_checkpoint(c_pgs *const _pgs,
+                               const char *const _file_name,
+                               const size_t _interval);
+
+ptrdiff_t c_pgs_set_migration(c_pgs *const _pgs,
+                              const c_migration *const _migration,
+                              const size_t _island,
+                              const size_t _interval,
+                              const size_t _count);
+
+#ifdef C_PERCEPTRON_POSIX
+ptrdiff_t c_pgs_set_numa(c_pgs *const _pgs,
+                         const size_t _threads_count);
+#endif
+
+ptrdiff_t c_pgs_set_lesson_threads(c_pgs *const _pgs,
+                                   const size_t _threads_count);
+
+ptrdiff_t c_pgs_set_profiler(c_pgs *const _pgs,
+                             c_profiler *const _profiler);
+
 ptrdiff_t c_pgs_run(c_pgs *const _pgs,
                     c_perceptron *const _perceptron,
                     const float *const _lessons,
@@ -50,4 +454,56 @@ ptrdiff_t c_pgs_run(c_pgs *const _pgs,
                     const float _mut_force,
                     uint64_t *const _seed);
 
+ptrdiff_t c_pgs_resume(c_pgs *const _pgs,
+                       c_perceptron *const _perceptron,
+                       const float *const _lessons,
+                       const size_t _lessons_count,
+                       const char *const _file_name,
+                       uint64_t *const _seed);
+
+#ifdef C_PERCEPTRON_POSIX
+
+c_pgs_job *c_pgs_run_async(c_pgs *const _pgs,
+                           c_perceptron *const _perceptron,
+                           const float *const _lessons,
+                           const size_t _lessons_count,
+                           const size_t _iterations_count,
+                           const float _noise_force,
+                           const float _mut_force,
+                           uint64_t *const _seed,
+                           size_t *const _error);
+
+size_t c_pgs_job_get_iteration(c_pgs_job *const _job);
+
+float c_pgs_job_get_sigma(c_pgs_job *const _job);
+
+ptrdiff_t c_pgs_job_is_done(c_pgs_job *const _job);
+
+ptrdiff_t c_pgs_job_snapshot(c_pgs_job *const _job,
+                             c_perceptron *const _perceptron);
+
+ptrdiff_t c_pgs_job_cancel(c_pgs_job *const _job);
+
+ptrdiff_t c_pgs_job_wait(c_pgs_job *const _job);
+
+ptrdiff_t c_pgs_job_delete(c_pgs_job *const _job);
+
+#endif
+
+// --------------------
+
+ptrdiff_t c_pgs_sweep(c_perceptron *const _perceptron,
+                      const float *const _lessons,
+                      const size_t _lessons_count,
+                      const c_sweep_config *const _configs,
+                      const size_t _configs_count,
+                      const size_t _iterations_count,
+                      const size_t _rungs_count,
+                      const size_t _threads_count,
+                      c_sweep_result *const _results);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,377 @@
+#ifndef C_PERCEPTRON_HPP
+#define C_PERCEPTRON_HPP
+
+// Обертки C++17 над c_perceptron.
+// - Perceptron<...> - перцептрон с топологией, заданной на этапе компиляции.
+//   Все размеры слоев являются constexpr, веса хранятся в std::array, поэтому для небольших
+//   сетей компилятор может полностью встроить, развернуть и векторизовать прямой проход.
+// - PerceptronHandle и PgsHandle - RAII владельцы c_perceptron* и c_pgs* (только перемещение).
+
+#include "c_perceptron.h"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace c_perceptron_cpp
+{
+
+// Владелец c_perceptron*, удаляет перцептрон в деструкторе.
+class PerceptronHandle
+{
+public:
+    PerceptronHandle() noexcept = default;
+
+    explicit PerceptronHandle(c_perceptron *const _perceptron) noexcept
+        : perceptron(_perceptron)
+    {
+    }
+
+    PerceptronHandle(const PerceptronHandle &) = delete;
+    PerceptronHandle &operator=(const PerceptronHandle &) = delete;
+
+    PerceptronHandle(PerceptronHandle &&_other) noexcept
+        : perceptron(_other.release())
+    {
+    }
+
+    PerceptronHandle &operator=(PerceptronHandle &&_other) noexcept
+    {
+        if (this != &_other)
+        {
+            reset(_other.release());
+        }
+        return *this;
+    }
+
+    ~PerceptronHandle()
+    {
+        reset();
+    }
+
+    // Создает перцептрон, см. c_perceptron_create().
+    // В случае ошибки возвращает пустой владелец.
+    static PerceptronHandle create(const std::size_t _layers_count,
+                                   const std::size_t *const _topology,
+                                   std::size_t *const _error = nullptr) noexcept
+    {
+        return PerceptronHandle(c_perceptron_create(_layers_count, _topology, _error));
+    }
+
+    // Загружает перцептрон из файла, см. c_perceptron_load().
+    // В случае ошибки возвращает пустой владелец.
+    static PerceptronHandle load(const char *const _file_name,
+                                 std::size_t *const _error = nullptr) noexcept
+    {
+        return PerceptronHandle(c_perceptron_load(_file_name, _error));
+    }
+
+    // Клонирует перцептрон, см. c_perceptron_clone().
+    // В случае ошибки возвращает пустой владелец.
+    PerceptronHandle clone(std::size_t *const _error = nullptr) const noexcept
+    {
+        return PerceptronHandle(c_perceptron_clone(perceptron, _error));
+    }
+
+    c_perceptron *get() const noexcept
+    {
+        return perceptron;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return perceptron != nullptr;
+    }
+
+    // Отказывается от владения перцептроном.
+    c_perceptron *release() noexcept
+    {
+        c_perceptron *const h = perceptron;
+        perceptron = nullptr;
+        return h;
+    }
+
+    // Удаляет текущий перцептрон и начинает владеть заданным.
+    void reset(c_perceptron *const _perceptron = nullptr) noexcept
+    {
+        if (perceptron != nullptr)
+        {
+            c_perceptron_delete(perceptron);
+        }
+        perceptron = _perceptron;
+    }
+
+private:
+    c_perceptron *perceptron = nullptr;
+};
+
+// Владелец c_pgs*, удаляет селекционера в деструкторе.
+class PgsHandle
+{
+public:
+    PgsHandle() noexcept = default;
+
+    explicit PgsHandle(c_pgs *const _pgs) noexcept
+        : pgs(_pgs)
+    {
+    }
+
+    PgsHandle(const PgsHandle &) = delete;
+    PgsHandle &operator=(const PgsHandle &) = delete;
+
+    PgsHandle(PgsHandle &&_other) noexcept
+        : pgs(_other.release())
+    {
+    }
+
+    PgsHandle &operator=(PgsHandle &&_other) noexcept
+    {
+        if (this != &_other)
+        {
+            reset(_other.release());
+        }
+        return *this;
+    }
+
+    ~PgsHandle()
+    {
+        reset();
+    }
+
+    // Создает селекционера, см. c_pgs_create().
+    // В случае ошибки возвращает пустой владелец.
+    static PgsHandle create(const c_perceptron *const _perceptron,
+                            const std::size_t _pop_count,
+                            std::size_t *const _error = nullptr) noexcept
+    {
+        return PgsHandle(c_pgs_create(_perceptron, _pop_count, _error));
+    }
+
+    c_pgs *get() const noexcept
+    {
+        return pgs;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return pgs != nullptr;
+    }
+
+    // Отказывается от владения селекционером.
+    c_pgs *release() noexcept
+    {
+        c_pgs *const h = pgs;
+        pgs = nullptr;
+        return h;
+    }
+
+    // Удаляет текущего селекционера и начинает владеть заданным.
+    void reset(c_pgs *const _pgs = nullptr) noexcept
+    {
+        if (pgs != nullptr)
+        {
+            c_pgs_delete(pgs);
+        }
+        pgs = _pgs;
+    }
+
+private:
+    c_pgs *pgs = nullptr;
+};
+
+// Перцептрон с топологией, заданной на этапе компиляции, например Perceptron<1, 5, 8, 1>.
+// Порядок весов и вычислений совпадает с c_perceptron, поэтому результаты execute()
+// совпадают с c_perceptron_execute() для тех же весов.
+template <std::size_t... Topology>
+class Perceptron
+{
+public:
+    static constexpr std::size_t layers_count = sizeof...(Topology);
+
+    static_assert(layers_count >= 2, "Слоев должно быть >= 2.");
+    static_assert(((Topology > 0) && ...), "Каждый слой должен содержать > 0 нейронов.");
+
+    static constexpr std::array<std::size_t, layers_count> topology = {Topology...};
+
+    static constexpr std::size_t ins_count = topology[0];
+    static constexpr std::size_t outs_count = topology[layers_count - 1];
+
+    // Смещение первого веса слоя _l (_l >= 1) в массиве весов.
+    static constexpr std::size_t weights_offset(const std::size_t _l) noexcept
+    {
+        std::size_t offset = 0;
+        for (std::size_t l = 1; l < _l; ++l)
+        {
+            offset += topology[l - 1] * topology[l];
+        }
+        return offset;
+    }
+
+    static constexpr std::size_t weights_count = weights_offset(layers_count);
+
+    alignas(64) std::array<float, weights_count> weights = {};
+
+    // Функции активации слоев (C_ACTIVATION_*), activations[0] не используется.
+    std::array<std::size_t, layers_count> activations = {};
+
+    // Пропускает сигнал через перцептрон.
+    void execute(const float *const _ins,
+                 float *const _outs) const noexcept
+    {
+        forward<1>(_ins, _outs);
+    }
+
+    std::array<float, outs_count> execute(const std::array<float, ins_count> &_ins) const noexcept
+    {
+        std::array<float, outs_count> outs;
+        forward<1>(_ins.data(), outs.data());
+        return outs;
+    }
+
+    // Проверяет, совпадает ли топология заданного перцептрона с топологией шаблона.
+    static bool is_compatible(const c_perceptron *const _perceptron) noexcept
+    {
+        if (c_perceptron_get_layers_count(_perceptron) != layers_count)
+        {
+            return false;
+        }
+        const std::size_t *const h_topology = c_perceptron_get_topology(_perceptron);
+        for (std::size_t l = 0; l < layers_count; ++l)
+        {
+            if (h_topology[l] != topology[l])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Копирует веса и функции активации из заданного перцептрона.
+    // Топология перцептрона должна совпадать с топологией шаблона.
+    bool import_from(const c_perceptron *const _perceptron) noexcept
+    {
+        if (is_compatible(_perceptron) == false)
+        {
+            return false;
+        }
+        // Веса копируются библиотекой, чтобы поддержать и компактные перцептроны.
+        if (c_perceptron_copy_weights(_perceptron, weights.data(), weights_count) < 0)
+        {
+            return false;
+        }
+        for (std::size_t l = 1; l < layers_count; ++l)
+        {
+            activations[l] = static_cast<std::size_t>(c_perceptron_get_activation(_perceptron, l));
+        }
+        return true;
+    }
+
+    // Копирует веса и функции активации в заданный перцептрон.
+    // Топология перцептрона должна совпадать с топологией шаблона.
+    bool export_to(c_perceptron *const _perceptron) const noexcept
+    {
+        if (is_compatible(_perceptron) == false)
+        {
+            return false;
+        }
+        for (std::size_t l = 1; l < layers_count; ++l)
+        {
+            if (c_perceptron_set_activation(_perceptron, l, activations[l]) < 0)
+            {
+                return false;
+            }
+        }
+        return c_perceptron_set_weights(_perceptron, weights.data(), weights_count) > 0;
+    }
+
+    // Создает c_perceptron с такой же топологией, весами и функциями активации.
+    // В случае ошибки возвращает пустой владелец.
+    PerceptronHandle to_c(std::size_t *const _error = nullptr) const noexcept
+    {
+        PerceptronHandle handle = PerceptronHandle::create(layers_count, topology.data(), _error);
+        if ( (handle) &&
+             (export_to(handle.get()) == false) )
+        {
+            handle.reset();
+        }
+        return handle;
+    }
+
+private:
+    template <std::size_t L>
+    void forward(const float *const _ins,
+                 float *const _outs) const noexcept
+    {
+        constexpr std::size_t pn_count = topology[L - 1];
+        constexpr std::size_t cn_count = topology[L];
+        constexpr std::size_t offset = weights_offset(L);
+
+        // Последний слой пишет сразу в _outs, промежуточные - в буфер на стеке.
+        if constexpr (L + 1 == layers_count)
+        {
+            layer<pn_count, cn_count>(_ins, &weights[offset], activations[L], _outs);
+        } else {
+            std::array<float, cn_count> h_outs;
+            layer<pn_count, cn_count>(_ins, &weights[offset], activations[L], h_outs.data());
+            forward<L + 1>(h_outs.data(), _outs);
+        }
+    }
+
+    template <std::size_t PnCount, std::size_t CnCount>
+    static void layer(const float *const _ins,
+                      const float *const _weights,
+                      const std::size_t _activation,
+                      float *const _outs) noexcept
+    {
+        for (std::size_t cn = 0; cn < CnCount; ++cn)
+        {
+            float sum = 0;
+            for (std::size_t pn = 0; pn < PnCount; ++pn)
+            {
+                sum += _ins[pn] * _weights[cn * PnCount + pn];
+            }
+            _outs[cn] = sum;
+        }
+        // Функции активации вычисляются так же, как в c_perceptron (экспонента и тангенс - в double).
+        switch (_activation)
+        {
+            case C_ACTIVATION_TANH:
+                for (std::size_t cn = 0; cn < CnCount; ++cn)
+                {
+                    _outs[cn] = std::tanh(static_cast<double>(_outs[cn]));
+                }
+                break;
+            case C_ACTIVATION_RELU:
+                for (std::size_t cn = 0; cn < CnCount; ++cn)
+                {
+                    _outs[cn] = (_outs[cn] > 0) ? _outs[cn] : 0;
+                }
+                break;
+            case C_ACTIVATION_LEAKY_RELU:
+                for (std::size_t cn = 0; cn < CnCount; ++cn)
+                {
+                    _outs[cn] = (_outs[cn] > 0) ? _outs[cn] : C_LEAKY_RELU_SLOPE * _outs[cn];
+                }
+                break;
+            case C_ACTIVATION_HARD_SIGMOID:
+                for (std::size_t cn = 0; cn < CnCount; ++cn)
+                {
+                    const float h = C_HARD_SIGMOID_SLOPE * _outs[cn] + 0.5f;
+                    _outs[cn] = (h > 0) ? ((h < 1) ? h : 1) : 0;
+                }
+                break;
+            default:
+                for (std::size_t cn = 0; cn < CnCount; ++cn)
+                {
+                    _outs[cn] = 1 / (1 + std::exp(-static_cast<double>(_outs[cn])));
+                }
+                break;
+        }
+    }
+};
+
+}
+
+#endif
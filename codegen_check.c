@@ -0,0 +1,194 @@
+// Проверка c_perceptron_codegen(): сгенерированный код компилируется в разделяемую библиотеку, загружается
+// через dlopen(), и его результаты побитово сравниваются с c_perceptron_execute_io() для нескольких топологий
+// и всех функций активации.
+// Сборка: cc -std=c11 -O2 codegen_check.c c_perceptron.c -lm -lpthread -lrt -ldl -o codegen_check
+// Запуск: ./codegen_check
+// Компилятор сгенерированного кода задается переменной окружения CC (по умолчанию cc).
+// Возвращает 0, если результаты совпадают для всех проверок.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c_perceptron.h"
+
+// Имена временных файлов сгенерированного кода и библиотеки.
+#define CHECK_SOURCE_NAME "codegen_check.tmp.c"
+#define CHECK_LIBRARY_NAME "./codegen_check.tmp.so"
+
+// Количество случайных входов на одну проверку.
+#define CHECK_INPUTS 64
+
+// Количество функций активации (C_ACTIVATION_SIGMOID ... C_ACTIVATION_HARD_SIGMOID).
+#define CHECK_ACTIVATIONS (C_ACTIVATION_HARD_SIGMOID + 1)
+
+typedef void (*generated_function)(const float *_ins, float *_outs);
+
+// Возвращает псевдослучайное число в диапазоне [-_range; _range] (xorshift64).
+static float random_float(uint64_t *const _state,
+                          const float _range)
+{
+    *_state ^= *_state << 13;
+    *_state ^= *_state >> 7;
+    *_state ^= *_state << 17;
+    return _range * ((float)(*_state >> 40) / (float)(1u << 23) - 1.0f);
+}
+
+// Генерирует, компилирует и загружает код перцептрона, затем сравнивает его выходы с c_perceptron_execute_io().
+// Возвращает количество несовпавших выходов или < 0 в случае ошибки.
+static ptrdiff_t check(c_perceptron *const _perceptron,
+                       uint64_t *const _state)
+{
+    if (c_perceptron_codegen(_perceptron, CHECK_SOURCE_NAME, "generated_execute") < 0)
+    {
+        printf("c_perceptron_codegen() error\n");
+        return -1;
+    }
+
+    const char *cc = getenv("CC");
+    if (cc == NULL)
+    {
+        cc = "cc";
+    }
+    char command[512];
+    snprintf(command, sizeof(command), "%s -std=c11 -O2 -shared -fPIC %s -o %s -lm",
+             cc, CHECK_SOURCE_NAME, CHECK_LIBRARY_NAME);
+    if (system(command) != 0)
+    {
+        printf("compilation error: %s\n", command);
+        remove(CHECK_SOURCE_NAME);
+        return -2;
+    }
+    remove(CHECK_SOURCE_NAME);
+
+    void *const library = dlopen(CHECK_LIBRARY_NAME, RTLD_NOW | RTLD_LOCAL);
+    remove(CHECK_LIBRARY_NAME);
+    if (library == NULL)
+    {
+        printf("dlopen() error: %s\n", dlerror());
+        return -3;
+    }
+    // Преобразование через объединение, так как ISO C не допускает приведения void* к указателю на функцию.
+    union
+    {
+        void *object;
+        generated_function function;
+    } symbol;
+    symbol.object = dlsym(library, "generated_execute");
+    if (symbol.object == NULL)
+    {
+        printf("dlsym() error: %s\n", dlerror());
+        dlclose(library);
+        return -4;
+    }
+
+    const size_t layers_count = c_perceptron_get_layers_count(_perceptron);
+    const size_t *const topology = c_perceptron_get_topology(_perceptron);
+    const size_t ins_count = topology[0];
+    const size_t outs_count = topology[layers_count - 1];
+
+    float *const ins = malloc(sizeof(float) * ins_count);
+    float *const outs = malloc(sizeof(float) * outs_count);
+    float *const generated_outs = malloc(sizeof(float) * outs_count);
+    if ( (ins == NULL) ||
+         (outs == NULL) ||
+         (generated_outs == NULL) )
+    {
+        free(ins);
+        free(outs);
+        free(generated_outs);
+        dlclose(library);
+        return -5;
+    }
+
+    ptrdiff_t mismatches = 0;
+    for (size_t i = 0; i < CHECK_INPUTS; ++i)
+    {
+        for (size_t j = 0; j < ins_count; ++j)
+        {
+            ins[j] = random_float(_state, 4.0f);
+        }
+        c_perceptron_execute_io(_perceptron, ins, 1, outs);
+        symbol.function(ins, generated_outs);
+        for (size_t j = 0; j < outs_count; ++j)
+        {
+            if (memcmp(&outs[j], &generated_outs[j], sizeof(float)) != 0)
+            {
+                ++mismatches;
+            }
+        }
+    }
+
+    free(ins);
+    free(outs);
+    free(generated_outs);
+    dlclose(library);
+
+    return mismatches;
+}
+
+int main(void)
+{
+    static const size_t topologies[][4] = {{3, 1, 0, 0},
+                                           {1, 5, 8, 1},
+                                           {17, 33, 9, 4},
+                                           {64, 128, 10, 0}};
+    static const size_t layers_counts[] = {2, 4, 4, 3};
+
+    uint64_t state = 0x9e3779b97f4a7c15u;
+    size_t failed = 0;
+    size_t checks = 0;
+
+    for (size_t t = 0; t < sizeof(layers_counts) / sizeof(layers_counts[0]); ++t)
+    {
+        size_t error = 0;
+        c_perceptron *const perceptron = c_perceptron_create(layers_counts[t], topologies[t], &error);
+        if (perceptron == NULL)
+        {
+            printf("c_perceptron_create() error: %zu\n", error);
+            return 1;
+        }
+
+        const size_t weights_count = c_perceptron_get_weights_count(perceptron);
+        float *const weights = malloc(sizeof(float) * weights_count);
+        if (weights == NULL)
+        {
+            c_perceptron_delete(perceptron);
+            return 1;
+        }
+        for (size_t w = 0; w < weights_count; ++w)
+        {
+            weights[w] = random_float(&state, 2.0f);
+        }
+        c_perceptron_set_weights(perceptron, weights, weights_count);
+        free(weights);
+
+        // Все слои с одной функцией активации, затем функции, чередующиеся по слоям.
+        for (size_t a = 0; a <= CHECK_ACTIVATIONS; ++a)
+        {
+            for (size_t l = 1; l < layers_counts[t]; ++l)
+            {
+                const size_t activation = (a < CHECK_ACTIVATIONS) ? a : (l + t) % CHECK_ACTIVATIONS;
+                c_perceptron_set_activation(perceptron, l, activation);
+            }
+
+            const ptrdiff_t r = check(perceptron, &state);
+            ++checks;
+            if (r != 0)
+            {
+                ++failed;
+                printf("topology %zu, activations %zu: %s (%td)\n", t, a, (r < 0) ? "error" : "mismatch", r);
+            }
+        }
+
+        c_perceptron_delete(perceptron);
+    }
+
+    printf("codegen check: %zu of %zu passed\n", checks - failed, checks);
+
+    return (failed == 0) ? 0 : 1;
+}
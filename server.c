@@ -0,0 +1,631 @@
+// Сервер выполнения перцептрона через Unix сокет с динамическим объединением запросов в пакеты.
+// Сервер загружает перцептрон, сохраненный c_perceptron_save(), принимает запросы от любого количества
+// клиентов, объединяет одновременные запросы в пакеты (не больше max_batch строк, первый запрос пакета
+// ждет не дольше max_wait_us микросекунд) и выполняет пакеты в рабочих потоках через c_perceptron_execute_rows().
+// Сборка: cc -std=c11 -O2 server.c c_perceptron.c -lm -lpthread -lrt -o server
+// Запуск: ./server model socket_path [workers] [max_batch] [max_wait_us]
+// SIGUSR1 печатает статистику (задержки p50/p99, гистограмма размеров пакетов) в JSON (stdout),
+// SIGINT и SIGTERM завершают сервер, напечатав статистику.
+//
+// Протокол (все числа в порядке байт хоста, сигналы - float):
+// - после подключения сервер отправляет uint32 ins_count, uint32 outs_count;
+// - запрос: uint32 id, uint32 rows_count (1..SERVER_ROWS_MAX), затем rows_count * ins_count входных сигналов;
+// - ответ: uint32 id, int32 status, uint32 rows_count, затем rows_count * outs_count выходных сигналов.
+// status == 0 - успех; при status < 0 выходных сигналов нет, и сервер закрывает соединение.
+// Клиент может отправлять следующий запрос, не дожидаясь ответа: ответы идут в порядке запросов.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "c_perceptron.h"
+
+// Максимальное количество строк в одном запросе.
+#define SERVER_ROWS_MAX 65536
+
+// Количество последних задержек, по которым считаются перцентили.
+#define LATENCY_SAMPLES 65536
+
+// Запрос, ожидающий выполнения. Располагается в стеке потока соединения.
+typedef struct s_request
+{
+    struct s_request *next;
+    const float *ins;
+    float *outs;
+    size_t rows_count;
+    uint64_t enqueued_ns;
+    int done;
+    pthread_cond_t cond;
+} request;
+
+// Сервер: очередь запросов, рабочие потоки и статистика.
+typedef struct s_server
+{
+    c_perceptron *perceptron;
+    size_t ins_count;
+    size_t outs_count;
+    size_t max_batch;
+    uint64_t max_wait_ns;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t queue_cond;
+    request *head;
+    request *tail;
+    size_t queued_rows;
+    int stop;
+
+    // Статистика, защищена mutex.
+    uint64_t requests_count;
+    uint64_t rows_count;
+    uint64_t batches_count;
+    uint64_t *batch_hist;// batch_hist[r] - пакетов из r строк, batch_hist[max_batch + 1] - из большего количества.
+    double *latencies;// Задержки в микросекундах, кольцевой буфер на LATENCY_SAMPLES значений.
+    size_t latencies_count;
+} server;
+
+// Рабочий поток со своим клоном перцептрона (веса разделяются).
+typedef struct s_worker
+{
+    server *srv;
+    c_perceptron *perceptron;
+    pthread_t thread;
+} worker;
+
+// Соединение клиента.
+typedef struct s_connection
+{
+    server *srv;
+    int fd;
+} connection;
+
+static volatile sig_atomic_t stop_signal = 0;
+static volatile sig_atomic_t stats_signal = 0;
+
+static void on_stop(int _signal)
+{
+    (void)_signal;
+    stop_signal = 1;
+}
+
+static void on_stats(int _signal)
+{
+    (void)_signal;
+    stats_signal = 1;
+}
+
+// Возвращает текущее монотонное время в наносекундах.
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int comp_double(const void *_p1,
+                       const void *_p2)
+{
+    const double d1 = *(const double*)_p1;
+    const double d2 = *(const double*)_p2;
+    return (d1 > d2) - (d1 < d2);
+}
+
+// Читает ровно _size байт. Возвращает 1 в случае успеха, 0 при закрытии соединения или ошибке.
+static int read_all(const int _fd,
+                    void *const _buffer,
+                    const size_t _size)
+{
+    char *h = _buffer;
+    size_t left = _size;
+    while (left != 0)
+    {
+        const ssize_t r = read(_fd, h, left);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        if (r == 0)
+        {
+            return 0;
+        }
+        h += r;
+        left -= (size_t)r;
+    }
+    return 1;
+}
+
+// Пишет ровно _size байт. Возвращает 1 в случае успеха, 0 в случае ошибки.
+static int write_all(const int _fd,
+                     const void *const _buffer,
+                     const size_t _size)
+{
+    const char *h = _buffer;
+    size_t left = _size;
+    while (left != 0)
+    {
+        const ssize_t r = send(_fd, h, left, MSG_NOSIGNAL);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        h += r;
+        left -= (size_t)r;
+    }
+    return 1;
+}
+
+// Печатает статистику сервера в JSON.
+static void print_stats(server *const _srv)
+{
+    pthread_mutex_lock(&_srv->mutex);
+
+    const size_t samples_count = (_srv->latencies_count < LATENCY_SAMPLES) ? _srv->latencies_count : LATENCY_SAMPLES;
+    double *const sorted = malloc(sizeof(double) * (samples_count + 1));
+    if (sorted != NULL)
+    {
+        memcpy(sorted, _srv->latencies, sizeof(double) * samples_count);
+    }
+
+    printf("{\"requests\":%llu,\"rows\":%llu,\"batches\":%llu,",
+           (unsigned long long)_srv->requests_count, (unsigned long long)_srv->rows_count,
+           (unsigned long long)_srv->batches_count);
+    printf("\"batch_rows\":{");
+    int first = 1;
+    for (size_t r = 1; r <= _srv->max_batch + 1; ++r)
+    {
+        if (_srv->batch_hist[r] != 0)
+        {
+            if (r <= _srv->max_batch)
+            {
+                printf("%s\"%zu\":%llu", (first != 0) ? "" : ",", r, (unsigned long long)_srv->batch_hist[r]);
+            } else {
+                printf("%s\">%zu\":%llu", (first != 0) ? "" : ",", _srv->max_batch, (unsigned long long)_srv->batch_hist[r]);
+            }
+            first = 0;
+        }
+    }
+    printf("},");
+
+    pthread_mutex_unlock(&_srv->mutex);
+
+    if ( (sorted != NULL) &&
+         (samples_count != 0) )
+    {
+        qsort(sorted, samples_count, sizeof(double), comp_double);
+        printf("\"latency_us\":{\"samples\":%zu,\"p50\":%.1f,\"p99\":%.1f,\"max\":%.1f}}\n", samples_count,
+               sorted[(samples_count - 1) / 2], sorted[(size_t)((double)(samples_count - 1) * 0.99)],
+               sorted[samples_count - 1]);
+    } else {
+        printf("\"latency_us\":{\"samples\":0}}\n");
+    }
+    fflush(stdout);
+
+    free(sorted);
+}
+
+// Ставит запрос в очередь и ждет его выполнения.
+static void submit(server *const _srv,
+                   request *const _request)
+{
+    pthread_mutex_lock(&_srv->mutex);
+
+    _request->next = NULL;
+    _request->done = 0;
+    _request->enqueued_ns = now_ns();
+    if (_srv->tail != NULL)
+    {
+        _srv->tail->next = _request;
+    } else {
+        _srv->head = _request;
+    }
+    _srv->tail = _request;
+    _srv->queued_rows += _request->rows_count;
+    pthread_cond_signal(&_srv->queue_cond);
+
+    while (_request->done == 0)
+    {
+        pthread_cond_wait(&_request->cond, &_srv->mutex);
+    }
+
+    pthread_mutex_unlock(&_srv->mutex);
+}
+
+// Поток рабочего: собирает пакет из очереди, выполняет его и раздает результаты запросам.
+// Пакет отправляется на выполнение, когда в очереди набралось max_batch строк или
+// первый запрос очереди ждет max_wait_ns. Запрос не делится между пакетами.
+static void *worker_thread(void *const _arg)
+{
+    worker *const w = _arg;
+    server *const srv = w->srv;
+
+    float *batch_ins = NULL;
+    float *batch_outs = NULL;
+    size_t batch_capacity = 0;
+
+    pthread_mutex_lock(&srv->mutex);
+    for (;;)
+    {
+        while ( (srv->stop == 0) &&
+                (srv->head == NULL) )
+        {
+            pthread_cond_wait(&srv->queue_cond, &srv->mutex);
+        }
+        if (srv->head == NULL)
+        {
+            break;
+        }
+
+        // Ждем заполнения пакета до срока первого запроса.
+        while ( (srv->stop == 0) &&
+                (srv->head != NULL) &&
+                (srv->queued_rows < srv->max_batch) )
+        {
+            const uint64_t deadline = srv->head->enqueued_ns + srv->max_wait_ns;
+            if (now_ns() >= deadline)
+            {
+                break;
+            }
+            struct timespec ts = {(time_t)(deadline / 1000000000u), (long)(deadline % 1000000000u)};
+            pthread_cond_timedwait(&srv->queue_cond, &srv->mutex, &ts);
+        }
+        // Пока ждали, очередь могли забрать другие рабочие.
+        if (srv->head == NULL)
+        {
+            continue;
+        }
+
+        // Забираем запросы в пакет.
+        request *const first = srv->head;
+        request *last = first;
+        size_t rows_count = first->rows_count;
+        while ( (last->next != NULL) &&
+                (rows_count + last->next->rows_count <= srv->max_batch) )
+        {
+            last = last->next;
+            rows_count += last->rows_count;
+        }
+        srv->head = last->next;
+        if (srv->head == NULL)
+        {
+            srv->tail = NULL;
+        }
+        last->next = NULL;
+        srv->queued_rows -= rows_count;
+        // В очереди остались запросы - будим следующего рабочего.
+        if (srv->head != NULL)
+        {
+            pthread_cond_signal(&srv->queue_cond);
+        }
+
+        pthread_mutex_unlock(&srv->mutex);
+
+        // Собираем входные сигналы пакета, выполняем и раздаем выходные сигналы.
+        int status = 0;
+        if (rows_count > batch_capacity)
+        {
+            float *const new_ins = realloc(batch_ins, sizeof(float) * srv->ins_count * rows_count);
+            if (new_ins != NULL)
+            {
+                batch_ins = new_ins;
+            }
+            float *const new_outs = realloc(batch_outs, sizeof(float) * srv->outs_count * rows_count);
+            if (new_outs != NULL)
+            {
+                batch_outs = new_outs;
+            }
+            if ( (new_ins != NULL) &&
+                 (new_outs != NULL) )
+            {
+                batch_capacity = rows_count;
+            } else {
+                status = -1;
+            }
+        }
+        if (status == 0)
+        {
+            size_t r = 0;
+            for (request *q = first; q != NULL; q = q->next)
+            {
+                memcpy(&batch_ins[r * srv->ins_count], q->ins, sizeof(float) * srv->ins_count * q->rows_count);
+                r += q->rows_count;
+            }
+            if (c_perceptron_execute_rows(w->perceptron, batch_ins, srv->ins_count,
+                                          batch_outs, srv->outs_count, rows_count) < 0)
+            {
+                status = -2;
+            }
+        }
+        if (status == 0)
+        {
+            size_t r = 0;
+            for (request *q = first; q != NULL; q = q->next)
+            {
+                memcpy(q->outs, &batch_outs[r * srv->outs_count], sizeof(float) * srv->outs_count * q->rows_count);
+                r += q->rows_count;
+            }
+        }
+
+        pthread_mutex_lock(&srv->mutex);
+
+        ++srv->batches_count;
+        ++srv->batch_hist[(rows_count <= srv->max_batch) ? rows_count : srv->max_batch + 1];
+        for (request *q = first; q != NULL; )
+        {
+            // Запрос может быть освобожден сразу после done = 1.
+            request *const next = q->next;
+            q->done = (status == 0) ? 1 : status;
+            pthread_cond_signal(&q->cond);
+            q = next;
+        }
+    }
+    pthread_mutex_unlock(&srv->mutex);
+
+    free(batch_ins);
+    free(batch_outs);
+
+    return NULL;
+}
+
+// Поток соединения: читает запросы клиента, ставит их в очередь и отправляет ответы.
+static void *connection_thread(void *const _arg)
+{
+    connection *const conn = _arg;
+    server *const srv = conn->srv;
+    const int fd = conn->fd;
+    free(conn);
+
+    float *ins = NULL;
+    float *outs = NULL;
+    size_t capacity = 0;
+
+    request req;
+    pthread_cond_init(&req.cond, NULL);
+
+    const uint32_t hello[2] = {(uint32_t)srv->ins_count, (uint32_t)srv->outs_count};
+    if (write_all(fd, hello, sizeof(hello)) != 0)
+    {
+        for (;;)
+        {
+            uint32_t header[2];
+            if (read_all(fd, header, sizeof(header)) == 0)
+            {
+                break;
+            }
+
+            const size_t rows_count = header[1];
+            int32_t status = 0;
+            if ( (rows_count == 0) ||
+                 (rows_count > SERVER_ROWS_MAX) )
+            {
+                status = -1;
+            } else if (rows_count > capacity) {
+                free(ins);
+                free(outs);
+                ins = malloc(sizeof(float) * srv->ins_count * rows_count);
+                outs = malloc(sizeof(float) * srv->outs_count * rows_count);
+                capacity = ( (ins != NULL) && (outs != NULL) ) ? rows_count : 0;
+                if (capacity == 0)
+                {
+                    status = -2;
+                }
+            }
+            if (status != 0)
+            {
+                const uint32_t response[3] = {header[0], (uint32_t)status, 0};
+                write_all(fd, response, sizeof(response));
+                break;
+            }
+
+            if (read_all(fd, ins, sizeof(float) * srv->ins_count * rows_count) == 0)
+            {
+                break;
+            }
+
+            const uint64_t start_ns = now_ns();
+            req.ins = ins;
+            req.outs = outs;
+            req.rows_count = rows_count;
+            submit(srv, &req);
+            if (req.done < 0)
+            {
+                const uint32_t response[3] = {header[0], (uint32_t)req.done, 0};
+                write_all(fd, response, sizeof(response));
+                break;
+            }
+
+            const uint32_t response[3] = {header[0], 0, (uint32_t)rows_count};
+            if ( (write_all(fd, response, sizeof(response)) == 0) ||
+                 (write_all(fd, outs, sizeof(float) * srv->outs_count * rows_count) == 0) )
+            {
+                break;
+            }
+            const double latency_us = (double)(now_ns() - start_ns) / 1e3;
+
+            pthread_mutex_lock(&srv->mutex);
+            ++srv->requests_count;
+            srv->rows_count += rows_count;
+            srv->latencies[srv->latencies_count % LATENCY_SAMPLES] = latency_us;
+            ++srv->latencies_count;
+            pthread_mutex_unlock(&srv->mutex);
+        }
+    }
+
+    pthread_cond_destroy(&req.cond);
+    free(ins);
+    free(outs);
+    close(fd);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    if ( (argc < 3) ||
+         (argc > 6) )
+    {
+        fprintf(stderr, "usage: %s model socket_path [workers] [max_batch] [max_wait_us]\n", argv[0]);
+        return 1;
+    }
+
+    const char *const socket_path = argv[2];
+    const size_t workers_count = (argc > 3) ? strtoul(argv[3], NULL, 10) : 2;
+    const size_t max_batch = (argc > 4) ? strtoul(argv[4], NULL, 10) : 64;
+    const uint64_t max_wait_us = (argc > 5) ? strtoull(argv[5], NULL, 10) : 200;
+    if ( (workers_count == 0) ||
+         (max_batch == 0) )
+    {
+        fprintf(stderr, "workers and max_batch must be > 0\n");
+        return 1;
+    }
+
+    size_t error;
+    c_perceptron *const perceptron = c_perceptron_load(argv[1], &error);
+    if (perceptron == NULL)
+    {
+        fprintf(stderr, "c_perceptron_load() error: %zu\n", error);
+        return 2;
+    }
+
+    server srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.perceptron = perceptron;
+    srv.ins_count = c_perceptron_get_topology(perceptron)[0];
+    srv.outs_count = c_perceptron_get_topology(perceptron)[c_perceptron_get_layers_count(perceptron) - 1];
+    srv.max_batch = max_batch;
+    srv.max_wait_ns = max_wait_us * 1000u;
+    srv.batch_hist = calloc(max_batch + 2, sizeof(uint64_t));
+    srv.latencies = malloc(sizeof(double) * LATENCY_SAMPLES);
+    worker *const workers = calloc(workers_count, sizeof(worker));
+    if ( (srv.batch_hist == NULL) ||
+         (srv.latencies == NULL) ||
+         (workers == NULL) )
+    {
+        fprintf(stderr, "out of memory\n");
+        return 3;
+    }
+
+    pthread_mutex_init(&srv.mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&srv.queue_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // Сокет.
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "socket path is too long\n");
+        return 4;
+    }
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( (listen_fd < 0) ||
+         (bind(listen_fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+         (listen(listen_fd, 128) != 0) )
+    {
+        perror("socket");
+        return 4;
+    }
+
+    // Рабочие потоки выполняют пакеты на клонах, разделяющих веса загруженного перцептрона.
+    for (size_t w = 0; w < workers_count; ++w)
+    {
+        workers[w].srv = &srv;
+        workers[w].perceptron = c_perceptron_clone_shared(perceptron, &error);
+        if ( (workers[w].perceptron == NULL) ||
+             (pthread_create(&workers[w].thread, NULL, worker_thread, &workers[w]) != 0) )
+        {
+            fprintf(stderr, "worker %zu start error\n", w);
+            return 5;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = on_stats;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    fprintf(stderr, "listening on %s: %zu ins, %zu outs, %zu workers, max_batch %zu, max_wait %llu us\n",
+            socket_path, srv.ins_count, srv.outs_count, workers_count, max_batch, (unsigned long long)max_wait_us);
+
+    // Принимаем соединения, каждое обслуживается своим потоком.
+    while (stop_signal == 0)
+    {
+        if (stats_signal != 0)
+        {
+            stats_signal = 0;
+            print_stats(&srv);
+        }
+
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0)
+        {
+            continue;
+        }
+
+        const int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            continue;
+        }
+        connection *const conn = malloc(sizeof(connection));
+        pthread_t thread;
+        if (conn != NULL)
+        {
+            conn->srv = &srv;
+            conn->fd = fd;
+        }
+        if ( (conn == NULL) ||
+             (pthread_create(&thread, NULL, connection_thread, conn) != 0) )
+        {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    // Рабочие выполняют оставшиеся в очереди запросы и завершаются.
+    pthread_mutex_lock(&srv.mutex);
+    srv.stop = 1;
+    pthread_cond_broadcast(&srv.queue_cond);
+    pthread_mutex_unlock(&srv.mutex);
+    for (size_t w = 0; w < workers_count; ++w)
+    {
+        pthread_join(workers[w].thread, NULL);
+        c_perceptron_delete(workers[w].perceptron);
+    }
+
+    print_stats(&srv);
+
+    // Потоки соединений отсоединены и завершаются вместе с процессом, поэтому очередь и перцептрон не удаляются.
+    return 0;
+}
@@ -0,0 +1,318 @@
+// Перебор гиперпараметров обучения c_pgs_run() через c_pgs_sweep() с выводом результатов в JSON (stdout).
+// Конфигурации задаются сеткой (все сочетания значений списков) или случайной выборкой из диапазонов списков.
+// Сборка: cc -std=c11 -O2 sweep.c c_perceptron.c -lm -lpthread -lrt -o sweep
+// Запуск: ./sweep model lessons iterations [threads=N] [rungs=N] [pop=20,40] [noise=1] [mut=0.5,1]
+//                 [seeds=1,2,3] [random=N] [out=file]
+// - model - перцептрон, сохраненный c_perceptron_save(): задает топологию и геном первой особи;
+// - lessons - текстовый файл с числами, разделенными пробелами: ins outs ins outs...;
+// - rungs - ступени последовательного деления пополам (1 - без отсева);
+// - random=N - вместо сетки N конфигураций: размер популяции, силы шума и мутации равномерно
+//   из [min; max] соответствующих списков, зерна - по порядку, начиная с первого зерна списка;
+// - out - файл, в который сохраняется перцептрон лучшей конфигурации.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c_perceptron.h"
+
+// Максимальное количество значений в списке параметра.
+#define SWEEP_VALUES_MAX 64
+
+// Список значений параметра.
+typedef struct s_values
+{
+    double values[SWEEP_VALUES_MAX];
+    size_t count;
+} values;
+
+// Список зерен: целые числа разбираются без потери точности, которую дал бы double.
+typedef struct s_seeds_values
+{
+    uint64_t values[SWEEP_VALUES_MAX];
+    size_t count;
+} seeds_values;
+
+// Разбирает список чисел через запятую. Возвращает 0 в случае успеха.
+static int parse_values(const char *const _text,
+                        values *const _values)
+{
+    _values->count = 0;
+    const char *h = _text;
+    while (*h != '\0')
+    {
+        if (_values->count == SWEEP_VALUES_MAX)
+        {
+            return -1;
+        }
+        char *end;
+        _values->values[_values->count++] = strtod(h, &end);
+        if (end == h)
+        {
+            return -1;
+        }
+        h = (*end == ',') ? end + 1 : end;
+        if ( (*end != ',') &&
+             (*end != '\0') )
+        {
+            return -1;
+        }
+    }
+    return (_values->count != 0) ? 0 : -1;
+}
+
+// Разбирает список целых чисел через запятую. Возвращает 0 в случае успеха.
+static int parse_seeds(const char *const _text,
+                       seeds_values *const _seeds)
+{
+    _seeds->count = 0;
+    const char *h = _text;
+    while (*h != '\0')
+    {
+        if (_seeds->count == SWEEP_VALUES_MAX)
+        {
+            return -1;
+        }
+        char *end;
+        errno = 0;
+        _seeds->values[_seeds->count++] = strtoull(h, &end, 10);
+        if ( (end == h) ||
+             (*h == '-') ||
+             (errno != 0) )
+        {
+            return -1;
+        }
+        h = (*end == ',') ? end + 1 : end;
+        if ( (*end != ',') &&
+             (*end != '\0') )
+        {
+            return -1;
+        }
+    }
+    return (_seeds->count != 0) ? 0 : -1;
+}
+
+static double values_min(const values *const _values)
+{
+    double m = _values->values[0];
+    for (size_t i = 1; i < _values->count; ++i)
+    {
+        m = (_values->values[i] < m) ? _values->values[i] : m;
+    }
+    return m;
+}
+
+static double values_max(const values *const _values)
+{
+    double m = _values->values[0];
+    for (size_t i = 1; i < _values->count; ++i)
+    {
+        m = (_values->values[i] > m) ? _values->values[i] : m;
+    }
+    return m;
+}
+
+// Возвращает случайное число [0; 1).
+static double random_unit(uint64_t *const _seed)
+{
+    *_seed = *_seed * 6364136223846793005LLU + 1;
+    return (double)(*_seed >> 11) / (double)(1LLU << 53);
+}
+
+// Читает уроки из текстового файла. Возвращает массив сигналов (освобождается free()) или NULL.
+static float *read_lessons(const char *const _file_name,
+                           const size_t _lesson_size,
+                           size_t *const _lessons_count)
+{
+    FILE *const f = fopen(_file_name, "r");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+
+    size_t capacity = 1024;
+    size_t count = 0;
+    float *signals = malloc(sizeof(float) * capacity);
+    float v;
+    while ( (signals != NULL) &&
+            (fscanf(f, "%f", &v) == 1) )
+    {
+        if (count == capacity)
+        {
+            capacity *= 2;
+            float *const h = realloc(signals, sizeof(float) * capacity);
+            if (h == NULL)
+            {
+                free(signals);
+                signals = NULL;
+                break;
+            }
+            signals = h;
+        }
+        signals[count++] = v;
+    }
+    fclose(f);
+
+    if ( (signals == NULL) ||
+         (count == 0) ||
+         (count % _lesson_size != 0) )
+    {
+        free(signals);
+        return NULL;
+    }
+
+    *_lessons_count = count / _lesson_size;
+    return signals;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "usage: %s model lessons iterations [threads=N] [rungs=N] [pop=20,40] [noise=1] [mut=0.5,1]"
+                        " [seeds=1,2,3] [random=N] [out=file]\n", argv[0]);
+        return 1;
+    }
+
+    const size_t iterations_count = strtoul(argv[3], NULL, 10);
+    size_t threads_count = 1;
+    size_t rungs_count = 1;
+    size_t random_count = 0;
+    const char *out_name = NULL;
+    values pops = {{20}, 1};
+    values noises = {{1}, 1};
+    values muts = {{1}, 1};
+    seeds_values seeds = {{1}, 1};
+    for (int a = 4; a < argc; ++a)
+    {
+        const char *const arg = argv[a];
+        int r = 0;
+        if (strncmp(arg, "threads=", 8) == 0)
+        {
+            threads_count = strtoul(arg + 8, NULL, 10);
+        } else if (strncmp(arg, "rungs=", 6) == 0) {
+            rungs_count = strtoul(arg + 6, NULL, 10);
+        } else if (strncmp(arg, "random=", 7) == 0) {
+            random_count = strtoul(arg + 7, NULL, 10);
+        } else if (strncmp(arg, "out=", 4) == 0) {
+            out_name = arg + 4;
+        } else if (strncmp(arg, "pop=", 4) == 0) {
+            r = parse_values(arg + 4, &pops);
+        } else if (strncmp(arg, "noise=", 6) == 0) {
+            r = parse_values(arg + 6, &noises);
+        } else if (strncmp(arg, "mut=", 4) == 0) {
+            r = parse_values(arg + 4, &muts);
+        } else if (strncmp(arg, "seeds=", 6) == 0) {
+            r = parse_seeds(arg + 6, &seeds);
+        } else {
+            r = -1;
+        }
+        if (r != 0)
+        {
+            fprintf(stderr, "bad argument: %s\n", arg);
+            return 1;
+        }
+    }
+
+    size_t error;
+    c_perceptron *const perceptron = c_perceptron_load(argv[1], &error);
+    if (perceptron == NULL)
+    {
+        fprintf(stderr, "c_perceptron_load() error: %zu\n", error);
+        return 2;
+    }
+    const size_t *const topology = c_perceptron_get_topology(perceptron);
+    const size_t layers_count = c_perceptron_get_layers_count(perceptron);
+
+    size_t lessons_count;
+    float *const lessons = read_lessons(argv[2], topology[0] + topology[layers_count - 1], &lessons_count);
+    if (lessons == NULL)
+    {
+        fprintf(stderr, "cannot read lessons from %s\n", argv[2]);
+        c_perceptron_delete(perceptron);
+        return 3;
+    }
+
+    // Собираем конфигурации.
+    const size_t configs_count = (random_count != 0) ? random_count :
+                                 pops.count * noises.count * muts.count * seeds.count;
+    c_sweep_config *const configs = malloc(sizeof(c_sweep_config) * configs_count);
+    c_sweep_result *const results = malloc(sizeof(c_sweep_result) * configs_count);
+    if ( (configs == NULL) ||
+         (results == NULL) )
+    {
+        fprintf(stderr, "out of memory\n");
+        return 4;
+    }
+    if (random_count != 0)
+    {
+        uint64_t seed = seeds.values[0];
+        for (size_t c = 0; c < configs_count; ++c)
+        {
+            const double pop_min = values_min(&pops);
+            configs[c].pop_count = (size_t)(pop_min + random_unit(&seed) * (values_max(&pops) - pop_min + 1));
+            configs[c].noise_force = (float)(values_min(&noises) + random_unit(&seed) * (values_max(&noises) - values_min(&noises)));
+            configs[c].mut_force = (float)(values_min(&muts) + random_unit(&seed) * (values_max(&muts) - values_min(&muts)));
+            configs[c].seed = seeds.values[0] + c;
+        }
+    } else {
+        size_t c = 0;
+        for (size_t p = 0; p < pops.count; ++p)
+        {
+            for (size_t n = 0; n < noises.count; ++n)
+            {
+                for (size_t m = 0; m < muts.count; ++m)
+                {
+                    for (size_t s = 0; s < seeds.count; ++s)
+                    {
+                        configs[c].pop_count = (size_t)pops.values[p];
+                        configs[c].noise_force = (float)noises.values[n];
+                        configs[c].mut_force = (float)muts.values[m];
+                        configs[c].seed = seeds.values[s];
+                        ++c;
+                    }
+                }
+            }
+        }
+    }
+
+    const ptrdiff_t best = c_pgs_sweep(perceptron, lessons, lessons_count, configs, configs_count,
+                                       iterations_count, rungs_count, threads_count, results);
+    if (best < 0)
+    {
+        fprintf(stderr, "c_pgs_sweep() error: %td\n", best);
+        return 5;
+    }
+
+    printf("{\"iterations\":%zu,\"rungs\":%zu,\"threads\":%zu,\"best\":%td,\"configs\":[",
+           iterations_count, rungs_count, threads_count, best - 1);
+    for (size_t c = 0; c < configs_count; ++c)
+    {
+        printf("%s\n{\"pop\":%zu,\"noise\":%g,\"mut\":%g,\"seed\":%llu,\"sigma\":%g,\"elapsed_s\":%.6f,"
+               "\"iterations\":%zu,\"rung\":%zu}",
+               (c == 0) ? "" : ",", configs[c].pop_count, configs[c].noise_force, configs[c].mut_force,
+               (unsigned long long)configs[c].seed, results[c].sigma, results[c].elapsed,
+               results[c].iterations_count, results[c].rung);
+    }
+    printf("\n]}\n");
+
+    int r_code = 0;
+    if (out_name != NULL)
+    {
+        if (c_perceptron_save(perceptron, out_name) < 0)
+        {
+            fprintf(stderr, "c_perceptron_save() error\n");
+            r_code = 6;
+        }
+    }
+
+    free(configs);
+    free(results);
+    free(lessons);
+    c_perceptron_delete(perceptron);
+
+    return r_code;
+}